@@ -0,0 +1,347 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+// End to end timings of FBuild on a generated source tree, built with StubTool instead of a compiler (GCC toolchain, thus Linux).
+// Catches regressions of the dependency check (CppOutOfDate, CppDepends) and the scheduling without a real toolchain.
+//
+//    BuildBenchmark <fbuild> <stubtool> <directory> [name=value...]
+//
+//    units=400     translation units, spread over the libraries
+//    libs=4        libraries, linked into one exe
+//    headers=200   headers, in layers
+//    depth=4       layers of headers. Every header includes headers of the next layer.
+//    fanout=6      includes per file (fan-in follows: units * fanout / headers per header of the first layer)
+//    paths=4       include paths the headers are spread over
+//    delay=0       StubTool sleeps that many microseconds per include while compiling
+//    runs=3        the best run counts
+//    strace=0      1: count the system calls with strace -f -c (if it's installed)
+//
+// Measured (wall time, file system and process counters of fbuild --stats, and the system calls):
+//    full build          from scratch
+//    null build          nothing changed
+//    cold scan           the dependency databases (CppDepends.db) removed, nothing to compile
+//    header touch        one header of the last layer changed
+//
+// The directory is deleted and generated anew.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+
+struct Options {
+   int  units{400};
+   int  libs{4};
+   int  headers{200};
+   int  depth{4};
+   int  fanout{6};
+   int  paths{4};
+   int  delay{0};
+   int  runs{3};
+   bool strace{false};
+};
+
+struct Result {
+   double   milliseconds{0};
+   uint64_t statCalls{0};
+   uint64_t directoryReads{0};
+   uint64_t spawns{0};
+   uint64_t syscalls{0};
+};
+
+
+
+// Deterministic, thus every run generates the same tree.
+class Random {
+public:
+   uint32_t Next (uint32_t bound)
+   {
+      state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+      return static_cast<uint32_t>(state_ >> 33) % bound;
+   }
+
+private:
+   uint64_t state_{0x853c49e6748fea9bULL};
+};
+
+
+static void Write (const std::filesystem::path& file, const std::string& content)
+{
+   std::filesystem::create_directories(file.parent_path());
+   std::ofstream stream(file, std::ios::binary | std::ios::trunc);
+   stream << content;
+   if (!stream) throw std::runtime_error("Unable to write " + file.string());
+}
+
+static std::string HeaderName (int layer, int index)
+{
+   return "h" + std::to_string(layer) + "_" + std::to_string(index) + ".h";
+}
+
+static std::string Quoted (const std::string& text)
+{
+   return "\"" + text + "\"";
+}
+
+static std::vector<std::string> Picks (Random& random, int count, int layer, int perLayer)
+{
+   std::vector<std::string> result;
+   for (int i = 0; i < count; ++i) result.push_back(HeaderName(layer, random.Next(perLayer)));
+
+   std::sort(result.begin(), result.end());
+   result.erase(std::unique(result.begin(), result.end()), result.end());
+   return result;
+}
+
+// The last layer's first header is returned, for the header touch.
+static std::filesystem::path Generate (const std::filesystem::path& root, const Options& options)
+{
+   Random random;
+
+   std::filesystem::remove_all(root);
+
+   const int perLayer = std::max(1, options.headers / options.depth);
+   std::filesystem::path touched;
+
+   // Headers, spread over the include paths
+   for (int layer = 0; layer < options.depth; ++layer) {
+      for (int i = 0; i < perLayer; ++i) {
+         std::string content = "#pragma once\n\n#include <vector>\n";
+
+         if (layer + 1 < options.depth) {
+            for (auto&& include : Picks(random, options.fanout, layer + 1, perLayer)) content += "#include " + Quoted(include) + "\n";
+         }
+
+         content += "\n// #include \"commented.h\"\n#if 0\n#include \"disabled.h\"\n#endif\n\n";
+         content += "inline int f" + std::to_string(layer) + "_" + std::to_string(i) + " () { return " + std::to_string(i) + "; }\n";
+
+         const auto file = root / "include" / ("p" + std::to_string((layer * perLayer + i) % options.paths)) / HeaderName(layer, i);
+         Write(file, content);
+
+         if (layer == options.depth - 1 && i == 0) touched = file;
+      }
+   }
+
+   std::string includes;
+   for (int p = 0; p < options.paths; ++p) includes += (p ? ", " : "") + Quoted("../include/p" + std::to_string(p));
+
+   // Libraries
+   std::string root_js = "Deferred(true);\n\n";
+   std::string libs;
+
+   for (int l = 0; l < options.libs; ++l) {
+      const std::string name = "lib" + std::to_string(l);
+
+      for (int u = l; u < options.units; u += options.libs) {
+         const std::string unit = "u" + std::to_string(u);
+
+         std::string content = "#include " + Quoted(unit + ".h") + "\n";
+         for (auto&& include : Picks(random, options.fanout, 0, perLayer)) content += "#include " + Quoted(include) + "\n";
+         content += "\nint " + unit + " () { return 0; }\n";
+
+         Write(root / name / (unit + ".cpp"), content);
+         Write(root / name / (unit + ".h"), "#pragma once\n\nint " + unit + " ();\n");
+      }
+
+      Write(root / name / "FBuild.js",
+            "ToolChain(\"GCC\");\n"
+            "var lib = new Lib;\n"
+            "lib.Files(Glob(\"*.cpp\"));\n"
+            "lib.Includes(" + includes + ");\n"
+            "lib.Output(\"../out/" + name + ".a\");\n"
+            "lib.Create();\n");
+
+      root_js += "Build(" + Quoted(name) + ");\n";
+      libs += (l ? ", " : "") + Quoted(name + ".a");
+   }
+
+   Write(root / "app" / "main.cpp", "int main () { return 0; }\n");
+   Write(root / "app" / "FBuild.js",
+         "ToolChain(\"GCC\");\n"
+         "var exe = new Exe;\n"
+         "exe.Files(\"main.cpp\");\n"
+         "exe.Output(\"../out/app\");\n"
+         "exe.LibPath(\"../out\");\n"
+         "exe.Libs(" + libs + ");\n"
+         "exe.Create();\n");
+
+   root_js += "Build(\"app\");\n";
+   Write(root / "FBuild.js", root_js);
+
+   return touched;
+}
+
+
+static std::string Read (const std::filesystem::path& file)
+{
+   std::ifstream stream(file, std::ios::binary);
+   return std::string{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+}
+
+// The value of a line of the --stats report
+static uint64_t Counter (const std::string& log, const std::string& name)
+{
+   const auto pos = log.find("   " + name + " ");
+   if (pos == std::string::npos) return 0;
+
+   return std::strtoull(log.c_str() + pos + name.size() + 4, nullptr, 10);
+}
+
+// The calls of the total line of strace -c. The column is looked up in the header, it moved between versions of strace.
+static uint64_t Syscalls (const std::string& summary)
+{
+   std::istringstream stream(summary);
+   std::string line;
+   int column = -1;
+
+   while (std::getline(stream, line)) {
+      std::istringstream words(line);
+      std::vector<std::string> tokens{std::istream_iterator<std::string>{words}, std::istream_iterator<std::string>{}};
+
+      if (column < 0) {
+         auto it = std::find(tokens.begin(), tokens.end(), "calls");
+         if (it != tokens.end() && !tokens.empty() && tokens.front() == "%") column = static_cast<int>(it - tokens.begin()) - 1;   // "% time"
+      }
+      else if (!tokens.empty() && tokens.back() == "total" && column < static_cast<int>(tokens.size())) {
+         return std::strtoull(tokens[column].c_str(), nullptr, 10);
+      }
+   }
+
+   return 0;
+}
+
+static Result Run (const std::filesystem::path& root, const std::string& fbuild, const Options& options)
+{
+   const auto log = root / "fbuild.log";
+   const auto summary = root / "strace.log";
+
+   std::string command = "cd " + Quoted(root.string()) + " && ";
+   if (options.strace) command += "strace -f -c -o " + Quoted(summary.string()) + " ";
+   command += Quoted(fbuild) + " --stats > " + Quoted(log.string()) + " 2>&1";
+
+   const auto start = std::chrono::steady_clock::now();
+   const int rc = std::system(command.c_str());
+   const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+   const auto output = Read(log);
+   if (rc != 0) throw std::runtime_error("fbuild failed:\n" + output);
+
+   Result result;
+   result.milliseconds = elapsed.count();
+   result.statCalls = Counter(output, "vfs.statCalls");
+   result.directoryReads = Counter(output, "vfs.directoryReads");
+   result.spawns = Counter(output, "process.spawns");
+   if (options.strace) result.syscalls = Syscalls(Read(summary));
+
+   return result;
+}
+
+static void Print (const char* name, const Result& result, bool strace)
+{
+   std::printf("%-14s %10.1f ms %10llu %10llu %8llu", name, result.milliseconds,
+               static_cast<unsigned long long>(result.statCalls), static_cast<unsigned long long>(result.directoryReads), static_cast<unsigned long long>(result.spawns));
+   if (strace) std::printf(" %10llu", static_cast<unsigned long long>(result.syscalls));
+   std::printf("\n");
+}
+
+static void RemoveDependencyDatabases (const std::filesystem::path& root)
+{
+   for (auto&& entry : std::filesystem::recursive_directory_iterator{root}) {
+      if (entry.path().filename() == "CppDepends.db") std::filesystem::remove(entry.path());
+   }
+}
+
+
+int main (int argc, char** argv)
+{
+   if (argc < 4) {
+      std::cerr << "Usage: BuildBenchmark <fbuild> <stubtool> <directory> [units=400] [libs=4] [headers=200] [depth=4] [fanout=6] [paths=4] [delay=0] [runs=3] [strace=0]" << std::endl;
+      return 1;
+   }
+
+   try {
+      const std::string fbuild = std::filesystem::absolute(argv[1]).string();
+      const std::string stub = std::filesystem::absolute(argv[2]).string();
+      const std::filesystem::path root = std::filesystem::absolute(argv[3]);
+
+      Options options;
+      const std::map<std::string, int*> numbers{
+         {"units", &options.units}, {"libs", &options.libs}, {"headers", &options.headers}, {"depth", &options.depth},
+         {"fanout", &options.fanout}, {"paths", &options.paths}, {"delay", &options.delay}, {"runs", &options.runs}
+      };
+
+      for (int i = 4; i < argc; ++i) {
+         const std::string arg = argv[i];
+         const auto pos = arg.find('=');
+         const auto name = arg.substr(0, pos);
+         const int value = pos == std::string::npos ? 1 : std::atoi(arg.c_str() + pos + 1);
+
+         auto it = numbers.find(name);
+         if (it != numbers.end()) *it->second = std::max(it == numbers.find("delay") ? 0 : 1, value);
+         else if (name == "strace") options.strace = value != 0;
+         else throw std::runtime_error("Unknown option " + arg);
+      }
+
+      // FBuild takes the tools from the environment (see ActualCompilerGcc::Driver, ActualLinkerGcc, ActualLibrarianAr)
+      for (auto&& variable : {"CC", "CXX", "AR"}) {
+#ifdef _WIN32
+         _putenv_s(variable, stub.c_str());
+#else
+         ::setenv(variable, stub.c_str(), 1);
+#endif
+      }
+
+      const std::string delay = std::to_string(options.delay);
+#ifdef _WIN32
+      _putenv_s("FB_STUB_DELAY_US", delay.c_str());
+#else
+      ::setenv("FB_STUB_DELAY_US", delay.c_str(), 1);
+#endif
+
+      std::printf("%d units in %d libs, %d headers in %d layers, fanout %d, %d include paths, best of %d\n\n",
+                  options.units, options.libs, options.headers, options.depth, options.fanout, options.paths, options.runs);
+      std::printf("%-14s %13s %10s %10s %8s%s\n", "", "wall", "stat calls", "dir reads", "spawns", options.strace ? "   syscalls" : "");
+
+      std::map<std::string, Result> best;
+      const auto keep = [&best] (const std::string& name, const Result& result) {
+         auto it = best.find(name);
+         if (it == best.end() || result.milliseconds < it->second.milliseconds) best[name] = result;
+      };
+
+      for (int run = 0; run < options.runs; ++run) {
+         const auto touched = Generate(root, options);
+
+         keep("full build", Run(root, fbuild, options));
+         keep("null build", Run(root, fbuild, options));
+
+         RemoveDependencyDatabases(root);
+         keep("cold scan", Run(root, fbuild, options));
+
+         std::ofstream{touched, std::ios::app} << "inline int touched" << run << " () { return 0; }\n";
+         keep("header touch", Run(root, fbuild, options));
+      }
+
+      for (auto&& name : {"full build", "null build", "cold scan", "header touch"}) Print(name, best[name], options.strace);
+   }
+   catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,48 @@
+
+if (args.build == undefined) args.build = "Release";
+if (args.build != "Debug" && args.build != "Release") throw "build='<Release|Debug>' expected";
+
+var exe = new Exe;
+exe.Build(args.build);
+exe.Files("ScannerBenchmark.cpp", "../FBuild/IncludeScanner.cpp");
+exe.CRT("Static");
+exe.Defines("_CRT_SECURE_NO_WARNINGS");
+exe.WarningLevel(4).WarningAsError(true);
+
+exe.Output("../" + args.build + "/ScannerBenchmark.exe");
+
+exe.Create();
+
+var stub = new Exe;
+stub.Build(args.build);
+stub.Files("StubTool.cpp");
+stub.CRT("Static");
+stub.Defines("_CRT_SECURE_NO_WARNINGS");
+stub.WarningLevel(4).WarningAsError(true);
+
+stub.Output("../" + args.build + "/StubTool.exe");
+
+stub.Create();
+
+var build = new Exe;
+build.Build(args.build);
+build.Files("BuildBenchmark.cpp");
+build.CRT("Static");
+build.Defines("_CRT_SECURE_NO_WARNINGS");
+build.WarningLevel(4).WarningAsError(true);
+
+build.Output("../" + args.build + "/BuildBenchmark.exe");
+
+build.Create();
+
+var micro = new Exe;
+micro.Build(args.build);
+micro.Files("MicroBenchmark.cpp", "../FBuild/CppDepends.cpp", "../FBuild/DependencyDatabase.cpp", "../FBuild/IncludeScanner.cpp", "../FBuild/MemoryMappedFile.cpp",
+            "../FBuild/Hash.cpp", "../FBuild/Vfs.cpp", "../FBuild/PathTable.cpp", "../FBuild/Stats.cpp", "../FBuild/JobSystem.cpp");
+micro.CRT("Static");
+micro.Defines("_CRT_SECURE_NO_WARNINGS");
+micro.WarningLevel(4).WarningAsError(true);
+
+micro.Output("../" + args.build + "/MicroBenchmark.exe");
+
+micro.Create();
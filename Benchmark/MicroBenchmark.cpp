@@ -0,0 +1,274 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+// Throughput (MB/s), time and heap allocations per operation of the hot paths of the dependency check:
+//    Parser.h            the line and directive matching, over the files in memory
+//    CppDepends          the includes of all translation units, cold (nothing scanned yet) and warm (memoized)
+//    DependencyDatabase  Put and Save, Load and Get of the dependencies found
+//    BinaryStream.h      operator< and operator> of the records the stores are made of
+//
+// The files of the directory are the sources, the *.c* files of it are the translation units.
+//
+//    MicroBenchmark <directory> [iterations] [include paths...]
+
+#include "../FBuild/CppDepends.h"
+#include "../FBuild/DependencyDatabase.h"
+#include "../FBuild/BinaryStream.h"
+#include "../FBuild/Parser.h"
+#include "../FBuild/PathTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new (size_t size)
+{
+   allocations.fetch_add(1, std::memory_order_relaxed);
+
+   if (void* p = std::malloc(size ? size : 1)) return p;
+   throw std::bad_alloc{};
+}
+
+void operator delete (void* p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete (void* p, size_t) noexcept
+{
+   std::free(p);
+}
+
+
+// The best of the iterations. Work returns something depending on the result, thus it can't be optimized away.
+static void Measure (const std::string& name, size_t operations, size_t bytes, int iterations, const std::function<size_t (int)>& work)
+{
+   double best = 1e30;
+   uint64_t allocated = 0;
+   size_t check = 0;
+
+   for (int i = 0; i < iterations; ++i) {
+      const uint64_t before = allocations.load();
+      const auto start = std::chrono::steady_clock::now();
+
+      check += work(i);
+
+      const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+      allocated = allocations.load() - before;
+      best = std::min(best, seconds.count());
+   }
+
+   const double ops = static_cast<double>(std::max<size_t>(operations, 1));
+   std::printf("%-24s %10.1f MB/s %12.1f ns/op %10.2f allocs/op  (%zu)\n", name.c_str(), bytes / best / 1e6, best * 1e9 / ops, allocated / ops, check);
+}
+
+
+static const std::string includeString = "include";
+
+static size_t Lines (const std::string& file)
+{
+   size_t lines = 0;
+
+   for (auto it = file.cbegin(), end = file.cend(); it != end; ) {
+      it = SkipWhitespaces(it, end);
+
+      auto eol = ConsumeUntil(it, end, '\n');
+      it = eol == it ? end : eol + 1;
+      ++lines;
+   }
+
+   return lines;
+}
+
+static size_t Directives (const std::string& file)
+{
+   size_t includes = 0;
+   const char* it = file.data();
+   const char* end = file.data() + file.size();
+
+   while ((it = std::find(it, end, '#')) != end) {
+      it = SkipWhitespaces(it + 1, end);
+
+      auto after = ConsumeIfEqual(it, end, includeString.cbegin(), includeString.cend());
+      if (after != it) ++includes;
+      it = after;
+   }
+
+   return includes;
+}
+
+
+int main (int argc, char** argv)
+{
+   if (argc < 2) {
+      std::cerr << "Usage: MicroBenchmark <directory> [iterations] [include paths...]" << std::endl;
+      return 1;
+   }
+
+   try {
+      const int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+      const std::vector<std::string> headers{".h", ".hh", ".hpp", ".hxx", ".inl"};
+      const std::vector<std::string> sources{".c", ".cc", ".cpp", ".cxx"};
+
+      std::vector<std::string> files;
+      std::vector<std::filesystem::path> units;
+      std::vector<std::pair<std::string, unsigned long long>> records;
+      size_t bytes = 0;
+
+      for (auto&& entry : std::filesystem::recursive_directory_iterator{argv[1], std::filesystem::directory_options::skip_permission_denied}) {
+         if (!entry.is_regular_file()) continue;
+
+         const auto extension = entry.path().extension().string();
+         const bool source = std::find(sources.begin(), sources.end(), extension) != sources.end();
+         if (!source && std::find(headers.begin(), headers.end(), extension) == headers.end()) continue;
+
+         std::ifstream stream(entry.path(), std::ios::binary);
+         files.emplace_back(std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{});
+         bytes += files.back().size();
+
+         if (source) units.push_back(entry.path());
+         records.emplace_back(std::filesystem::canonical(entry.path()).string(), files.back().size());
+      }
+
+      std::printf("%zu files (%zu translation units), %.1f MB, best of %d\n\n", files.size(), units.size(), bytes / 1e6, iterations);
+
+      // Parser.h
+      Measure("Parser lines", files.size(), bytes, iterations, [&files] (int) {
+         size_t lines = 0;
+         for (auto&& file : files) lines += Lines(file);
+         return lines;
+      });
+
+      Measure("Parser directives", files.size(), bytes, iterations, [&files] (int) {
+         size_t includes = 0;
+         for (auto&& file : files) includes += Directives(file);
+         return includes;
+      });
+
+      // CppDepends. A define of its own makes every cold iteration scan and walk everything again (the memoization is per defines).
+      // The include paths are searched once per process only, thus cold doesn't contain that.
+      if (!units.empty()) {
+         CppDepends::Settings settings;
+         for (int i = 3; i < argc; ++i) settings.AddIncludePath(std::filesystem::canonical(argv[i]));
+
+         std::vector<std::vector<PathTable::Id>> dependencies;
+         std::unordered_set<PathTable::Id> distinct;
+         size_t edges = 0;
+
+         for (auto&& unit : units) {
+            CppDepends depends{unit, settings};
+            dependencies.emplace_back(depends.Begin(), depends.End());
+            distinct.insert(depends.Begin(), depends.End());
+            edges += depends.Size();
+         }
+
+         size_t scanned = 0;
+         for (auto&& id : distinct) scanned += std::filesystem::file_size(std::string{PathTable::Name(id)});
+         for (auto&& unit : units) scanned += std::filesystem::file_size(unit);
+
+         std::printf("\n%zu headers, %zu dependencies\n\n", distinct.size(), edges);
+
+         std::vector<CppDepends::Settings> cold(iterations, settings);
+         for (int i = 0; i < iterations; ++i) cold[i].AddDefine("FB_MICROBENCHMARK_" + std::to_string(i));
+
+         Measure("CppDepends cold", units.size(), scanned, iterations, [&units, &cold] (int i) {
+            size_t found = 0;
+            for (auto&& unit : units) found += CppDepends{unit, cold[i]}.Size();
+            return found;
+         });
+
+         Measure("CppDepends warm", units.size(), scanned, iterations, [&units, &settings] (int) {
+            size_t found = 0;
+            for (auto&& unit : units) found += CppDepends{unit, settings}.Size();
+            return found;
+         });
+
+         // DependencyDatabase, in a directory of its own
+         const auto directory = std::filesystem::temp_directory_path() / "FBuildMicroBenchmark";
+         std::filesystem::create_directories(directory);
+
+         std::vector<std::vector<std::pair<PathTable::Id, uint64_t>>> times;
+         std::vector<std::string> names;
+         for (size_t u = 0; u < units.size(); ++u) {
+            auto& entry = times.emplace_back();
+            for (auto&& id : dependencies[u]) entry.emplace_back(id, CppDepends::LastWriteTime(std::string{PathTable::Name(id)}));
+
+            auto name = std::filesystem::canonical(units[u]);
+            names.push_back(name.make_preferred().string());
+         }
+
+         const auto save = [&] (int) {
+            std::filesystem::remove(directory / "CppDepends.db");
+
+            DependencyDatabase database{directory, settings.Key()};
+            for (size_t u = 0; u < units.size(); ++u) database.Put(names[u], times[u]);
+            database.Save();
+            return units.size();
+         };
+
+         save(0);
+         const size_t size = std::filesystem::file_size(directory / "CppDepends.db");
+
+         Measure("Database put and save", units.size(), size, iterations, save);
+
+         Measure("Database load and get", units.size(), size, iterations, [&] (int) {
+            DependencyDatabase database{directory, settings.Key()};
+            database.Validate(0);
+
+            size_t found = 0;
+            std::vector<PathTable::Id> deps;
+            uint64_t maxTime;
+            for (auto&& name : names) found += database.Get(name, deps, maxTime) ? deps.size() : 0;
+            return found;
+         });
+
+         std::filesystem::remove_all(directory);
+      }
+
+      // BinaryStream.h. The records of the signature and timing stores: a path and a number.
+      std::printf("\n");
+
+      std::ostringstream written;
+      written < records;
+      const std::string stream = written.str();
+
+      Measure("BinaryStream write", records.size(), stream.size(), iterations, [&records] (int) {
+         std::ostringstream out;
+         out < records;
+         return static_cast<size_t>(out.tellp());
+      });
+
+      Measure("BinaryStream read", records.size(), stream.size(), iterations, [&stream] (int) {
+         std::istringstream in(stream);
+         std::vector<std::pair<std::string, unsigned long long>> read;
+         in > read;
+         return read.size();
+      });
+   }
+   catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+// Throughput of the include scanner in GB/s, compared to the byte-at-a-time loop it replaced.
+// The files are read into memory first, thus the disk isn't measured.
+//
+//    ScannerBenchmark <directory> [iterations]
+
+#include "../FBuild/IncludeScanner.h"
+#include "../FBuild/Parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+
+using Includes = std::vector<std::pair<char, std::string>>;
+
+
+static const std::string includeString = "include";
+
+// CppDepends::Includes up to now
+static Includes PreviousScan (const char* it, const char* end)
+{
+   Includes includes;
+
+   it = std::find(it, end, '#');
+   while (it != end) {
+      ++it;
+      it = SkipWhitespaces(it, end);
+      auto itTmp = ConsumeIfEqual(it, end, includeString.cbegin(), includeString.cend());
+      if (it != itTmp) {
+         it = itTmp;
+         it = SkipWhitespaces(it, end);
+         if (it == end) break;
+
+         auto itStart = it + 1;
+         if (*it == '\"') {
+            it = ConsumeUntil(itStart, end, '\"');
+            if (it != itStart) includes.emplace_back('\"', std::string(itStart, it));
+         }
+         else if (*it == '<') {
+            it = ConsumeUntil(itStart, end, '>');
+            if (it != itStart) includes.emplace_back('<', std::string(itStart, it));
+         }
+      }
+
+      it = std::find(it, end, '#');
+   }
+
+   return includes;
+}
+
+
+static void Measure (const std::string& name, const std::vector<std::string>& files, size_t bytes, int iterations, const std::function<Includes (const char*, const char*)>& scan)
+{
+   size_t found = 0;
+   double best = 1e30;
+
+   for (int i = 0; i < iterations; ++i) {
+      found = 0;
+
+      const auto start = std::chrono::steady_clock::now();
+      for (auto&& file : files) found += scan(file.data(), file.data() + file.size()).size();
+      const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+      best = std::min(best, seconds.count());
+   }
+
+   std::printf("%-14s %8.2f GB/s  %10.3f ms  %8zu includes\n", name.c_str(), bytes / best / 1e9, best * 1e3, found);
+}
+
+
+int main (int argc, char** argv)
+{
+   if (argc < 2) {
+      std::cerr << "Usage: ScannerBenchmark <directory> [iterations]" << std::endl;
+      return 1;
+   }
+
+   const int iterations = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+   const std::vector<std::string> extensions{".h", ".hh", ".hpp", ".hxx", ".inl", ".c", ".cc", ".cpp", ".cxx"};
+
+   std::vector<std::string> files;
+   size_t bytes = 0;
+
+   for (auto&& entry : std::filesystem::recursive_directory_iterator{argv[1], std::filesystem::directory_options::skip_permission_denied}) {
+      if (!entry.is_regular_file()) continue;
+      if (std::find(extensions.begin(), extensions.end(), entry.path().extension().string()) == extensions.end()) continue;
+
+      std::ifstream stream(entry.path(), std::ios::binary);
+      files.emplace_back(std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{});
+      bytes += files.back().size();
+   }
+
+   std::printf("%zu files, %.1f MB, best of %d\n\n", files.size(), bytes / 1e6, iterations);
+
+   Measure("Previous", files, bytes, iterations, PreviousScan);
+
+   for (auto isa : {IncludeScanner::Isa::Scalar, IncludeScanner::Isa::Sse2, IncludeScanner::Isa::Avx2}) {
+      if (!IncludeScanner::Supported(isa)) continue;
+
+      Measure(IncludeScanner::Name(isa), files, bytes, iterations, [isa] (const char* begin, const char* end) {
+         return IncludeScanner::Scan(begin, end, isa);
+      });
+   }
+
+   // Skips comments, literals and #if 0. Without macros, as they're target specific.
+   const IncludeScanner::Macros macros;
+
+   for (auto isa : {IncludeScanner::Isa::Scalar, IncludeScanner::Isa::Sse2, IncludeScanner::Isa::Avx2}) {
+      if (!IncludeScanner::Supported(isa)) continue;
+
+      Measure(std::string{"Precise "} + IncludeScanner::Name(isa), files, bytes, iterations, [isa, &macros] (const char* begin, const char* end) {
+         return IncludeScanner::ScanPrecise(begin, end, macros, isa);
+      });
+   }
+
+   return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+// Stands in for the GCC toolchain in BuildBenchmark (as CC, CXX and AR), thus FBuild can be measured without a compiler.
+//
+//    Compiling (-c): Resolves the includes like the preprocessor would (quoted ones next to the including file first, then the -I paths)
+//                    and writes the object (-o) and the dependency file (-MF).
+//    ar rcsT:        Writes a thin archive.
+//    Linking:        Writes the output (-o).
+//
+// FB_STUB_DELAY_US: Microseconds to sleep per resolved include while compiling, to give the files a cost for the scheduler.
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+static std::string Read (const std::filesystem::path& file)
+{
+   std::ifstream stream(file, std::ios::binary);
+   return std::string{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+}
+
+// Every #include of the file. No conditions, no comments: the generated sources don't need them.
+static std::vector<std::pair<char, std::string>> Includes (const std::string& content)
+{
+   std::vector<std::pair<char, std::string>> result;
+
+   size_t pos = 0;
+   while ((pos = content.find("#include", pos)) != std::string::npos) {
+      pos += 8;
+      while (pos < content.size() && (content[pos] == ' ' || content[pos] == '\t')) ++pos;
+      if (pos == content.size()) break;
+
+      const char open = content[pos];
+      const char close = open == '<' ? '>' : open == '"' ? '"' : 0;
+      if (!close) continue;
+
+      const auto end = content.find(close, pos + 1);
+      if (end == std::string::npos) break;
+
+      result.emplace_back(open, content.substr(pos + 1, end - pos - 1));
+      pos = end + 1;
+   }
+
+   return result;
+}
+
+static void Resolve (const std::filesystem::path& file, const std::vector<std::filesystem::path>& includePaths, std::set<std::string>& found)
+{
+   for (auto&& [kind, name] : Includes(Read(file))) {
+      std::filesystem::path include;
+      std::error_code ec;
+
+      if (kind == '"' && std::filesystem::is_regular_file(file.parent_path() / name, ec)) include = file.parent_path() / name;
+      else {
+         for (auto&& path : includePaths) {
+            if (std::filesystem::is_regular_file(path / name, ec)) {
+               include = path / name;
+               break;
+            }
+         }
+      }
+
+      if (include.empty()) continue;   // e.g. <vector>
+
+      include = std::filesystem::canonical(include, ec);
+      if (ec) continue;
+
+      if (found.insert(include.string()).second) Resolve(include, includePaths, found);
+   }
+}
+
+static int Compile (const std::vector<std::string>& args)
+{
+   std::vector<std::filesystem::path> includePaths;
+   std::string output, depFile, source;
+
+   for (size_t i = 1; i < args.size(); ++i) {
+      const auto& arg = args[i];
+
+      if (arg.rfind("-I", 0) == 0) includePaths.emplace_back(arg.size() > 2 ? arg.substr(2) : args[++i]);
+      else if (arg == "-o" && i + 1 < args.size()) output = args[++i];
+      else if (arg == "-MF" && i + 1 < args.size()) depFile = args[++i];
+      else if (arg == "-include" || arg == "-x") ++i;
+      else if (arg[0] != '-') source = arg;
+   }
+
+   if (source.empty() || output.empty()) {
+      std::cerr << "StubTool: source or output missing" << std::endl;
+      return 1;
+   }
+
+   std::set<std::string> found;
+   Resolve(source, includePaths, found);
+
+   if (const char* delay = std::getenv("FB_STUB_DELAY_US")) {
+      std::this_thread::sleep_for(std::chrono::microseconds{std::atoll(delay) * static_cast<long long>(found.size() + 1)});
+   }
+
+   {
+      std::ofstream stream(output, std::ios::binary | std::ios::trunc);
+      stream << "stub object of " << source << " (" << found.size() << " includes)\n";
+   }
+
+   if (!depFile.empty()) {
+      std::ofstream stream(depFile, std::ios::binary | std::ios::trunc);
+      stream << output << ": " << source;
+      for (auto&& include : found) stream << " \\\n  " << include;
+      stream << "\n";
+   }
+
+   return 0;
+}
+
+static int Archive (const std::vector<std::string>& args)
+{
+   if (args.size() < 3) {
+      std::cerr << "StubTool: archive missing" << std::endl;
+      return 1;
+   }
+
+   std::ofstream stream(args[2], std::ios::binary | std::ios::trunc);
+   stream << "!<thin>\n";
+   for (size_t i = 3; i < args.size(); ++i) stream << args[i] << "\n";
+
+   return 0;
+}
+
+static int Link (const std::vector<std::string>& args)
+{
+   std::string output;
+   for (size_t i = 1; i + 1 < args.size(); ++i) {
+      if (args[i] == "-o") output = args[i + 1];
+   }
+
+   if (output.empty()) {
+      std::cerr << "StubTool: output missing" << std::endl;
+      return 1;
+   }
+
+   std::ofstream stream(output, std::ios::binary | std::ios::trunc);
+   for (size_t i = 1; i < args.size(); ++i) stream << args[i] << "\n";
+
+   return 0;
+}
+
+
+int main (int argc, char** argv)
+{
+   const std::vector<std::string> args(argv, argv + argc);
+
+   try {
+      if (args.size() > 1 && args[1] == "rcsT") return Archive(args);
+
+      for (auto&& arg : args) {
+         if (arg == "-c") return Compile(args);
+      }
+
+      return Link(args);
+   }
+   catch (std::exception& e) {
+      std::cerr << "StubTool: " << e.what() << std::endl;
+      return 1;
+   }
+}
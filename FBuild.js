@@ -1,5 +1,11 @@
+/* Create() only registers the targets. They're built in parallel after this script */
+Deferred(true);
+
 /* Build Duktape */
 Build("Duktape");
 
 /* Build  FBuild */
 Build("FBuild");
+
+/* The benchmarks only on request: benchmark=true */
+if (args.benchmark) Build("Benchmark");
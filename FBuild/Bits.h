@@ -0,0 +1,32 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// The index of the lowest set bit. mask must not be 0.
+inline unsigned CountTrailingZeros (uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+   unsigned long index;
+   _BitScanForward64(&index, mask);
+   return index;
+#elif defined(_MSC_VER)
+   unsigned long index;
+   if (_BitScanForward(&index, static_cast<uint32_t>(mask))) return index;
+   _BitScanForward(&index, static_cast<uint32_t>(mask >> 32));
+   return index + 32;
+#else
+   return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
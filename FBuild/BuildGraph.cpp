@@ -0,0 +1,189 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "BuildGraph.h"
+#include "JobSystem.h"
+#include "ToolChain.h"
+#include "Compiler.h"
+#include "Linker.h"
+#include "Librarian.h"
+#include "ResourceCompiler.h"
+#include "TimingHistory.h"
+
+#include <filesystem>
+#include <unordered_map>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+
+
+// Above any compile job (whose priorities are milliseconds).
+static constexpr int64_t linkPriority = int64_t{1} << 48;
+
+
+
+static std::string Key (const std::string& file)
+{
+   auto key = std::filesystem::path{file}.lexically_normal().make_preferred().string();
+
+#ifdef _WIN32
+   for (char& ch : key) ch = static_cast<char>(tolower(ch));
+#endif
+
+   return key;
+}
+
+static std::vector<std::string> Absolute (const std::vector<std::string>& paths)
+{
+   std::vector<std::string> result;
+   result.reserve(paths.size());
+
+   for (auto&& path : paths) result.push_back(BuildGraph::Absolute(path));
+
+   return result;
+}
+
+
+
+
+BuildGraph& BuildGraph::Instance ()
+{
+   static BuildGraph buildGraph;
+   return buildGraph;
+}
+
+void BuildGraph::Add (Target target)
+{
+   // The toolchain is global. All targets of one graph have to be built with the same one.
+   const auto toolChain = ToolChain::ToolChain() + " " + ToolChain::Platform();
+   if (toolChain_.empty()) toolChain_ = toolChain;
+   else if (toolChain_ != toolChain) throw std::runtime_error("All deferred targets must use the same ToolChain (" + toolChain_ + " vs. " + toolChain + ")");
+
+   targets_.push_back(std::move(target));
+}
+
+void BuildGraph::Execute ()
+{
+   std::vector<Target> targets;
+   targets.swap(targets_);
+   toolChain_.clear();
+
+   if (targets.empty()) return;
+
+   std::unordered_map<std::string, size_t> producers;
+   for (size_t i = 0; i < targets.size(); ++i) {
+      for (auto&& output : targets[i].outputs) producers[Key(output)] = i;
+   }
+
+   std::vector<std::vector<size_t>> dependencies(targets.size());
+   for (size_t i = 0; i < targets.size(); ++i) {
+      for (auto&& input : targets[i].inputs) {
+         auto it = producers.find(Key(input));
+         if (it != producers.end() && it->second != i) dependencies[i].push_back(it->second);
+      }
+   }
+
+   // The link steps are submitted in topological order, thus every dependency is already submitted.
+   std::vector<size_t> order;
+   std::vector<char> state(targets.size(), 0);
+
+   std::function<void(size_t)> visit = [&] (size_t i) {
+      if (state[i] == 2) return;
+      if (state[i] == 1) throw std::runtime_error("Cyclic dependency between deferred targets at " + targets[i].name);
+
+      state[i] = 1;
+      for (auto dependency : dependencies[i]) visit(dependency);
+      state[i] = 2;
+
+      order.push_back(i);
+   };
+
+   for (size_t i = 0; i < targets.size(); ++i) visit(i);
+
+   // The critical path: How long the link steps take which can't start before the target is compiled (its own one and those waiting for it).
+   // Its jobs get this as priority, thus the targets at the bottom of long chains are compiled first (and within a target, the longest files, see Compiler).
+   std::vector<int64_t> path(targets.size(), 0);
+   for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      path[*it] += static_cast<int64_t>(TimingHistory::Instance().Expected(targets[*it].timing));
+      for (auto dependency : dependencies[*it]) path[dependency] = std::max(path[dependency], path[*it]);
+   }
+
+   auto& jobSystem = JobSystem::Instance();
+
+   std::vector<JobSystem::JobPtr> compileJobs(targets.size());
+   std::vector<JobSystem::JobPtr> linkJobs(targets.size());
+
+   for (size_t i = 0; i < targets.size(); ++i) {
+      compileJobs[i] = jobSystem.Submit(targets[i].compile, path[i]);
+   }
+
+   for (auto i : order) {
+      std::vector<JobSystem::JobPtr> before{compileJobs[i]};
+      for (auto dependency : dependencies[i]) before.push_back(linkJobs[dependency]);
+
+      // A finished link step unblocks other targets, thus it goes before the remaining compile jobs.
+      linkJobs[i] = jobSystem.Submit(targets[i].link, linkPriority + path[i], before);
+   }
+
+   std::exception_ptr error;
+
+   for (auto&& jobs : {&compileJobs, &linkJobs}) {
+      for (auto&& job : *jobs) {
+         try {
+            jobSystem.Wait(job);
+         }
+         catch (...) {
+            if (!error) error = std::current_exception();
+         }
+      }
+   }
+
+   if (error) std::rethrow_exception(error);
+}
+
+
+
+
+std::string BuildGraph::Absolute (const std::string& path)
+{
+   if (path.empty()) return path;
+
+   return std::filesystem::absolute(path).lexically_normal().make_preferred().string();
+}
+
+void BuildGraph::MakeAbsolute (Compiler& compiler)
+{
+   if (compiler.ObjDir().empty()) compiler.ObjDir(compiler.Build());
+
+   compiler.ObjDir(Absolute(compiler.ObjDir()));
+   compiler.Includes(::Absolute(compiler.Includes()));
+   compiler.Files(::Absolute(compiler.Files()));
+   compiler.PrecompiledHeader(Absolute(compiler.PrecompiledH()), Absolute(compiler.PrecompiledCPP()));
+}
+
+void BuildGraph::MakeAbsolute (Linker& linker)
+{
+   linker.Output(Absolute(linker.Output()));
+   linker.ImportLib(Absolute(linker.ImportLib()));
+   linker.Def(Absolute(linker.Def()));
+   linker.Libpath(::Absolute(linker.Libpath()));
+   linker.Files(::Absolute(linker.Files()));
+}
+
+void BuildGraph::MakeAbsolute (Librarian& librarian)
+{
+   librarian.Output(Absolute(librarian.Output()));
+   librarian.Files(::Absolute(librarian.Files()));
+}
+
+void BuildGraph::MakeAbsolute (ResourceCompiler& resourceCompiler)
+{
+   resourceCompiler.Outdir(Absolute(resourceCompiler.Outdir()));
+   resourceCompiler.Files(::Absolute(resourceCompiler.Files()));
+   resourceCompiler.Includes(::Absolute(resourceCompiler.Includes()));
+}
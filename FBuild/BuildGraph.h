@@ -0,0 +1,61 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+
+
+class Compiler;
+class Linker;
+class Librarian;
+class ResourceCompiler;
+
+
+// In deferred mode Exe::Create() and Lib::Create() don't build anything. They only register the target here.
+// After the script has been evaluated, Execute() builds all targets in parallel:
+// The compile step of every target starts right away. The link step waits for the own compile step
+// and for the link steps of all targets producing one of its inputs (e.g. the libraries an exe links).
+class BuildGraph {
+public:
+   struct Target {
+      std::string              name;
+      std::string              timing;   // Its link step in the TimingHistory
+      std::vector<std::string> inputs;
+      std::vector<std::string> outputs;
+      std::function<void()>    compile;
+      std::function<void()>    link;
+   };
+
+   static BuildGraph& Instance ();
+
+   void Deferred (bool v) { deferred_ = v; }
+   bool Deferred () const { return deferred_; }
+
+   void Add (Target target);
+
+   // Builds all registered targets and clears the graph. Rethrows the first error once all started steps are finished.
+   void Execute ();
+
+   // The targets are built after the script changed the directory, thus all their paths have to be absolute.
+   static std::string Absolute (const std::string& path);
+   static void MakeAbsolute (Compiler& compiler);
+   static void MakeAbsolute (Linker& linker);
+   static void MakeAbsolute (Librarian& librarian);
+   static void MakeAbsolute (ResourceCompiler& resourceCompiler);
+
+private:
+   bool                deferred_{false};
+   std::string         toolChain_;
+   std::vector<Target> targets_;
+
+   BuildGraph () { }
+};
+
@@ -0,0 +1,138 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "CompilationCache.h"
+
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+
+
+CompilationCache& CompilationCache::Instance ()
+{
+   static CompilationCache compilationCache;
+   return compilationCache;
+}
+
+CompilationCache::CompilationCache ()
+{
+   maxSize_ = uint64_t{10240} << 20;
+
+   const char* env = std::getenv("FB_CACHE");
+   if (env && *env) directory_ = std::filesystem::absolute(env);
+
+   env = std::getenv("FB_CACHE_SIZE");
+   if (env && std::atoll(env) > 0) maxSize_ = static_cast<uint64_t>(std::atoll(env)) << 20;
+}
+
+CompilationCache::~CompilationCache ()
+{
+   if (!stored_) return;
+
+   try {
+      Trim();
+   }
+   catch (std::exception& e) {
+      std::cerr << "Error on trimming the compilation cache: " << e.what() << std::endl;
+   }
+}
+
+std::filesystem::path CompilationCache::Entry (uint64_t key, const std::string& object) const
+{
+   char name[17];
+   std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+   auto entry = directory_ / std::string(name, 2) / name;
+   entry += std::filesystem::path{object}.extension();
+   return entry;
+}
+
+bool CompilationCache::Fetch (uint64_t key, const std::string& object)
+{
+   if (!Enabled()) return false;
+
+   const auto entry = Entry(key, object);
+
+   std::error_code ec;
+   if (!std::filesystem::is_regular_file(entry, ec)) return false;
+
+   std::filesystem::remove(object, ec);
+
+   ec.clear();
+   std::filesystem::create_hard_link(entry, object, ec);
+   if (ec) {
+      ec.clear();
+      std::filesystem::copy_file(entry, object, std::filesystem::copy_options::overwrite_existing, ec);
+      if (ec) return false;
+   }
+
+   // The timestamp tells the eviction how recently the object was used.
+   std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);
+
+   return true;
+}
+
+void CompilationCache::Store (uint64_t key, const std::string& object)
+{
+   if (!Enabled()) return;
+
+   const auto entry = Entry(key, object);
+
+   std::error_code ec;
+   std::filesystem::create_directories(entry.parent_path(), ec);
+   if (ec) return;
+
+   // Copied, not linked: The compiler may rewrite the object in place next time.
+   // Other FBuild processes may use the cache concurrently, thus the entry appears by renaming it.
+   auto tmp = entry;
+   tmp += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "." + std::to_string(++sequence_) + ".tmp";
+
+   std::filesystem::copy_file(object, tmp, std::filesystem::copy_options::overwrite_existing, ec);
+   if (!ec) std::filesystem::rename(tmp, entry, ec);
+   if (ec) std::filesystem::remove(tmp, ec);
+   else stored_ = true;
+}
+
+void CompilationCache::Trim ()
+{
+   std::vector<std::tuple<std::filesystem::file_time_type, uint64_t, std::filesystem::path>> entries;
+   uint64_t size = 0;
+
+   std::error_code ec;
+   for (auto it = std::filesystem::recursive_directory_iterator(directory_, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+      if (!it->is_regular_file(ec) || it->path().extension() == ".tmp") continue;
+
+      const auto fileSize = it->file_size(ec);
+      const auto time = it->last_write_time(ec);
+      if (ec) {
+         ec.clear();
+         continue;
+      }
+
+      entries.emplace_back(time, fileSize, it->path());
+      size += fileSize;
+   }
+
+   if (size <= maxSize_) return;
+
+   // Some headroom, so we don't have to trim on every run.
+   const uint64_t target = maxSize_ / 10 * 9;
+
+   std::sort(entries.begin(), entries.end());
+
+   for (auto&& [time, fileSize, path] : entries) {
+      if (size <= target) break;
+      if (std::filesystem::remove(path, ec)) size -= fileSize;
+   }
+}
@@ -0,0 +1,42 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <filesystem>
+#include <atomic>
+
+
+
+// Object files stored by the hash of everything they were compiled from (see CppOutOfDate).
+// Enabled by setting FB_CACHE to a directory. FB_CACHE_SIZE limits its size in MB (default 10 GB).
+// When FBuild exits, the least recently used objects are removed until the cache fits again.
+class CompilationCache {
+public:
+   static CompilationCache& Instance ();
+
+   ~CompilationCache ();
+
+   bool Enabled () const { return !directory_.empty(); }
+
+   // Places the cached object at the given path (as hardlink if possible). False, if there's none.
+   bool Fetch (uint64_t key, const std::string& object);
+   void Store (uint64_t key, const std::string& object);
+
+private:
+   std::filesystem::path  directory_;
+   uint64_t               maxSize_;
+   std::atomic<uint64_t>  sequence_{0};
+   std::atomic<bool>      stored_{false};
+
+   CompilationCache ();
+
+   std::filesystem::path Entry (uint64_t key, const std::string& object) const;
+   void Trim ();
+};
+
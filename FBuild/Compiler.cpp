@@ -8,14 +8,29 @@
 
 #include "Compiler.h"
 #include "CppOutOfDate.h"
+#include "CppDepends.h"
+#include "DependencyDatabase.h"
 #include "ToolChain.h"
+#include "Process.h"
+#include "Executor.h"
+#include "Console.h"
+#include "JobSystem.h"
+#include "SignatureStore.h"
+#include "CompilationCache.h"
+#include "TimingHistory.h"
+#include "Governor.h"
+#include "Vfs.h"
 
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
-#include <thread>
 #include <mutex>
+#include <atomic>
 #include <filesystem>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
 
 
 
@@ -55,45 +70,317 @@ std::vector<std::string> ActualCompiler::CompiledObjFiles (const std::string& ex
    return result;
 }
 
+std::string ActualCompiler::ObjFile (const std::string& file, const std::string& extension) const
+{
+   auto outfile = std::filesystem::path{compiler.ObjDir()} / std::filesystem::path{file}.filename();
+   outfile.replace_extension(extension);
+   return outfile.string();
+}
 
+void ActualCompiler::RecordSignature (const std::string& file, const std::string& extension)
+{
+   uint64_t signature;
+   {
+      std::lock_guard lock(unitsMutex);
+      auto it = signatures.find(file);
+      if (it == signatures.end()) return;
+      signature = it->second;
+   }
 
+   SignatureStore::Instance().Record(ObjFile(file, extension), signature);
+}
 
+// The defines of the command line, for the include scanner. Macros the compiler defines on its own are added by the backends, if they're certain.
+std::vector<std::string> ActualCompiler::ScanDefines () const
+{
+   auto defines = compiler.Defines();
+   defines.push_back(compiler.Build() == "Debug" ? "_DEBUG" : "NDEBUG");
+   return defines;
+}
 
+std::string ActualCompiler::CacheCommandLine (const std::string& commandLine, const std::vector<std::string>& tools) const
+{
+   std::string result = commandLine;
 
+   // Without a precompiled header the object doesn't depend on the ObjDir. Then it can be shared between checkouts.
+   if (compiler.PrecompiledH().empty() && !compiler.ObjDir().empty()) {
+      for (auto pos = result.find(compiler.ObjDir()); pos != std::string::npos; pos = result.find(compiler.ObjDir(), pos)) {
+         result.replace(pos, compiler.ObjDir().size(), "<ObjDir>");
+      }
+   }
 
-void ActualCompilerVisualStudio::CheckParams ()
+   // An upgraded compiler builds different objects from the same command line.
+   for (auto&& tool : tools) result += " <" + ToolChain::Identity(tool) + ">";
+
+   return result;
+}
+
+bool ActualCompiler::FetchFromCache (const std::string& file, const std::string& extension)
 {
-   if (compiler.ObjDir().empty()) compiler.ObjDir(compiler.Build());
+   uint64_t key;
+   {
+      std::lock_guard lock(unitsMutex);
+      auto it = cacheKeys.find(file);
+      if (it == cacheKeys.end()) return false;
+      key = it->second;
+   }
+
+   Console::Span span{"cache", "Fetch " + std::filesystem::path{file}.filename().string()};
+   return CompilationCache::Instance().Fetch(key, ObjFile(file, extension));
 }
 
-bool ActualCompilerVisualStudio::NeedsRebuild ()
+// Under the key it was looked up by, thus another checkout finds it the same way. And under the key of the dependencies the compiler
+// reported, if they differ: that's the key once the DependencyDatabase holds them.
+void ActualCompiler::StoreInCache (const std::string& file, const std::string& extension)
+{
+   uint64_t key;
+   uint64_t compilerKey = 0;
+   {
+      std::lock_guard lock(unitsMutex);
+      auto it = cacheKeys.find(file);
+      if (it == cacheKeys.end()) return;
+      key = it->second;
+
+      auto compilerIt = compilerCacheKeys.find(file);
+      if (compilerIt != compilerCacheKeys.end() && compilerIt->second != key) compilerKey = compilerIt->second;
+   }
+
+   Console::Span span{"cache", "Store " + std::filesystem::path{file}.filename().string()};
+   CompilationCache::Instance().Store(key, ObjFile(file, extension));
+   if (compilerKey) CompilationCache::Instance().Store(compilerKey, ObjFile(file, extension));
+}
+
+void ActualCompiler::CompileOutOfDate (CppOutOfDate* checker, const std::string& extension, const std::function<void()>& start, const std::vector<std::string>& environment,
+                                       const std::function<std::string(const std::string&)>& command, const std::function<void(const std::string&)>& compiled)
 {
-   CheckParams();
    outOfDate.clear();
+   signatures.clear();
+   cacheKeys.clear();
+   compilerCacheKeys.clear();
+
+   std::atomic<size_t> errors{0};
+   std::atomic<size_t> found{0};
+   std::atomic<size_t> pending{0};   // Submitted and not done yet
+   bool compiling = false;           // Guarded by unitsMutex
+
+   // At most Threads() files of the target at once (zero: no limit of its own). The others wait, the longest first.
+   const size_t limit = compiler.Threads() > 0 ? static_cast<size_t>(compiler.Threads()) : std::numeric_limits<size_t>::max();
+   std::mutex queueMutex;
+   std::multimap<int64_t, std::string, std::greater<int64_t>> queue;
+   size_t running = 0;
+
+   // Longest first. On top of the priority of the target, which is the length of the link steps waiting for it (see BuildGraph).
+   const int64_t priority = JobSystem::CurrentPriority();
+
+   struct Running {
+      Process::Usage                  usage;
+      std::unique_ptr<Governor::Slot> slot;
+   };
+
+   std::function<void()> next;
+   std::function<void(const std::string&, const std::string&, int64_t, const std::shared_ptr<Running>&)> launch;
+
+   // The compiler is started once the Governor admits it, by the one admitting it. Until then, no thread waits for it.
+   auto compile = [&] (const std::string& cpp, int64_t filePriority) {
+      try {
+         const auto obj = ObjFile(cpp, extension);
+
+         std::error_code ec;
+         std::filesystem::remove(obj, ec);
 
-   if (!compiler.DependencyCheck()) {
+         if (FetchFromCache(cpp, extension)) {
+            RecordSignature(cpp, extension);
+            next();
+            return;
+         }
+
+         auto running = std::make_shared<Running>();
+         Governor::Instance().Admit(Governor::Class::Compile, obj, running->usage, [&launch, cpp, obj, filePriority, running] (std::unique_ptr<Governor::Slot> slot) {
+            running->slot = std::move(slot);
+            launch(cpp, obj, filePriority, running);
+         });
+      }
+      catch (std::exception& e) {
+         Console::Write(e.what());
+         ++errors;
+         next();
+      }
+      catch (...) {
+         ++errors;
+         next();
+      }
+   };
+
+   // The compiler runs on the Executor, no thread waits for it. The slot is given back as soon as it exited, the rest is a job again.
+   launch = [&] (const std::string& cpp, const std::string& obj, int64_t filePriority, const std::shared_ptr<Running>& running) {
+      try {
+         auto execution = Process::StartJob(cpp, command(cpp), environment);
+         execution->Then([&, cpp, obj, filePriority, running, done = execution.get()] () {
+            const int rc = done->ExitCode();
+            running->usage = done->Usage();
+            running->slot.reset();
+
+            JobSystem::Instance().Submit([&, cpp, obj, rc, running] () {
+               try {
+                  if (rc != 0) ++errors;
+                  else {
+                     TimingHistory::Instance().Record(obj, running->usage);
+                     if (compiled) compiled(cpp);
+                     RecordSignature(cpp, extension);
+                     StoreInCache(cpp, extension);
+                  }
+               }
+               catch (std::exception& e) {
+                  Console::Write(e.what());
+                  ++errors;
+               }
+               catch (...) {
+                  ++errors;
+               }
+
+               next();
+            }, filePriority);
+         });
+      }
+      catch (std::exception& e) {
+         running->slot.reset();
+         Console::Write(e.what());
+         ++errors;
+         JobSystem::Instance().Submit([&] () { next(); }, filePriority);   // Not started from within a job
+      }
+      catch (...) {
+         running->slot.reset();
+         ++errors;
+         JobSystem::Instance().Submit([&] () { next(); }, filePriority);
+      }
+   };
+
+   auto submit = [&] (const std::string& cpp) {
+      const int64_t filePriority = priority + static_cast<int64_t>(TimingHistory::Instance().Expected(ObjFile(cpp, extension)));
+
+      ++pending;
+      {
+         std::lock_guard lock(queueMutex);
+         if (running >= limit) {
+            queue.emplace(filePriority, cpp);
+            return;
+         }
+         ++running;
+      }
+
+      JobSystem::Instance().Submit([&compile, cpp, filePriority] () { compile(cpp, filePriority); }, filePriority);
+   };
+
+   // A file is done: the next one waiting takes its place. Always from within a job, thus WaitFor() below notices the last one.
+   next = [&] () {
+      std::optional<std::pair<int64_t, std::string>> file;
+      {
+         std::lock_guard lock(queueMutex);
+         if (queue.empty()) --running;
+         else {
+            file = *queue.begin();
+            queue.erase(queue.begin());
+         }
+      }
+
+      if (file) JobSystem::Instance().Submit([&compile, file] () { compile(file->second, file->first); }, file->first);
+
+      --pending;
+   };
+
+   auto finish = [checker] () {
+      if (checker) checker->Finish();
+   };
+
+   if (!checker) {
       outOfDate = compiler.Files();
+      found = outOfDate.size();
    }
    else {
-      ::CppOutOfDate checker{"obj"};
-      checker.OutDir(compiler.ObjDir());
-      checker.Threads(compiler.Threads());
-      checker.Files(compiler.Files());
-      checker.Include(compiler.Includes());
-      checker.PrecompiledHeader(compiler.PrecompiledH());
-      checker.Go();
+      checker->Start([&] (const std::string& file, uint64_t signature, uint64_t cacheKey) {
+         bool now;
+         {
+            std::lock_guard lock(unitsMutex);
+            outOfDate.push_back(file);
+            signatures[file] = signature;
+            if (cacheKey) cacheKeys[file] = cacheKey;
+            now = compiling;
+         }
 
-      outOfDate = checker.OutOfDate();
+         ++found;
+         if (now) submit(file);
+      });
+
+      // Nothing to do until the first file turns out to be out of date
+      JobSystem::Instance().WaitFor([&] () { return found > 0 || checker->Done(); });
+   }
+
+   if (!found) {
+      finish();
+      return;
+   }
+
+   try {
+      start();
    }
+   catch (...) {
+      try { finish(); } catch (...) { }
+      throw;
+   }
+
+   // Those found so far. The checker submits the others itself.
+   std::vector<std::string> files;
+   {
+      std::lock_guard lock(unitsMutex);
+      compiling = true;
+      files = outOfDate;
+   }
+
+   for (auto&& file : files) submit(file);
 
-   return !outOfDate.empty();
+   std::exception_ptr exception;
+   try { finish(); } catch (...) { exception = std::current_exception(); }
+
+   JobSystem::Instance().WaitFor([&pending] () { return pending == 0; });
+
+   if (exception) std::rethrow_exception(exception);
+   if (errors) throw std::runtime_error("Compile Error");
 }
 
-void ActualCompilerVisualStudio::DeleteOutOfDateObjectFiles ()
+
+
+
+
+
+
+void ActualCompilerVisualStudio::CheckParams ()
 {
-   const auto files = CompiledObjFiles();
+   if (compiler.ObjDir().empty()) compiler.ObjDir(compiler.Build());
+}
 
-   for (auto&& file : files) std::filesystem::remove(file);
+std::unique_ptr<CppOutOfDate> ActualCompilerVisualStudio::Checker ()
+{
+   if (!compiler.DependencyCheck()) return nullptr;
+
+   auto checker = std::make_unique<CppOutOfDate>("obj");
+   checker->OutDir(compiler.ObjDir());
+   checker->Threads(compiler.Threads());
+   checker->Files(compiler.Files());
+   checker->Include(compiler.Includes());
+   checker->PrecompiledHeader(compiler.PrecompiledH());
+   checker->Defines(ScanDefines());
+   checker->Defines({"WIN32", "WINDOWS", "_WIN32"});
+   if (ToolChain::Platform() == "x64") checker->Defines({"_WIN64"});
+   const auto commandLine = ToolChain::ToolChain() + " " + ToolChain::Platform() + " " + CommandLine() + compiler.PrecompiledHeader();
+   checker->CommandLine(commandLine);
+
+   // Objects with debug information refer to the pdb of their ObjDir. They can't be cached.
+   if (CompilationCache::Instance().Enabled() && compiler.Build() != "Debug") checker->CacheCommandLine(CacheCommandLine(commandLine, {"cl.exe"}));
+
+   // The precompiled header is built before any other file
+   if (!compiler.PrecompiledCPP().empty()) checker->First(compiler.PrecompiledCPP());
+
+   return checker;
 }
 
 std::string ActualCompilerVisualStudio::CommandLine ()
@@ -168,19 +455,26 @@ std::string ActualCompilerVisualStudio::CommandLine ()
 
 void ActualCompilerVisualStudio::CompilePrecompiledHeaders ()
 {
-   if (outOfDate.empty()) return;
    if (compiler.PrecompiledCPP().empty()) return;
 
    std::filesystem::path cpp = std::filesystem::canonical(compiler.PrecompiledCPP());
    cpp.make_preferred();
 
-   auto it = std::find_if(outOfDate.cbegin(), outOfDate.cend(), [&cpp] (const std::string& f) -> bool {
-      return std::filesystem::equivalent(cpp, f);
-   });
+   std::string file;
+   {
+      std::lock_guard lock(unitsMutex);
+      auto it = std::find_if(outOfDate.cbegin(), outOfDate.cend(), [&cpp] (const std::string& f) -> bool {
+         return std::filesystem::equivalent(cpp, f);
+      });
 
-   if (it == outOfDate.cend()) return;
+      if (it == outOfDate.cend()) return;
 
-   outOfDate.erase(it);
+      file = *it;
+      outOfDate.erase(it);
+   }
+
+   std::error_code ec;
+   std::filesystem::remove(ObjFile(file, "obj"), ec);
 
    std::filesystem::path pch = std::filesystem::path(compiler.ObjDir()) / "PrecompiledHeader.pch";
    if (std::filesystem::exists(pch)) std::filesystem::remove(pch);
@@ -189,88 +483,44 @@ void ActualCompilerVisualStudio::CompilePrecompiledHeaders ()
    command += "-Yc\"" + std::filesystem::path{compiler.PrecompiledH()}.filename().string() + "\" ";
    command += cpp.string();
 
-   std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-   int rc = std::system(cmd.c_str());
+   Process::Usage usage;
+   int rc = Governor::Instance().RunJob(Governor::Class::Compile, ObjFile(file, "obj"), file, command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Compile Error");
+
+   TimingHistory::Instance().Record(ObjFile(file, "obj"), usage);
+   RecordSignature(file, "obj");
 }
 
-void ActualCompilerVisualStudio::CompileFiles ()
+std::string ActualCompilerVisualStudio::CompileCommand (const std::string& cpp, const std::string& commandLine)
 {
-   if (outOfDate.empty()) return;
-
-   std::string commandLine = CommandLine();
-
-   if (compiler.PrecompiledH().size()) {
-      commandLine += "-FI\"" + compiler.PrecompiledH() + "\" ";
-      commandLine += "-Yu\"" + compiler.PrecompiledH() + "\" ";
-   }
-
-   std::vector<std::string> todo = outOfDate;
-   size_t errors = 0;
-   std::mutex mutex{};
-
-   auto threadFunction = [&] () {
-      std::string cpp;
-      std::string command;
-
-      for (;;) {
-         try {
-            {
-               std::lock_guard<std::mutex> lock{mutex};
-               auto it = todo.rbegin();
-               if (it == todo.rend()) break;
-               cpp = (*it);
-               todo.pop_back();
-            }
-
-            command = "cl.exe " + commandLine + "\"" + cpp + "\" ";
-
-            std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-            int rc = std::system(cmd.c_str());
-            if (rc != 0) {
-               std::lock_guard<std::mutex> lock{mutex};
-               ++errors;
-            }
-         }
-         catch (std::exception& e) {
-            std::cout << e.what() << std::endl;
-            std::lock_guard<std::mutex> lock{mutex};
-            ++errors;
-         }
-         catch (...) {
-            std::lock_guard<std::mutex> lock{mutex};
-            ++errors;
-         }
-      }
-   };
-
-   size_t threads = compiler.Threads();
-   if (!threads) {
-      threads = std::thread::hardware_concurrency();
-      if (!threads) threads = 2;
-   }
-   if (threads > todo.size()) threads = todo.size();
-
-   std::vector<std::thread> threadGroup;
-   for (size_t i = 0; i < threads; ++i) threadGroup.push_back(std::thread{threadFunction});
-
-   for (auto&& thread : threadGroup) thread.join();
-
-   if (errors) throw std::runtime_error("Compile Error");
+   return "cl.exe " + commandLine + "\"" + cpp + "\" ";
 }
 
 void ActualCompilerVisualStudio::Compile ()
 {
    CheckParams();
-   if (!NeedsRebuild()) return;
+   auto checker = Checker();
+
+   std::string commandLine;
+   std::vector<std::string> environment;
 
-   std::cout << "\nCompiling (" << ToolChain::ToolChain() << " " << ToolChain::Platform() << ")" << std::endl;
+   CompileOutOfDate(checker.get(), "obj", [&] () {
+      Console::Write("\nCompiling (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
 
-   compiler.DoBeforeCompile();
+      compiler.DoBeforeCompile();
 
-   DeleteOutOfDateObjectFiles();
-   CompilePrecompiledHeaders();
-   CompileFiles();
+      CompilePrecompiledHeaders();
+
+      commandLine = CommandLine();
+      if (compiler.PrecompiledH().size()) {
+         commandLine += "-FI\"" + compiler.PrecompiledH() + "\" ";
+         commandLine += "-Yu\"" + compiler.PrecompiledH() + "\" ";
+      }
+
+      environment = ToolChain::Environment();
+   }, environment, [&] (const std::string& cpp) {
+      return CompileCommand(cpp, commandLine);
+   }, nullptr);
 }
 
 
@@ -285,142 +535,212 @@ void ActualCompilerEmscripten::CheckParams ()
    if (!std::filesystem::exists(compiler.ObjDir())) std::filesystem::create_directories(compiler.ObjDir());
 }
 
-bool ActualCompilerEmscripten::NeedsRebuild ()
+std::unique_ptr<CppOutOfDate> ActualCompilerEmscripten::Checker ()
 {
-   CheckParams();
-   outOfDate.clear();
-
-   if (!compiler.DependencyCheck()) {
-      outOfDate = compiler.Files();
-   }
-   else {
-      ::CppOutOfDate checker{"o"};
-      checker.OutDir(compiler.ObjDir());
-      checker.Threads(compiler.Threads());
-      checker.Files(compiler.Files());
-      checker.Include(compiler.Includes());
-      checker.PrecompiledHeader(compiler.PrecompiledH());
-      checker.Go();
+   if (!compiler.DependencyCheck()) return nullptr;
 
-      outOfDate = checker.OutOfDate();
-   }
+   auto checker = std::make_unique<CppOutOfDate>("o");
+   checker->OutDir(compiler.ObjDir());
+   checker->Threads(compiler.Threads());
+   checker->Files(compiler.Files());
+   checker->Include(compiler.Includes());
+   checker->PrecompiledHeader(compiler.PrecompiledH());
+   checker->Defines(ScanDefines());
+   checker->Defines({"__EMSCRIPTEN__"});
+   const auto commandLine = ToolChain::ToolChain() + " " + ToolChain::Platform() + " " + CommandLine(false) + compiler.PrecompiledHeader();
+   checker->CommandLine(commandLine);
 
-   return !outOfDate.empty();
-}
+   if (CompilationCache::Instance().Enabled()) checker->CacheCommandLine(CacheCommandLine(commandLine, {"emcc"}));
 
-void ActualCompilerEmscripten::DeleteOutOfDateObjectFiles ()
-{
-   const auto files = CompiledObjFiles();
+   if (!compiler.PrecompiledCPP().empty()) checker->First(compiler.PrecompiledCPP());
 
-   for (auto&& file : files) std::filesystem::remove(file);
+   return checker;
 }
 
 void ActualCompilerEmscripten::CompilePrecompiledHeaders ()
 {
-   if (outOfDate.empty()) return;
    if (compiler.PrecompiledCPP().empty()) return;
 
    std::filesystem::path cpp = std::filesystem::canonical(compiler.PrecompiledCPP());
    cpp.make_preferred();
 
-   auto it = std::find_if(outOfDate.cbegin(), outOfDate.cend(), [&cpp] (const std::string& f) -> bool {
-      return std::filesystem::equivalent(cpp, f);
-   });
+   std::string file;
+   {
+      std::lock_guard lock(unitsMutex);
+      auto it = std::find_if(outOfDate.cbegin(), outOfDate.cend(), [&cpp] (const std::string& f) -> bool {
+         return std::filesystem::equivalent(cpp, f);
+      });
 
-   if (it == outOfDate.cend()) return;
+      if (it == outOfDate.cend()) return;
 
-   outOfDate.erase(it);
+      file = *it;
+      outOfDate.erase(it);
+   }
 
    std::filesystem::path hpp = std::filesystem::canonical(compiler.PrecompiledH());
    hpp.make_preferred();
 
-   std::cout << hpp.string() << std::endl;
-
    std::string command = "emcc " + CommandLine(true) + "\"" + hpp.string() + "\" -x c++-header -o \"" + hpp.string() + ".pch\" ";
 
-   int rc = std::system(command.c_str());
+   Process::Usage usage;
+   int rc = Governor::Instance().RunJob(Governor::Class::Compile, ObjFile(file, "o"), hpp.string(), command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Compile Error");
 
+   TimingHistory::Instance().Record(ObjFile(file, "o"), usage);
+
    std::ofstream obj(compiler.ObjDir() + "/" + cpp.filename().replace_extension("o").string());
+
+   RecordSignature(file, "o");
+}
+
+std::string ActualCompilerEmscripten::CompileCommand (const std::string& cpp, const std::string& commandLine)
+{
+   return "emcc " + commandLine + "\"" + cpp + "\" ";
 }
 
-void ActualCompilerEmscripten::CompileFiles ()
+std::string ActualCompilerEmscripten::CommandLine (bool omitObjDir)
 {
-   if (outOfDate.empty()) return;
+   bool debug = compiler.Build() == "Debug";
+
+   std::string command = "-c -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 -std=c++1z ";
+
+   command += "-fdiagnostics-format=msvc -Wno-invalid-source-encoding ";
+
+   if (debug) command += "-g -O1 -D_DEBUG ";
+   else command += "-O3 -DNDEBUG ";
+
 
-   std::string commandLine = CommandLine(false);
-   if (compiler.PrecompiledH().size()) {
-      std::filesystem::path hpp = std::filesystem::canonical(compiler.PrecompiledH());
-      hpp.make_preferred();
+   for (auto&& define : compiler.Defines()) command += "-D" + define + " ";
 
-      commandLine += " -include \"" + hpp.string() + "\" ";
+
+   for (auto&& include : compiler.Includes()) command += "-I\"" + include + "\" ";
+
+
+   if (compiler.WarnLevel() == 0) command += "-w ";
+   else if (compiler.WarnLevel() == 4) {
+      if (compiler.WarningAsError()) command += "-pedantic-errors ";
+      else command += "-pedantic ";
    }
 
-   std::vector<std::string> todo = outOfDate;
-   size_t errors = 0;
-   std::mutex mutex{};
+   if (compiler.WarningAsError()) command += "-Werror ";
 
-   auto threadFunction = [&] () {
-      std::string cpp;
-      std::string command;
+   for (auto&& disabledWarning : compiler.WarningDisable()) command += "-Wno-" + std::to_string(disabledWarning) + " ";
 
-      for (;;) {
-         try {
-            {
-               std::lock_guard<std::mutex> lock{mutex};
-               auto it = todo.rbegin();
-               if (it == todo.rend()) break;
-               cpp = (*it);
-               todo.pop_back();
 
-               std::cout << cpp << std::endl;
-            }
+   command += compiler.Args() + " ";
 
-            command = "emcc " + commandLine + "\"" + cpp + "\" ";
 
-            int rc = std::system(command.c_str());
-            if (rc != 0) {
-               std::lock_guard<std::mutex> lock{mutex};
-               ++errors;
-            }
-         }
-         catch (std::exception& e) {
-            std::cout << e.what() << std::endl;
-            std::lock_guard<std::mutex> lock{mutex};
-            ++errors;
-         }
-         catch (...) {
-            std::lock_guard<std::mutex> lock{mutex};
-            ++errors;
-         }
+   if (!omitObjDir) command += "-o " + compiler.ObjDir() + "/ ";
+
+
+   return command;
+}
+
+void ActualCompilerEmscripten::Compile ()
+{
+   CheckParams();
+   auto checker = Checker();
+
+   std::string commandLine;
+   std::vector<std::string> environment;
+
+   CompileOutOfDate(checker.get(), "o", [&] () {
+      Console::Write("\nCompiling (" + ToolChain::ToolChain() + ")");
+
+      compiler.DoBeforeCompile();
+
+      CompilePrecompiledHeaders();
+
+      commandLine = CommandLine(false);
+      if (compiler.PrecompiledH().size()) {
+         std::filesystem::path hpp = std::filesystem::canonical(compiler.PrecompiledH());
+         hpp.make_preferred();
+
+         commandLine += " -include \"" + hpp.string() + "\" ";
       }
-   };
 
-   size_t threads = compiler.Threads();
-   if (!threads) {
-      threads = std::thread::hardware_concurrency();
-      if (!threads) threads = 2;
-   }
-   if (threads > todo.size()) threads = todo.size();
+      environment = ToolChain::Environment();
+   }, environment, [&] (const std::string& cpp) {
+      return CompileCommand(cpp, commandLine);
+   }, nullptr);
+}
 
-   std::vector<std::thread> threadGroup;
-   for (size_t i = 0; i < threads; ++i) threadGroup.push_back(std::thread{threadFunction});
 
-   for (auto&& thread : threadGroup) thread.join();
 
-   if (errors) throw std::runtime_error("Compile Error");
+
+
+
+
+
+void ActualCompilerGcc::CheckParams ()
+{
+   if (compiler.ObjDir().empty()) compiler.ObjDir(compiler.Build());
+   if (!std::filesystem::exists(compiler.ObjDir())) std::filesystem::create_directories(compiler.ObjDir());
 }
 
-std::string ActualCompilerEmscripten::CommandLine (bool omitObjDir)
+std::unique_ptr<CppOutOfDate> ActualCompilerGcc::Checker ()
+{
+   signatureCommandLine.clear();
+   cacheCommandLine.clear();
+
+   if (!compiler.DependencyCheck()) return nullptr;
+
+   auto checker = std::make_unique<CppOutOfDate>("o");
+   checker->OutDir(compiler.ObjDir());
+   checker->Threads(compiler.Threads());
+   checker->Files(compiler.Files());
+   checker->Include(compiler.Includes());
+   checker->PrecompiledHeader(compiler.PrecompiledH());
+   checker->Defines(ScanDefines());
+   signatureCommandLine = ToolChain::ToolChain() + " " + ToolChain::Platform() + " " + Driver("c") + " " + Driver("cpp") + " " + CommandLine() + compiler.PrecompiledHeader();
+   checker->CommandLine(signatureCommandLine);
+
+   // Debug information refers to the directory the object was compiled in.
+   if (CompilationCache::Instance().Enabled() && compiler.Build() != "Debug") cacheCommandLine = CacheCommandLine(signatureCommandLine, {Driver("c"), Driver("cpp")});
+   checker->CacheCommandLine(cacheCommandLine);
+
+   // Whether the precompiled header is out of date is known before any other file
+   if (!compiler.PrecompiledCPP().empty()) checker->First(compiler.PrecompiledCPP());
+
+   dependencyKey = checker->SettingsKey();
+
+   return checker;
+}
+
+std::string ActualCompilerGcc::Driver (const std::string& file) const
+{
+   auto extension = std::filesystem::path{file}.extension().string();
+   if (extension.empty()) extension = "." + file;
+
+   const bool clang = ToolChain::ToolChain() == "CLANG";
+
+   if (extension == ".c") {
+      const char* env = std::getenv("CC");
+      return env ? std::string{env} : clang ? "clang" : "gcc";
+   }
+
+   const char* env = std::getenv("CXX");
+   return (env ? std::string{env} : clang ? "clang++" : "g++") + " -std=c++17";
+}
+
+// The precompiled header is included by this file in the ObjDir. The compiler takes its .gch/.pch instead, if it's there and fits.
+// Otherwise the file just includes the actual header.
+std::string ActualCompilerGcc::PrecompiledHeaderFile () const
+{
+   return (std::filesystem::path{compiler.ObjDir()} / "PrecompiledHeader.h").string();
+}
+
+std::string ActualCompilerGcc::CommandLine ()
 {
    bool debug = compiler.Build() == "Debug";
 
-   std::string command = "-c -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 -std=c++1z ";
+   std::string command = "-c -fPIC -pthread ";
 
-   command += "-fdiagnostics-format=msvc -Wno-invalid-source-encoding ";
+   if (ToolChain::Platform() == "x86") command += "-m32 ";
+   else command += "-m64 ";
 
-   if (debug) command += "-g -O1 -D_DEBUG ";
-   else command += "-O3 -DNDEBUG ";
+   if (debug) command += "-g -O0 -D_DEBUG ";
+   else command += "-O2 -DNDEBUG ";
 
 
    for (auto&& define : compiler.Defines()) command += "-D" + define + " ";
@@ -430,37 +750,248 @@ std::string ActualCompilerEmscripten::CommandLine (bool omitObjDir)
 
 
    if (compiler.WarnLevel() == 0) command += "-w ";
-   else if (compiler.WarnLevel() == 4) {
-      if (compiler.WarningAsError()) command += "-pedantic-errors ";
-      else command += "-pedantic ";
-   }
+   else if (compiler.WarnLevel() == 2 || compiler.WarnLevel() == 3) command += "-Wall ";
+   else if (compiler.WarnLevel() == 4) command += "-Wall -Wextra -pedantic ";
 
    if (compiler.WarningAsError()) command += "-Werror ";
 
-   for (auto&& disabledWarning : compiler.WarningDisable()) command += "-Wno-" + std::to_string(disabledWarning) + " ";
+   // WarningDisable holds the numbers of MSVC warnings. They have no counterpart here, use Args.
 
 
    command += compiler.Args() + " ";
 
 
-   if (!omitObjDir) command += "-o " + compiler.ObjDir() + "/ ";
+   const char* env = std::getenv("FB_COMPILER");
+   if (env) command += std::string(env) + " ";
 
+   if (debug) {
+      env = std::getenv("FB_COMPILER_DEBUG");
+      if (env) command += std::string(env) + " ";
+   }
+   else {
+      env = std::getenv("FB_COMPILER_RELEASE");
+      if (env) command += std::string(env) + " ";
+   }
 
    return command;
 }
 
-void ActualCompilerEmscripten::Compile ()
+std::vector<std::string> ActualCompilerGcc::ReadDepFile (const std::string& depFile)
+{
+   std::ifstream stream(depFile, std::ios::binary);
+   if (!stream) return {};
+
+   const std::string content{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+
+   // "object: source header1 \
+   //    header2 ...". Spaces in names are escaped by a backslash, a $ is doubled.
+   size_t pos = 0;
+   while (pos < content.size()) {
+      pos = content.find(':', pos);
+      if (pos == std::string::npos) return {};
+      ++pos;
+      if (pos == content.size() || isspace(static_cast<unsigned char>(content[pos]))) break;
+   }
+
+   std::vector<std::string> names;
+   std::string name;
+
+   for (; pos < content.size(); ++pos) {
+      const char ch = content[pos];
+
+      if (ch == '\\' && pos + 1 < content.size()) {
+         const char next = content[pos + 1];
+         if (next == ' ' || next == '#' || next == '\\') {
+            name += next;
+            ++pos;
+            continue;
+         }
+         if (next == '\n' || next == '\r') continue;
+      }
+
+      if (ch == '$' && pos + 1 < content.size() && content[pos + 1] == '$') {
+         name += '$';
+         ++pos;
+         continue;
+      }
+
+      if (isspace(static_cast<unsigned char>(ch))) {
+         if (!name.empty()) names.push_back(std::move(name));
+         name.clear();
+         continue;
+      }
+
+      name += ch;
+   }
+
+   if (!name.empty()) names.push_back(std::move(name));
+
+   std::vector<std::string> result;
+   result.reserve(names.size());
+
+   for (auto&& n : names) {
+      std::error_code ec;
+      auto file = std::filesystem::canonical(n, ec);
+      if (ec) continue;
+      file.make_preferred();
+      result.push_back(file.string());
+   }
+
+   std::sort(result.begin(), result.end());
+   result.erase(std::unique(result.begin(), result.end()), result.end());
+
+   return result;
+}
+
+// The compiler knows the dependencies better than the include scanner. They become the dependencies
+// of the file in the DependencyDatabase, and the signature of the object is taken over them. The object is cached under their key as well.
+void ActualCompilerGcc::AddDependencies (const std::string& file, const std::string& depFile)
+{
+   {
+      std::lock_guard lock(unitsMutex);
+      if (signatures.find(file) == signatures.end()) return;
+   }
+
+   auto names = ReadDepFile(depFile);
+   if (names.empty()) return;
+
+   std::error_code ec;
+   const auto pch = std::filesystem::weakly_canonical(PrecompiledHeaderFile(), ec).make_preferred().string();
+
+   names.erase(std::remove_if(names.begin(), names.end(), [&pch] (const std::string& name) {
+      return name.compare(0, pch.size(), pch) == 0;
+   }), names.end());
+
+   names.insert(names.end(), precompiledHeaderDependencies.begin(), precompiledHeaderDependencies.end());
+   std::sort(names.begin(), names.end());
+   names.erase(std::unique(names.begin(), names.end()), names.end());
+
+   std::vector<PathTable::Id> ids;
+   ids.reserve(names.size());
+   for (auto&& name : names) ids.push_back(PathTable::Intern(name));
+
+   const uint64_t signature = CppOutOfDate::ObjectSignature(signatureCommandLine, ids);
+   const uint64_t cacheKey = cacheCommandLine.empty() ? 0 : CppOutOfDate::CacheKey(cacheCommandLine, file, ids);
+
+   {
+      std::lock_guard lock(unitsMutex);
+      signatures[file] = signature;
+
+      if (cacheKey && cacheKeys.find(file) != cacheKeys.end()) compilerCacheKeys[file] = cacheKey;
+   }
+
+   auto unit = std::filesystem::canonical(file);
+   unit.make_preferred();
+
+   std::lock_guard lock(dependenciesMutex);
+   dependencies.emplace_back(unit.string(), std::move(names));
+}
+
+void ActualCompilerGcc::StoreDependencies ()
+{
+   if (dependencies.empty()) return;
+
+   DependencyDatabase database{compiler.ObjDir(), dependencyKey};
+
+   for (auto&& [unit, names] : dependencies) {
+      std::vector<std::pair<PathTable::Id, uint64_t>> times;
+      times.reserve(names.size());
+
+      for (auto&& name : names) times.emplace_back(PathTable::Intern(name), CppDepends::LastWriteTime(name));
+
+      database.Put(unit, std::move(times));
+   }
+
+   database.Save();
+   dependencies.clear();
+}
+
+void ActualCompilerGcc::CompilePrecompiledHeaders ()
+{
+   if (compiler.PrecompiledH().empty()) return;
+
+   std::filesystem::path hpp = std::filesystem::canonical(compiler.PrecompiledH());
+   hpp.make_preferred();
+
+   const std::string include = "#include \"" + hpp.generic_string() + "\"\n";
+
+   std::string existing;
+   {
+      std::ifstream stream(PrecompiledHeaderFile(), std::ios::binary);
+      existing.assign(std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{});
+   }
+
+   if (existing != include) {
+      std::ofstream stream(PrecompiledHeaderFile(), std::ios::binary | std::ios::trunc);
+      stream << include;
+   }
+
+   const std::string pch = PrecompiledHeaderFile() + (ToolChain::ToolChain() == "CLANG" ? ".pch" : ".gch");
+   const std::string depFile = (std::filesystem::path{compiler.ObjDir()} / "PrecompiledHeader.d").string();
+
+   const std::string command = Driver("cpp") + " " + CommandLine() + "-x c++-header \"" + hpp.string() + "\" -MMD -MF \"" + depFile + "\" -o \"" + pch + "\" ";
+
+   // Like an object's: over the command line and what the header included the last time (its depfile). GCC takes a stale one without a word.
+   const auto signature = [&command, &depFile] () {
+      Signature signature;
+      signature.Add(command);
+      for (auto&& file : ReadDepFile(depFile)) signature.AddFile(file);
+      return signature.Value();
+   };
+
+   const bool outdated = !std::filesystem::exists(pch) || !std::filesystem::exists(depFile) || SignatureStore::Instance().Changed(pch, signature());
+
+   if (outdated) {
+      if (std::filesystem::exists(pch)) std::filesystem::remove(pch);
+
+      Process::Usage usage;
+      int rc = Governor::Instance().RunJob(Governor::Class::Compile, pch, hpp.string(), command, ToolChain::Environment(), &usage);
+      if (rc != 0) throw std::runtime_error("Compile Error");
+
+      TimingHistory::Instance().Record(pch, usage);
+      SignatureStore::Instance().Record(pch, signature());
+   }
+
+   precompiledHeaderDependencies = ReadDepFile(depFile);
+}
+
+std::string ActualCompilerGcc::CompileCommand (const std::string& cpp, const std::string& commandLine)
+{
+   return Driver(cpp) + " " + commandLine + "-MMD -MF \"" + ObjFile(cpp, "d") + "\" -o \"" + ObjFile(cpp, "o") + "\" \"" + cpp + "\" ";
+}
+
+void ActualCompilerGcc::Compile ()
 {
    CheckParams();
-   if (!NeedsRebuild()) return;
+   auto checker = Checker();
+
+   std::string commandLine;
+   std::vector<std::string> environment;
+
+   try {
+      CompileOutOfDate(checker.get(), "o", [&] () {
+         Console::Write("\nCompiling (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
 
-   std::cout << "\nCompiling (" << ToolChain::ToolChain() << ")" << std::endl;
+         compiler.DoBeforeCompile();
 
-   compiler.DoBeforeCompile();
+         CompilePrecompiledHeaders();
 
-   DeleteOutOfDateObjectFiles();
-   CompilePrecompiledHeaders();
-   CompileFiles();
+         commandLine = CommandLine();
+         if (compiler.PrecompiledH().size()) commandLine += "-include \"" + PrecompiledHeaderFile() + "\" ";
+
+         environment = ToolChain::Environment();
+      }, environment, [&] (const std::string& cpp) {
+         return CompileCommand(cpp, commandLine);
+      }, [&] (const std::string& cpp) {
+         AddDependencies(cpp, ObjFile(cpp, "d"));
+      });
+   }
+   catch (...) {
+      StoreDependencies();
+      throw;
+   }
+
+   StoreDependencies();
 }
 
 
@@ -475,8 +1006,14 @@ void Compiler::Compile ()
    const auto toolChain = ToolChain::ToolChain();
    if (toolChain.substr(0, 4) == "MSVC") actualCompiler.reset(new ActualCompilerVisualStudio{*this});
    else if (toolChain == "EMSCRIPTEN") actualCompiler.reset(new ActualCompilerEmscripten{*this});
+   else if (toolChain == "GCC" || toolChain == "CLANG") actualCompiler.reset(new ActualCompilerGcc{*this});
    else throw std::runtime_error("Unbekannte Toolchain: " + toolChain);
 
-   actualCompiler->Compile();
+   {
+      Console::Span span{"target", "Compile " + ObjDir()};
+      actualCompiler->Compile();
+   }
+
+   Vfs::Changed(ObjDir());   // Objects, precompiled headers, dependency files
 }
 
@@ -9,23 +9,47 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <utility>
 
 
 
 
 class Compiler;
+class CppOutOfDate;
 
 
 class ActualCompiler {
 protected:
    Compiler& compiler;
 
+   // Filled while the files are compiled already, thus guarded by unitsMutex until CompileOutOfDate() returns.
+   std::mutex unitsMutex;
    std::vector<std::string> outOfDate;
+   std::unordered_map<std::string, uint64_t> signatures;
+   std::unordered_map<std::string, uint64_t> cacheKeys;           // Of the checker
+   std::unordered_map<std::string, uint64_t> compilerCacheKeys;   // Over the dependencies the compiler reported (GCC)
 
+   std::string ObjFile (const std::string& file, const std::string& extension) const;
    std::vector<std::string> ObjFiles (const std::string& extension);
    std::vector<std::string> CompiledObjFiles (const std::string& extension);
+   void RecordSignature (const std::string& file, const std::string& extension);
+
+   std::vector<std::string> ScanDefines () const;
+
+   std::string CacheCommandLine (const std::string& commandLine, const std::vector<std::string>& tools) const;
+   bool FetchFromCache (const std::string& file, const std::string& extension);
+   void StoreInCache (const std::string& file, const std::string& extension);
+
+   // The checker (nullptr: all files are out of date) runs in the background and every out of date file is compiled as soon as it's known.
+   // start runs once before the first file is compiled, not at all if everything is up to date. By then, the file given to
+   // CppOutOfDate::First() has been checked, and the environment is set. The files not found in the cache are compiled with their command,
+   // all at once as far as the Governor lets them. compiled is called (in parallel) for every file compiled successfully.
+   void CompileOutOfDate (CppOutOfDate* checker, const std::string& extension, const std::function<void()>& start, const std::vector<std::string>& environment,
+                          const std::function<std::string(const std::string&)>& command, const std::function<void(const std::string&)>& compiled);
 
 public:
    ActualCompiler (Compiler& compiler) : compiler{compiler} { }
@@ -45,10 +69,9 @@ public:
 
 class ActualCompilerVisualStudio : public ActualCompiler {
    void CheckParams ();
-   bool NeedsRebuild ();
-   void DeleteOutOfDateObjectFiles ();
+   std::unique_ptr<CppOutOfDate> Checker ();
    void CompilePrecompiledHeaders ();
-   void CompileFiles ();
+   std::string CompileCommand (const std::string& cpp, const std::string& commandLine);
    std::string CommandLine ();
 
 public:
@@ -67,10 +90,9 @@ public:
 
 class ActualCompilerEmscripten : public ActualCompiler {
    void CheckParams ();
-   bool NeedsRebuild ();
-   void DeleteOutOfDateObjectFiles ();
+   std::unique_ptr<CppOutOfDate> Checker ();
    void CompilePrecompiledHeaders ();
-   void CompileFiles ();
+   std::string CompileCommand (const std::string& cpp, const std::string& commandLine);
    std::string CommandLine (bool omitObjDir);
 
 public:
@@ -87,6 +109,41 @@ public:
 
 
 
+class ActualCompilerGcc : public ActualCompiler {
+   std::string signatureCommandLine;
+   std::string cacheCommandLine;
+   uint64_t dependencyKey{0};
+   std::vector<std::string> precompiledHeaderDependencies;
+
+   std::mutex dependenciesMutex;
+   std::vector<std::pair<std::string, std::vector<std::string>>> dependencies;
+
+   void CheckParams ();
+   std::unique_ptr<CppOutOfDate> Checker ();
+   void CompilePrecompiledHeaders ();
+   std::string CompileCommand (const std::string& cpp, const std::string& commandLine);
+   void AddDependencies (const std::string& file, const std::string& depFile);
+   void StoreDependencies ();
+   std::string Driver (const std::string& file) const;
+   std::string PrecompiledHeaderFile () const;
+   std::string CommandLine ();
+
+   static std::vector<std::string> ReadDepFile (const std::string& depFile);
+
+public:
+   ActualCompilerGcc (Compiler& compiler) : ActualCompiler{compiler} { }
+
+   void Compile () override;
+
+   std::vector<std::string> ObjFiles() override         { return ActualCompiler::ObjFiles("o"); }
+   std::vector<std::string> CompiledObjFiles() override { return ActualCompiler::CompiledObjFiles("o"); }
+};
+
+
+
+
+
+
 class Compiler {
    std::unique_ptr<ActualCompiler> actualCompiler;
 
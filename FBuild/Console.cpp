@@ -0,0 +1,203 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Console.h"
+
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <cstdio>
+#include <atomic>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+   std::mutex mutex;
+   std::ofstream jobLog;
+   const auto startTime = std::chrono::steady_clock::now();
+
+   // The trace is a JSON array, the closing bracket is written on exit.
+   struct Trace {
+      std::ofstream     stream;
+      std::atomic<bool> enabled{false};
+      std::atomic<int>  threads{0};
+
+      // The processes run on the Executor, each on a lane of its own while it runs. Lane and end of the last one there.
+      std::vector<std::pair<int, std::chrono::steady_clock::time_point>> processes;
+
+      ~Trace () { if (stream.is_open()) stream << "\n]\n"; }
+   } trace;
+
+   std::string Escape (const std::string& text)
+   {
+      std::string result;
+      result.reserve(text.size() + 2);
+
+      result += '"';
+      for (char ch : text) {
+         switch (ch) {
+         case '"':  result += "\\\""; break;
+         case '\\': result += "\\\\"; break;
+         case '\n': result += "\\n"; break;
+         case '\r': result += "\\r"; break;
+         case '\t': result += "\\t"; break;
+         default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+               char buffer[8];
+               std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+               result += buffer;
+            }
+            else result += ch;
+         }
+      }
+      result += '"';
+
+      return result;
+   }
+
+   int64_t Microseconds (std::chrono::steady_clock::time_point time)
+   {
+      return std::chrono::duration_cast<std::chrono::microseconds>(time - startTime).count();
+   }
+
+   // The lane of the current thread. Named on first use. The mutex must be locked.
+   int Lane ()
+   {
+      static thread_local int lane = 0;
+      if (lane) return lane;
+
+      lane = ++trace.threads;
+      trace.stream << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << lane << ",\"name\":\"thread_name\",\"args\":{\"name\":\"Thread " << lane << "\"}}";
+      return lane;
+   }
+
+   // The first process lane free since the start. The mutex must be locked.
+   int ProcessLane (std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+   {
+      for (auto&& [lane, last] : trace.processes) {
+         if (last > start) continue;
+         last = end;
+         return lane;
+      }
+
+      const int lane = ++trace.threads;
+      trace.processes.emplace_back(lane, end);
+      trace.stream << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << lane << ",\"name\":\"thread_name\",\"args\":{\"name\":\"Process " << trace.processes.size() << "\"}}";
+      return lane;
+   }
+
+   // A complete event. args is the content of a JSON object. The mutex must be locked.
+   void Event (int lane, const char* category, const std::string& name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, const std::string& args)
+   {
+      trace.stream << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << lane
+                   << ",\"cat\":\"" << category << "\""
+                   << ",\"name\":" << Escape(name)
+                   << ",\"ts\":" << Microseconds(start)
+                   << ",\"dur\":" << Microseconds(end) - Microseconds(start);
+      if (!args.empty()) trace.stream << ",\"args\":{" << args << "}";
+      trace.stream << "}";
+   }
+}
+
+
+namespace Console
+{
+   void Write (const std::string& text)
+   {
+      if (text.empty()) return;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      std::cout << text;
+      if (text.back() != '\n') std::cout << '\n';
+      std::cout.flush();
+   }
+
+   void OpenJobLog (const std::filesystem::path& file)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      jobLog.open(file, std::ios::out | std::ios::trunc | std::ios::binary);
+      if (!jobLog) throw std::runtime_error("Unable to open job log " + file.string());
+   }
+
+   void Job (const std::string& name, const std::string& commandLine, std::chrono::steady_clock::time_point start, int exitCode, const std::string& output)
+   {
+      using namespace std::chrono;
+
+      const auto now = steady_clock::now();
+
+      // Tools like cl.exe echo the name of the file, that's no news for a job which went well.
+      std::string text = output;
+      if (exitCode != 0) text += name + " failed (" + std::to_string(exitCode) + ")\n";
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (!text.empty()) {
+         std::cout << text;
+         if (text.back() != '\n') std::cout << '\n';
+         std::cout.flush();
+      }
+
+      if (jobLog.is_open()) {
+         jobLog << "{\"job\":" << Escape(name)
+                << ",\"command\":" << Escape(commandLine)
+                << ",\"start\":" << duration_cast<milliseconds>(start - startTime).count()
+                << ",\"duration\":" << duration_cast<milliseconds>(now - start).count()
+                << ",\"exit\":" << exitCode
+                << ",\"output\":" << Escape(output)
+                << "}\n";
+         jobLog.flush();
+      }
+
+      if (trace.enabled) {
+         Event(ProcessLane(start, now), "process", std::filesystem::path{name}.filename().string(), start, now, "\"job\":" + Escape(name) + ",\"command\":" + Escape(commandLine) + ",\"exit\":" + std::to_string(exitCode));
+      }
+   }
+
+   void OpenTrace (const std::filesystem::path& file)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      trace.stream.open(file, std::ios::out | std::ios::trunc | std::ios::binary);
+      if (!trace.stream) throw std::runtime_error("Unable to open trace " + file.string());
+
+      trace.stream << "[\n{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"FBuild\"}}";
+      trace.enabled = true;
+   }
+
+   bool Tracing ()
+   {
+      return trace.enabled;
+   }
+
+   Span::Span (const char* category, const std::string& name) : category_{category}
+   {
+      if (!trace.enabled) return;
+
+      name_ = name;
+      start_ = std::chrono::steady_clock::now();
+   }
+
+   void Span::End ()
+   {
+      if (!name_.empty()) end_ = std::chrono::steady_clock::now();
+   }
+
+   Span::~Span ()
+   {
+      if (!trace.enabled || name_.empty()) return;
+
+      const auto end = end_ == std::chrono::steady_clock::time_point{} ? std::chrono::steady_clock::now() : end_;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      Event(Lane(), category_, name_, start_, end, std::string{});
+   }
+}
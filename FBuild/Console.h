@@ -0,0 +1,49 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <filesystem>
+
+
+// Output of the parallel jobs. Everything is written in one piece, thus lines of different jobs don't mix.
+namespace Console
+{
+   void Write (const std::string& text);
+
+   // Writes one JSON object per finished job to the file: job, command, start and duration (ms), exit code and output.
+   void OpenJobLog (const std::filesystem::path& file);
+
+   // Writes the output of the job to the console and adds the job to the log and the trace.
+   void Job (const std::string& name, const std::string& commandLine, std::chrono::steady_clock::time_point start, int exitCode, const std::string& output);
+
+   // Writes the timeline of the build to the file, in the Trace Event Format (chrome://tracing, ui.perfetto.dev).
+   // One lane per thread, with the jobs and the spans below on it, and lanes for the processes running at once. The file is completed when FBuild exits.
+   void OpenTrace (const std::filesystem::path& file);
+   bool Tracing ();
+
+   // A span of the trace, from construction to destruction, on the lane of the current thread. Does nothing without a trace.
+   class Span {
+   public:
+      Span (const char* category, const std::string& name);
+      ~Span ();
+
+      Span (const Span&) = delete;
+      Span& operator= (const Span&) = delete;
+
+      // Ends the span before its destruction, e.g. from another thread. It's still written on destruction (on the lane of that thread).
+      void End ();
+
+   private:
+      const char*                           category_;
+      std::string                           name_;
+      std::chrono::steady_clock::time_point start_;
+      std::chrono::steady_clock::time_point end_;
+   };
+}
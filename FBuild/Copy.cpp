@@ -10,7 +10,8 @@
 #include <iostream>
 #include <fstream>
 
-#include <Shlwapi.h>
+#include "Wildcard.h"
+#include "Vfs.h"
 
 #include "JavaScript.h"
 
@@ -34,7 +35,7 @@ static std::vector<std::filesystem::path> CollectSourceFiles (const std::string&
 
       for (auto&& entry : std::filesystem::directory_iterator{path}) {
          if (std::filesystem::is_regular_file(entry.path())) {
-            if (::PathMatchSpec(entry.path().filename().string().c_str(), pattern.c_str())) {
+            if (MatchesWildcard(entry.path().filename().string(), pattern)) {
                result.push_back(entry.path());
             }
          }
@@ -49,9 +50,9 @@ void Copy::DoFile (std::filesystem::path sourceFile, std::filesystem::path destF
    sourceFile.make_preferred();
    destFile.make_preferred();
 
-   if (std::filesystem::exists(destFile) && !ignoreTimestamp) {
-      const auto sourceTime = std::filesystem::last_write_time(sourceFile);
-      const auto destTime = std::filesystem::last_write_time(destFile);
+   if (Vfs::Exists(destFile) && !ignoreTimestamp) {
+      const auto sourceTime = Vfs::LastWriteTime(sourceFile);
+      const auto destTime = Vfs::LastWriteTime(destFile);
 
       if (destTime >= sourceTime) return;
    }
@@ -66,6 +67,7 @@ void Copy::DoFile (std::filesystem::path sourceFile, std::filesystem::path destF
 
    const auto sourceTime = std::filesystem::last_write_time(sourceFile);
    std::filesystem::last_write_time(destFile, sourceTime);
+   Vfs::Changed(destFile);
 
    ++copied;
 
@@ -94,9 +96,9 @@ static bool NeedsCopy (std::filesystem::path source, std::filesystem::path dest)
    source.make_preferred();
    dest.make_preferred();
 
-   if (std::filesystem::exists(dest)) {
-      const auto sourceTime = std::filesystem::last_write_time(source);
-      const auto destTime = std::filesystem::last_write_time(dest);
+   if (Vfs::Exists(dest)) {
+      const auto sourceTime = Vfs::LastWriteTime(source);
+      const auto destTime = Vfs::LastWriteTime(dest);
 
       if (destTime >= sourceTime) return false;
    }
@@ -6,241 +6,413 @@
  */
 
 #include "CppDepends.h"
-#include "Parser.h"
-#include "BinaryStream.h"
+#include "DependencyDatabase.h"
+#include "IncludeScanner.h"
 #include "MemoryMappedFile.h"
+#include "Hash.h"
+#include "Vfs.h"
+#include "Bits.h"
+#include "Stats.h"
 
-#include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 #include <mutex>
-#include <sstream>
+#include <map>
+#include <tuple>
 
 
 
 
-static std::mutex lastWriteTimeMutex;
-static std::unordered_map<std::string, uint64_t> lastWriteTimeCache;
-static std::string precompiledHeader;
-
-uint64_t LastWriteTime (const std::string& file)
+uint64_t CppDepends::LastWriteTime (const std::string& file)
 {
-   std::lock_guard lock(lastWriteTimeMutex);
-
-   auto it = lastWriteTimeCache.find(file);
-   if (it != lastWriteTimeCache.end()) return it->second;
-
-   uint64_t ts = 0;
-   try {
-      const std::filesystem::file_time_type timestamp = std::filesystem::last_write_time(file);
-      ts = std::chrono::duration_cast<std::chrono::seconds>(timestamp.time_since_epoch()).count();
-   }
-   catch (...) { }
-   
-   lastWriteTimeCache[file] = ts;
+   const auto timestamp = Vfs::LastWriteTime(file);
+   if (timestamp == std::filesystem::file_time_type::min()) return 0;
 
-   return ts;
+   return std::chrono::duration_cast<std::chrono::seconds>(timestamp.time_since_epoch()).count();
 }
 
 
 
 
+// A header might (un)define a macro of the target before another one tests it. Thus the macros which any scanned file
+// (un)defines are unknown to all scans. The set only grows. Whenever it grows by a macro that a scan relied on,
+// the generation changes: the closures built so far might miss includes, and the walks that used them start over.
+static std::mutex macrosMutex;
+static std::unordered_set<std::string> definedAnywhere;
+static std::unordered_set<std::string> assumedAnywhere;
+static std::atomic<uint64_t> macrosGeneration{0};
 
 
-static const std::string includeString = "include";
 
-static std::vector<std::filesystem::path>& IncludePaths ()
+CppDepends::CppDepends (const std::filesystem::path& file, const Settings& settings, DependencyDatabase* database, bool ignoreCache) : settings{settings}
 {
-   static std::vector<std::filesystem::path> includes;
-   return includes;
-}
-
+   Stats::Timer timer{Stats::Counter::DependsTime};
+   Stats::Add(Stats::Counter::DependsUnits);
 
-
-
-
-CppDepends::CppDepends (const std::filesystem::path& file, bool ignoreCache)
-{
    maxTime = 0;
 
    std::filesystem::path f = std::filesystem::canonical(file);
    f.make_preferred();
 
-   if (!ignoreCache && CheckCache(f)) return;
+   if (database && !ignoreCache && database->Get(f.string(), dependencies, maxTime)) {
+      Stats::Add(Stats::Counter::DependsDatabaseHits);
+      return;
+   }
+
+   Stats::Add(Stats::Counter::DependsDatabaseMisses);
 
    dependencies.clear();
 
-   if (precompiledHeader.size()) DoFile(std::filesystem::canonical(precompiledHeader));
-   DoFile(f);
+   Closure closure;
+   for (;;) {
+      const uint64_t generation = macrosGeneration.load(std::memory_order_acquire);
 
-   WriteCache(f);
-}
+      closure = *ClosureOf(PathTable::Intern(f.string()), generation);
+      if (settings.precompiledHeader.size()) {
+         auto pch = std::filesystem::canonical(settings.precompiledHeader);
+         closure.Add(*ClosureOf(PathTable::Intern(pch.make_preferred().string()), generation));
+      }
 
-void CppDepends::DoFile (std::filesystem::path file)
-{
-   file.make_preferred();
+      if (generation == macrosGeneration.load(std::memory_order_acquire)) break;
+   }
 
-   if (dependencies.find(file.string()) != dependencies.end()) return;
-   dependencies.insert(file.string());
+   for (size_t word = 0; word < closure.bits.size(); ++word) {
+      for (uint64_t bits = closure.bits[word]; bits; bits &= bits - 1) {
+         dependencies.push_back(static_cast<PathTable::Id>(word * 64 + CountTrailingZeros(bits)));
+      }
+   }
 
-   const auto todo = Includes(file);
+   std::sort(dependencies.begin(), dependencies.end(), [] (PathTable::Id a, PathTable::Id b) { return PathTable::Name(a) < PathTable::Name(b); });
+   maxTime = closure.maxTime;
+
+   if (!database) return;
+
+   std::vector<std::pair<PathTable::Id, uint64_t>> times;
+   times.reserve(dependencies.size());
+
+   for (auto&& dep : dependencies) times.emplace_back(dep, LastWriteTime(std::string{PathTable::Name(dep)}));
+
+   database->Put(f.string(), std::move(times));
+}
 
-   const auto parentPath = file.parent_path();
 
-   std::for_each(todo.cbegin(), todo.cend(), [&] (const std::pair<char, std::string>& v) {
-      if (v.first == '<') IncludeAnglebracketed(parentPath, v.second);
-      else IncludeQuoted(parentPath, v.second);
-   });
+void CppDepends::Closure::Add (PathTable::Id file)
+{
+   const size_t word = file / 64;
+   if (word >= bits.size()) bits.resize(word + 1, 0);
+   bits[word] |= uint64_t{1} << (file % 64);
 }
 
-void CppDepends::IncludeQuoted (const std::filesystem::path& path, const std::filesystem::path& file)
+void CppDepends::Closure::Add (const Closure& other)
 {
-   std::filesystem::path include = path / file;
+   if (other.bits.size() > bits.size()) bits.resize(other.bits.size(), 0);
+
+   const uint64_t* source = other.bits.data();
+   uint64_t* dest = bits.data();
+   for (size_t i = 0, n = other.bits.size(); i < n; ++i) dest[i] |= source[i];
 
-   if (std::filesystem::exists(include) && std::filesystem::is_regular_file(include)) DoFile(include);
-   else IncludeAnglebracketed(path, file);
+   maxTime = std::max(maxTime, other.maxTime);
 }
 
-void CppDepends::IncludeAnglebracketed (const std::filesystem::path& path, const std::filesystem::path& file)
+// Tarjan's algorithm. Include cycles (strongly connected components) share one closure.
+// A component is complete once all components it includes are, thus every closure is the union of the closures of the children.
+std::shared_ptr<const CppDepends::Closure> CppDepends::ClosureOf (PathTable::Id root, uint64_t generation) const
 {
-   const auto& includes = IncludePaths();
-   for (size_t i = 0; i < includes.size(); ++i) {
-      std::filesystem::path include = includes[i] / file;
-      if (std::filesystem::exists(include) && std::filesystem::is_regular_file(include)) {
-         DoFile(include);
-         return;
+   static std::mutex closuresMutex;
+   static std::map<std::tuple<uint64_t, uint64_t, uint64_t>, std::unordered_map<PathTable::Id, std::shared_ptr<const Closure>>> closures;   // (include paths, defines, generation) -> file
+
+   std::unordered_map<PathTable::Id, std::shared_ptr<const Closure>>* cache = nullptr;
+   {
+      std::lock_guard lock(closuresMutex);
+      cache = &closures[{settings.includePathsKey, settings.macrosKey, generation}];
+      auto it = cache->find(root);
+      if (it != cache->end()) {
+         Stats::Add(Stats::Counter::DependsClosureHits);
+         return it->second;
       }
    }
 
-   std::filesystem::path include = path / file;
+   Stats::Add(Stats::Counter::DependsClosureMisses);
 
-   if (std::filesystem::exists(include) && std::filesystem::is_regular_file(include)) DoFile(include);
-}
+   std::unordered_map<PathTable::Id, std::shared_ptr<const Closure>> complete;
 
+   const auto find = [&] (PathTable::Id file) -> std::shared_ptr<const Closure> {
+      auto it = complete.find(file);
+      if (it != complete.end()) return it->second;
 
-static std::mutex includesMutex;
-static std::unordered_map<std::string, std::vector<std::pair<char, std::string>>> includesCache;
+      std::lock_guard lock(closuresMutex);
+      auto cached = cache->find(file);
+      if (cached == cache->end()) return nullptr;
 
-std::vector<std::pair<char, std::string>> CppDepends::Includes (const std::filesystem::path& file)
-{
-   {
-      std::lock_guard lock(includesMutex);
-      auto it = includesCache.find(file.string());
-      if (it != includesCache.end()) return it->second;
-   }
+      complete.emplace(file, cached->second);
+      return cached->second;
+   };
+
+   struct Node {
+      uint32_t                   number;
+      uint32_t                   lowLink;
+      bool                       onStack;
+      std::vector<PathTable::Id> children;
+   };
+
+   struct Frame {
+      PathTable::Id file;
+      size_t        next;
+   };
+
+   std::unordered_map<PathTable::Id, Node> nodes;
+   std::vector<PathTable::Id> stack;
+   std::vector<Frame> frames;
+
+   const auto visit = [&] (PathTable::Id file) {
+      const auto number = static_cast<uint32_t>(nodes.size());
+      nodes.emplace(file, Node{number, number, true, Children(file)});
+      stack.push_back(file);
+      frames.push_back(Frame{file, 0});
+   };
 
-   std::vector<std::pair<char, std::string>> includes;
-
-   const MemoryMappedFile mmf{file};
-   const char* it = mmf.CBegin();
-   const char* end = mmf.CEnd();
-
-   it = std::find(it, end, '#');
-   while (it != end) {
-      ++it;
-      it = SkipWhitespaces(it, end);
-      auto itTmp = ConsumeIfEqual(it, end, includeString.cbegin(), includeString.cend());
-      if (it != itTmp) {
-         it = itTmp;
-         it = SkipWhitespaces(it, end);
-
-         auto itStart = it + 1;
-         if (*it == '\"') {
-            it = ConsumeUntil(itStart, end, '\"');
-            if (it != itStart) includes.emplace_back(std::pair<char, std::string>('\"', std::string(itStart, it)));
+   visit(root);
+
+   while (!frames.empty()) {
+      Frame& frame = frames.back();
+      Node& node = nodes.at(frame.file);
+
+      if (frame.next < node.children.size()) {
+         const PathTable::Id child = node.children[frame.next++];
+         if (find(child)) continue;
+
+         auto it = nodes.find(child);
+         if (it == nodes.end()) visit(child);
+         else if (it->second.onStack) node.lowLink = std::min(node.lowLink, it->second.number);
+         continue;
+      }
+
+      const PathTable::Id file = frame.file;
+      const uint32_t lowLink = node.lowLink;
+
+      if (node.lowLink == node.number) {
+         std::vector<PathTable::Id> members;
+         PathTable::Id member;
+         do {
+            member = stack.back();
+            stack.pop_back();
+            nodes.at(member).onStack = false;
+            members.push_back(member);
+         } while (member != file);
+
+         auto closure = std::make_shared<Closure>();
+         for (auto&& m : members) {
+            closure->Add(m);
+            closure->maxTime = std::max(closure->maxTime, LastWriteTime(std::string{PathTable::Name(m)}));
+
+            for (auto&& child : nodes.at(m).children) {
+               if (auto other = find(child)) closure->Add(*other);   // Members of this component aren't complete yet. They're in the bits anyway.
+            }
          }
-         else if (*it == '<') {
-            it = ConsumeUntil(itStart, end, '>');
-            if (it != itStart) includes.emplace_back(std::pair<char, std::string>('<', std::string(itStart, it)));
+
+         std::lock_guard lock(closuresMutex);
+         for (auto&& m : members) {
+            complete[m] = cache->emplace(m, closure).first->second;
          }
       }
 
-      it = std::find(it, end, '#');
+      frames.pop_back();
+      if (!frames.empty()) {
+         Node& parent = nodes.at(frames.back().file);
+         parent.lowLink = std::min(parent.lowLink, lowLink);
+      }
    }
 
-   std::lock_guard lock(includesMutex);
-   includesCache[file.string()] = includes;
+   return find(root);
+}
+
+std::vector<PathTable::Id> CppDepends::Children (PathTable::Id file) const
+{
+   const auto scanned = Includes(file);
+
+   std::vector<PathTable::Id> children;
+   children.reserve(scanned->includes.size());
 
-   return std::move(includes);
+   for (auto&& [kind, include] : scanned->includes) {
+      const PathTable::Id child = Resolve(kind, scanned->directory, include);
+      if (child != PathTable::None) children.push_back(child);
+   }
+
+   std::sort(children.begin(), children.end());
+   children.erase(std::unique(children.begin(), children.end()), children.end());
+
+   return children;
 }
 
-bool CppDepends::CheckCache (const std::filesystem::path& file)
+PathTable::Id CppDepends::Resolve (char kind, PathTable::Id path, PathTable::Id file) const
 {
-   std::ifstream stream(file.string() + ":CppDepends_Cache5", std::ofstream::in | std::ofstream::ate | std::ofstream::binary);
-   if (!stream.good()) return false;
-   if (stream.tellg() < sizeof(size_t)) return false;
-   stream.seekg(0);
-
-   std::string tmp;
-   uint64_t ts;
-
-   stream > tmp;
-   if (tmp != file.string()) return false;
-
-   uint32_t count = 0;
-   stream > count;
-   for (uint32_t i = 0; i < count; ++i) {
-      stream > tmp > ts;
-      if (LastWriteTime(tmp) != ts) return false;
-      dependencies.insert(tmp);
-      if (ts > maxTime) maxTime = ts;
+   if (kind != '<') {
+      const PathTable::Id include = FindLocal(path, file);
+      if (include != PathTable::None) return include;
    }
 
-   return true;
+   const PathTable::Id include = FindInIncludePaths(file);
+   if (include != PathTable::None) return include;
+
+   return FindLocal(path, file);
+}
+
+
+// Misses are cached too: most of the probes are misses, e.g. <vector> in every include path before the one of the STL.
+static std::mutex localMutex;
+static std::unordered_map<uint64_t, PathTable::Id> localCache;                                          // (directory, name)
+static std::mutex searchMutex;
+static std::unordered_map<uint64_t, std::unordered_map<PathTable::Id, PathTable::Id>> searchCache;  // include path set -> name
+
+static PathTable::Id Intern (std::filesystem::path path)
+{
+   return PathTable::Intern(path.make_preferred().string());
 }
 
-void CppDepends::WriteCache (const std::filesystem::path& file)
+PathTable::Id CppDepends::FindLocal (PathTable::Id path, PathTable::Id file)
 {
-   std::string writeMe;
+   const uint64_t key = uint64_t{path} << 32 | file;
 
    {
-      std::stringstream ss;
-      ss < file.string();
-      ss < static_cast<uint32_t>(dependencies.size());
-      for (auto&& dep : dependencies) {
-         uint64_t ts = LastWriteTime(dep);
-         ss < dep < ts;
-         if (ts > maxTime) maxTime = ts;
+      std::lock_guard lock(localMutex);
+      auto it = localCache.find(key);
+      if (it != localCache.end()) {
+         Stats::Add(Stats::Counter::DependsLookupHits);
+         return it->second;
       }
-
-      writeMe = ss.str();
    }
 
-   const auto ts = std::filesystem::last_write_time(file);
+   Stats::Add(Stats::Counter::DependsLookupMisses);
+
+   const std::filesystem::path include = std::filesystem::path{PathTable::Name(path)} / PathTable::Name(file);
+   const PathTable::Id id = Vfs::IsFile(include) ? Intern(include) : PathTable::None;
+
+   std::lock_guard lock(localMutex);
+   localCache.emplace(key, id);
 
+   return id;
+}
+
+PathTable::Id CppDepends::FindInIncludePaths (PathTable::Id file) const
+{
+   // Independent of the including file. Targets with the same include paths share the entries.
    {
-      std::ofstream stream(file.string() + ":CppDepends_Cache5", std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
-      if (!stream.good()) {
-         std::cerr << "Error on writing cache for " << file << std::endl;
-         return;
+      std::lock_guard lock(searchMutex);
+      auto& cache = searchCache[settings.includePathsKey];
+      auto it = cache.find(file);
+      if (it != cache.end()) {
+         Stats::Add(Stats::Counter::DependsLookupHits);
+         return it->second;
       }
+   }
+
+   Stats::Add(Stats::Counter::DependsLookupMisses);
+
+   PathTable::Id id = PathTable::None;
 
-      stream.write(writeMe.c_str(), writeMe.size());
+   for (auto&& includePath : settings.includePaths) {
+      const std::filesystem::path include = includePath / PathTable::Name(file);
+      if (Vfs::IsFile(include)) {
+         id = Intern(include);
+         break;
+      }
    }
 
-   std::filesystem::last_write_time(file, ts);
-}
+   std::lock_guard lock(searchMutex);
+   searchCache[settings.includePathsKey].emplace(file, id);
 
+   return id;
+}
 
 
-void CppDepends::ClearIncludePath ()
+std::shared_ptr<const CppDepends::Scanned> CppDepends::Includes (PathTable::Id file) const
 {
-   IncludePaths().clear();
+   // The includes of a header depend on the defines. Targets with other defines have their own entries.
+   // Stale entries are replaced, walks that still use the old one start over anyway (see macrosGeneration).
+   static std::unordered_map<uint64_t, std::unordered_map<PathTable::Id, std::shared_ptr<const Scanned>>> includesCache;   // macrosKey -> file
+
+   const auto stale = [] (const Scanned& scanned) {
+      return std::any_of(scanned.assumed.begin(), scanned.assumed.end(), [] (const std::string& name) { return definedAnywhere.count(name) != 0; });
+   };
+
+   // Only the macros of the target matter, a few compared to all the names the headers define.
+   std::unordered_set<std::string> unknown;
+   {
+      std::lock_guard lock(macrosMutex);
+      auto& cache = includesCache[settings.macrosKey];
+      auto it = cache.find(file);
+      if (it != cache.end() && !stale(*it->second)) return it->second;
+
+      for (auto&& macro : settings.macros) {
+         if (definedAnywhere.count(macro.first)) unknown.insert(macro.first);
+      }
+   }
+
+   const std::filesystem::path path{PathTable::Name(file)};
+
+   auto scanned = std::make_shared<Scanned>();
+   scanned->directory = PathTable::Intern(path.parent_path().string());
+
+   const MemoryMappedFile mmf{path};
+   Stats::Add(Stats::Counter::DependsFilesParsed);
+   Stats::Add(Stats::Counter::DependsBytesScanned, mmf.Size());
+
+   IncludeScanner::MacroUse use;
+   for (auto&& [kind, include] : IncludeScanner::ScanPrecise(mmf.CBegin(), mmf.CEnd(), settings.macros, unknown, use)) {
+      scanned->includes.emplace_back(kind, PathTable::Intern(include));
+   }
+   scanned->assumed = std::move(use.assumed);
+
+   std::lock_guard lock(macrosMutex);
+
+   // Scans of other threads may have relied on a macro this file (un)defines, or this one on a macro defined meanwhile.
+   bool broken = stale(*scanned);
+   for (auto&& name : use.defined) {
+      if (definedAnywhere.insert(name).second && assumedAnywhere.count(name)) broken = true;
+   }
+   assumedAnywhere.insert(scanned->assumed.begin(), scanned->assumed.end());
+   if (broken) macrosGeneration.fetch_add(1, std::memory_order_release);
+
+   auto& entry = includesCache[settings.macrosKey][file];
+   entry = scanned;
+   return entry;
 }
 
-void CppDepends::AddIncludePath (const std::filesystem::path& path)
+
+
+void CppDepends::Settings::AddIncludePath (const std::filesystem::path& path)
 {
    auto p = std::filesystem::canonical(path);
    p.make_preferred();
 
    if (!std::filesystem::exists(p)) std::cout << "Include-Path " << p << " does not exist. Ignored.";
    else if (!std::filesystem::is_directory(p)) std::cout << "Include-Path " << p << "is invalid. It's not a directory. Ignored";
-   else IncludePaths().push_back(p);
+   else {
+      includePaths.push_back(p);
+      includePathsKey = Hash64(std::to_string(includePathsKey) + '|' + p.string());
+   }
 }
 
-void CppDepends::PrecompiledHeader (const std::string& prec)
+void CppDepends::Settings::AddDefine (const std::string& define)
 {
-   precompiledHeader = prec;
+   const auto pos = define.find('=');
+   const std::string name = define.substr(0, pos);
+   const std::string value = pos == std::string::npos ? "1" : define.substr(pos + 1);
+
+   if (name.empty() || macros.count(name)) return;
+
+   macros.emplace(name, value);
+   macrosKey ^= Hash64(name + "=" + value, 1);   // Independent of the order
+}
+
+uint64_t CppDepends::Settings::Key () const
+{
+   std::string text = precompiledHeader + '\n' + std::to_string(macrosKey) + '\n';
+   for (auto&& path : includePaths) text += path.string() + '\n';
+
+   return Hash64(text);
 }
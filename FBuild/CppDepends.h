@@ -8,17 +8,39 @@
 #pragma once
 
 #include <string>
-#include <unordered_set>
+#include <vector>
+#include <memory>
 #include <iostream>
 #include <filesystem>
 
+#include "IncludeScanner.h"
+#include "PathTable.h"
+
+
+class DependencyDatabase;
 
 
 class CppDepends {
 public:
-   CppDepends (const std::filesystem::path& file, bool ignoreCache = false);
+   // The include paths, defines and precompiled header of one target.
+   struct Settings {
+      std::vector<std::filesystem::path> includePaths;
+      uint64_t                           includePathsKey{0};
+      std::string                        precompiledHeader;
+      IncludeScanner::Macros             macros;
+      uint64_t                           macrosKey{0};
+
+      void AddIncludePath (const std::filesystem::path& path);
+      void AddDefine (const std::string& define);   // "NAME" or "NAME=value"
+
+      // Changes with anything that changes the dependencies of a file.
+      uint64_t Key () const;
+   };
+
+   CppDepends (const std::filesystem::path& file, const Settings& settings, DependencyDatabase* database = nullptr, bool ignoreCache = false);
 
-   typedef std::unordered_set<std::string>::const_iterator Iterator;
+   // The dependencies, sorted by name
+   typedef std::vector<PathTable::Id>::const_iterator Iterator;
 
    Iterator Begin () const { return dependencies.cbegin(); }
    Iterator End () const { return dependencies.cend(); }
@@ -27,23 +49,41 @@ public:
 
    uint64_t MaxTime () const { return maxTime; }
 
-   // Beware. These functions are NOT threadsafe
-   static void ClearIncludePath ();
-   static void AddIncludePath (const std::filesystem::path& path);
-   static void PrecompiledHeader (const std::string& prec);
+   static uint64_t LastWriteTime (const std::string& file);
 
 private:
-   std::unordered_set<std::string> dependencies{};
+   // The includes of a file (as written) and the directory they are relative to.
+   // And the macros of the target its conditions relied on: once a file (un)defines one of them, the scan is stale.
+   struct Scanned {
+      PathTable::Id                               directory;
+      std::vector<std::pair<char, PathTable::Id>> includes;
+      std::vector<std::string>                    assumed;
+   };
+
+   // A file and everything it includes, directly or not: one bit per PathTable::Id, and the newest timestamp of them.
+   struct Closure {
+      std::vector<uint64_t> bits;
+      uint64_t              maxTime{0};
+
+      void Add (PathTable::Id file);
+      void Add (const Closure& other);
+   };
+
+   const Settings& settings;
+   std::vector<PathTable::Id> dependencies{};
    uint64_t maxTime{0};
 
-   void DoFile (std::filesystem::path file);
-   std::vector<std::pair<char, std::string>> Includes (const std::filesystem::path& file);
+   // Memoized for all files with the same include paths and defines. Thus every header is scanned and walked once per build.
+   // The closures of a generation are built from scans which were valid then (see Includes).
+   std::shared_ptr<const Closure> ClosureOf (PathTable::Id file, uint64_t generation) const;
+   std::vector<PathTable::Id> Children (PathTable::Id file) const;
 
-   void IncludeQuoted (const std::filesystem::path& path, const std::filesystem::path& file);
-   void IncludeAnglebracketed (const std::filesystem::path& path, const std::filesystem::path& file);
+   std::shared_ptr<const Scanned> Includes (PathTable::Id file) const;
+   PathTable::Id Resolve (char kind, PathTable::Id path, PathTable::Id file) const;
 
-   bool CheckCache (const std::filesystem::path& file);
-   void WriteCache (const std::filesystem::path& file);
+   // The resolved include or PathTable::None, memoized for all files and targets.
+   static PathTable::Id FindLocal (PathTable::Id path, PathTable::Id file);
+   PathTable::Id FindInIncludePaths (PathTable::Id file) const;
 };
 
 
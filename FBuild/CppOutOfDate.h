@@ -8,13 +8,23 @@
 #pragma once
 
 #include "CppDepends.h"
+#include "DependencyDatabase.h"
+#include "JobSystem.h"
+#include "SignatureStore.h"
+#include "Vfs.h"
+#include "Console.h"
+#include "Stats.h"
 
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <mutex>
-#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <limits>
 
 
 
@@ -22,53 +32,122 @@ class CppOutOfDate {
 public:
    CppOutOfDate (const std::string& objectFileExtension) : objectFileExtension_{"." + objectFileExtension}
    {
-      current_ = 0;
       ignoreCache_ = false;
       numberOfThreads_ = 0;
-      scriptTime_ = LastWriteTime("FBuild.js");
       files_.reserve(1000);
-
-      CppDepends::ClearIncludePath();
-      CppDepends::PrecompiledHeader("");
    }
 
    void OutDir (std::string v)                      { outdir_ = std::move(v); }
    void IgnoreCache (bool v)                        { ignoreCache_ = v; }
    void Threads (uint32_t v)                        { numberOfThreads_ = v; }
-   void AddIncludePath (const std::string& path)    { CppDepends::AddIncludePath(path); }
+   void AddIncludePath (const std::string& path)    { settings_.AddIncludePath(path); }
    void Files (std::vector<std::string>&& v)        { files_ = std::move(v); }
    void Files (const std::vector<std::string>& v)   { std::copy(v.begin(), v.end(), std::back_inserter(files_)); }
-   void Include (const std::vector<std::string>& v) { std::for_each(v.begin(), v.end(), [] (const std::string& s) { CppDepends::AddIncludePath(s); }); }
-   void PrecompiledHeader (const std::string& v)    { CppDepends::PrecompiledHeader(v); }
+   void Include (const std::vector<std::string>& v) { std::for_each(v.begin(), v.end(), [this] (const std::string& s) { settings_.AddIncludePath(s); }); }
+   void PrecompiledHeader (const std::string& v)    { settings_.precompiledHeader = v; }
+   void Defines (const std::vector<std::string>& v) { for (auto&& define : v) settings_.AddDefine(define); }
+   void CommandLine (std::string v)                 { commandLine_ = std::move(v); }
+   void CacheCommandLine (std::string v)            { cacheCommandLine_ = std::move(v); }
 
-   void Go ()
+   // Called from any thread for every out of date file, as soon as it's known. cacheKey is 0 without a CacheCommandLine.
+   typedef std::function<void(const std::string& file, uint64_t signature, uint64_t cacheKey)> OutOfDateFunction;
+
+   // The file is checked before all others, thus it's reported (if at all) before Start() returns. For the cpp of the precompiled header.
+   void First (const std::string& v)                { first_ = v; }
+
+   // Checks the files in the background
+   void Start (OutOfDateFunction onOutOfDate)
    {
       if (outdir_.empty()) throw std::runtime_error("Missing 'Outdir'");
 
-      uint32_t cpus = std::thread::hardware_concurrency();
-      if (!cpus) cpus = 2;
-      if (numberOfThreads_) cpus = numberOfThreads_;
+      onOutOfDate_ = std::move(onOutOfDate);
+      span_ = std::make_unique<Console::Span>("check", "Check " + outdir_);
 
-      for (size_t i = 0; i < cpus; ++i) {
-         threadGroup_.emplace_back(std::thread([this] () { Thread(); }));
-      }
+      database_ = std::make_unique<DependencyDatabase>(outdir_, settings_.Key());
+      if (!ignoreCache_) database_->Validate(numberOfThreads_);
+
+      std::error_code ec;
+      auto first = std::find_if(files_.cbegin(), files_.cend(), [this, &ec] (const std::string& file) {
+         return first_.size() && std::filesystem::equivalent(first_, file, ec);
+      });
+      if (first != files_.cend()) Check(*first);
 
-      for (;;) {
-         if (Done()) break;
-         std::this_thread::yield();
+      remaining_ = files_.size() - (first != files_.cend());
+      if (!remaining_) span_->End();
+
+      // Before any compile job. Checking is quick, and the sooner the long files are known, the sooner they start.
+      jobs_ = std::make_unique<JobGroup>(numberOfThreads_, std::numeric_limits<int64_t>::max());
+      for (auto it = files_.cbegin(); it != files_.cend(); ++it) {
+         if (it == first) continue;
+
+         jobs_->Add([this, &file = *it] () {
+            struct Done {
+               CppOutOfDate* checker;
+               ~Done () { if (--checker->remaining_ == 0) checker->span_->End(); }
+            } done{this};
+
+            Check(file);
+         });
       }
+   }
+
+   // All files checked
+   bool Done () const { return remaining_ == 0; }
 
-      for (auto&& thread : threadGroup_) thread.join();
+   // Waits for all files and saves the dependencies
+   void Finish ()
+   {
+      if (jobs_) jobs_->Wait();
+      jobs_.reset();
+
+      if (database_) database_->Save();
+      span_.reset();
+   }
+
+   void Go ()
+   {
+      Start(nullptr);
+      Finish();
    }
 
    const std::vector<std::string>& OutOfDate () const { return outOfDate_; }
 
+   // The signature of every checked file. To be recorded for its object file once that is compiled.
+   const std::unordered_map<std::string, uint64_t>& Signatures () const { return signatures_; }
+
+   // The key into the CompilationCache of every out of date file. Only if there's a CacheCommandLine.
+   const std::unordered_map<std::string, uint64_t>& CacheKeys () const { return cacheKeys_; }
+
+   // The key of the DependencyDatabase of the OutDir
+   uint64_t SettingsKey () const { return settings_.Key(); }
+
+   // Everything the object is built from: The flags and the contents of all files the translation unit consists of.
+   // The files are hashed once per build (see SignatureStore::FileHash), not once per unit including them.
+   static uint64_t ObjectSignature (const std::string& commandLine, std::vector<PathTable::Id> dependencies)
+   {
+      SortByName(dependencies);
+
+      Signature signature;
+      signature.Add(commandLine);
+      for (auto&& dependency : dependencies) signature.Add(PathTable::Name(dependency)).AddFile(dependency);
+
+      return signature.Value();
+   }
+
+   // Like the signature, but independent of where the files are located. Only their contents count.
+   static uint64_t CacheKey (const std::string& cacheCommandLine, const std::string& file, std::vector<PathTable::Id> dependencies)
+   {
+      SortByName(dependencies);
+
+      Signature key;
+      key.Add(cacheCommandLine).Add(std::filesystem::path{file}.filename().string());
+      for (auto&& dependency : dependencies) key.AddFile(dependency);
+
+      return key.Value();
+   }
+
 private:
-   std::vector<std::thread> threadGroup_;
-   std::mutex               filesMutex_;
    std::mutex               outOfDateMutex_;
-   size_t                   current_;
-   uint64_t                 scriptTime_;
    std::string              objectFileExtension_;
 
    std::string              outdir_;
@@ -76,51 +155,92 @@ private:
    uint32_t                 numberOfThreads_;
    std::vector<std::string> files_;
    std::vector<std::string> outOfDate_;
+   std::string              commandLine_;
+   std::string              cacheCommandLine_;
+   CppDepends::Settings     settings_;
+
+   std::string              first_;
+   OutOfDateFunction        onOutOfDate_;
+   std::unique_ptr<JobGroup> jobs_;
+   std::atomic<size_t>      remaining_{0};
+   std::unique_ptr<Console::Span> span_;
+
+   std::unique_ptr<DependencyDatabase>       database_;
+   std::unordered_map<std::string, uint64_t> signatures_;
+   std::unordered_map<std::string, uint64_t> cacheKeys_;
+
+   // The ids differ from run to run, the names don't. Usually sorted already (see CppDepends).
+   static void SortByName (std::vector<PathTable::Id>& ids)
+   {
+      const auto less = [] (PathTable::Id a, PathTable::Id b) { return PathTable::Name(a) < PathTable::Name(b); };
+      if (!std::is_sorted(ids.begin(), ids.end(), less)) std::sort(ids.begin(), ids.end(), less);
+   }
 
    inline uint64_t LastWriteTime (const std::filesystem::path& file)
    {
-      return std::chrono::duration_cast<std::chrono::seconds>(std::filesystem::last_write_time(file).time_since_epoch()).count();
+      return std::chrono::duration_cast<std::chrono::seconds>(Vfs::LastWriteTime(file).time_since_epoch()).count();
    }
 
-   bool GetFile (std::filesystem::path& result)
+   void AddOutOfDate (const std::string& file, uint64_t signature, const CppDepends& dep, Stats::Counter reason)
    {
-      std::lock_guard lock(filesMutex_);
-      if (current_ == files_.size()) return false;
+      Stats::Add(reason);
 
-      result = files_[current_];
-      ++current_;
-      return true;
-   }
+      const uint64_t cacheKey = cacheCommandLine_.empty() ? 0 : CacheKey(file, dep);
 
-   bool Done ()
-   {
-      std::lock_guard lock(filesMutex_);
-      return current_ == files_.size();
+      {
+         std::lock_guard lock(outOfDateMutex_);
+         outOfDate_.push_back(file);
+         signatures_[file] = signature;
+         if (!cacheCommandLine_.empty()) cacheKeys_[file] = cacheKey;
+      }
+
+      if (onOutOfDate_) onOutOfDate_(file, signature, cacheKey);
    }
 
-   void AddOutOfDate (const std::string& file)
+   void AddUpToDate (const std::string& file, uint64_t signature)
    {
+      Stats::Add(Stats::Counter::CheckUpToDate);
+
       std::lock_guard lock(outOfDateMutex_);
-      outOfDate_.push_back(file);
+      signatures_[file] = signature;
    }
 
-   void Thread ()
+   uint64_t ObjectSignature (const CppDepends& dep) const
    {
-      std::filesystem::path objdir(outdir_);
-      std::filesystem::path file;
-
-      for (;;) {
-         if (!GetFile(file)) break;
-         CppDepends dep(file, ignoreCache_);
+      return ObjectSignature(commandLine_, std::vector<PathTable::Id>(dep.Begin(), dep.End()));
+   }
 
-         auto obj = objdir / file.filename();
-         obj.replace_extension(objectFileExtension_);
+   uint64_t CacheKey (const std::string& file, const CppDepends& dep) const
+   {
+      return CacheKey(cacheCommandLine_, file, std::vector<PathTable::Id>(dep.Begin(), dep.End()));
+   }
 
-         if (!std::filesystem::exists(obj)) AddOutOfDate(file.string());
-         else if (!std::filesystem::file_size(obj)) AddOutOfDate(file.string());
-         else if (LastWriteTime(obj) < dep.MaxTime()) AddOutOfDate(file.string());
-         else if (LastWriteTime(obj) < scriptTime_) AddOutOfDate(file.string());
+   void Check (const std::filesystem::path& file)
+   {
+      Console::Span span{"check", file.filename().string()};
+      Stats::Timer timer{Stats::Counter::CheckTime};
+      Stats::Add(Stats::Counter::CheckUnits);
+
+      CppDepends dep(file, settings_, database_.get(), ignoreCache_);
+
+      auto obj = std::filesystem::path(outdir_) / file.filename();
+      obj.replace_extension(objectFileExtension_);
+
+      const uint64_t signature = ObjectSignature(dep);
+      auto& store = SignatureStore::Instance();
+
+      if (!Vfs::Exists(obj)) AddOutOfDate(file.string(), signature, dep, Stats::Counter::CheckMissingObject);
+      else if (!Vfs::FileSize(obj)) AddOutOfDate(file.string(), signature, dep, Stats::Counter::CheckEmptyObject);
+      else if (!store.Known(obj.string())) {
+         // Built before there were signatures. Trust the timestamps one last time.
+         if (LastWriteTime(obj) < dep.MaxTime()) AddOutOfDate(file.string(), signature, dep, Stats::Counter::CheckOlderObject);
+         else {
+            store.Record(obj.string(), signature);
+            AddUpToDate(file.string(), signature);
+         }
       }
+      else if (store.Changed(obj.string(), signature)) AddOutOfDate(file.string(), signature, dep, Stats::Counter::CheckSignatureChanged);
+      else AddUpToDate(file.string(), signature);
    }
 
 
@@ -0,0 +1,239 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "DependencyDatabase.h"
+#include "CppDepends.h"
+#include "JobSystem.h"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+
+
+DependencyDatabase::DependencyDatabase (const std::filesystem::path& objDir, uint64_t settings) : file_{objDir / "CppDepends.db"}, settings_{settings}
+{
+   try {
+      Load();
+   }
+   catch (std::exception& e) {
+      std::cerr << "Ignoring dependency database " << file_ << ": " << e.what() << std::endl;
+
+      mapping_.reset();
+      names_.clear();
+      ids_.clear();
+      unitIndex_.clear();
+   }
+}
+
+void DependencyDatabase::Load ()
+{
+   std::error_code ec;
+   const auto size = std::filesystem::file_size(file_, ec);
+   if (ec || size < sizeof(Head)) return;
+
+   mapping_ = std::make_unique<MemoryMappedFile>(file_);
+
+   const char* memory = mapping_->CBegin();
+
+   Head head;
+   std::memcpy(&head, memory, sizeof(head));
+   if (head.magic != magic_ || head.version != version_ || head.settings != settings_) return;
+
+   const uint64_t filesOffset = sizeof(Head);
+   const uint64_t unitsOffset = filesOffset + uint64_t{head.files} * sizeof(File);
+   const uint64_t edgesOffset = unitsOffset + uint64_t{head.units} * sizeof(Unit);
+   const uint64_t stringsOffset = edgesOffset + uint64_t{head.edges} * sizeof(uint32_t);
+   if (stringsOffset + head.stringSize != size) throw std::runtime_error("Unexpected size");
+
+   files_ = reinterpret_cast<const File*>(memory + filesOffset);
+   units_ = reinterpret_cast<const Unit*>(memory + unitsOffset);
+   edges_ = reinterpret_cast<const uint32_t*>(memory + edgesOffset);
+   const char* strings = memory + stringsOffset;
+
+   names_.reserve(head.files);
+   ids_.reserve(head.files);
+   for (uint32_t i = 0; i < head.files; ++i) {
+      if (uint64_t{files_[i].nameOffset} + files_[i].nameLength > head.stringSize) throw std::runtime_error("Invalid file entry");
+      names_.emplace_back(strings + files_[i].nameOffset, files_[i].nameLength);
+      ids_.push_back(PathTable::Intern(names_.back()));
+   }
+
+   unitIndex_.reserve(head.units);
+   for (uint32_t i = 0; i < head.units; ++i) {
+      const Unit& unit = units_[i];
+      if (unit.file >= head.files) throw std::runtime_error("Invalid unit entry");
+      if (uint64_t{unit.firstEdge} + unit.edgeCount > head.edges) throw std::runtime_error("Invalid unit entry");
+
+      for (uint32_t e = 0; e < unit.edgeCount; ++e) {
+         if (edges_[unit.firstEdge + e] >= head.files) throw std::runtime_error("Invalid edge");
+      }
+
+      unitIndex_[names_[unit.file]] = i;
+   }
+}
+
+void DependencyDatabase::Validate (uint32_t threads)
+{
+   const size_t count = names_.size();
+   if (!count) return;
+
+   std::vector<char> unchanged(count, 0);
+
+   static constexpr size_t chunk = 64;
+
+   JobGroup jobs{threads};
+   for (size_t first = 0; first < count; first += chunk) {
+      jobs.Add([&, first] () {
+         const size_t last = std::min(first + chunk, count);
+         for (size_t i = first; i < last; ++i) {
+            const uint64_t ts = CppDepends::LastWriteTime(std::string{names_[i]});
+            unchanged[i] = ts && ts == files_[i].time;
+         }
+      });
+   }
+
+   jobs.Wait();
+
+   unchanged_.swap(unchanged);
+}
+
+bool DependencyDatabase::Get (const std::string& unit, std::vector<PathTable::Id>& dependencies, uint64_t& maxTime)
+{
+   const auto it = unitIndex_.find(unit);
+   if (it == unitIndex_.end()) return false;
+
+   const Unit& entry = units_[it->second];
+
+   uint64_t time = 0;
+   for (uint32_t e = 0; e < entry.edgeCount; ++e) {
+      const uint32_t file = edges_[entry.firstEdge + e];
+
+      if (!unchanged_.empty()) {
+         if (!unchanged_[file]) return false;
+      }
+      else {
+         if (CppDepends::LastWriteTime(std::string{names_[file]}) != files_[file].time) return false;
+      }
+
+      if (files_[file].time > time) time = files_[file].time;
+   }
+
+   dependencies.reserve(entry.edgeCount);
+   for (uint32_t e = 0; e < entry.edgeCount; ++e) dependencies.push_back(ids_[edges_[entry.firstEdge + e]]);
+   maxTime = time;
+
+   return true;
+}
+
+void DependencyDatabase::Put (const std::string& unit, std::vector<std::pair<PathTable::Id, uint64_t>> dependencies)
+{
+   std::lock_guard lock(changedMutex_);
+   changed_[unit] = std::move(dependencies);
+}
+
+void DependencyDatabase::Save ()
+{
+   if (changed_.empty()) return;
+
+   std::vector<File> files;
+   std::vector<Unit> units;
+   std::vector<uint32_t> edges;
+   std::string strings;
+   std::unordered_map<PathTable::Id, uint32_t> fileIndex;
+
+   const auto intern = [&] (PathTable::Id id, uint64_t time) -> uint32_t {
+      auto it = fileIndex.find(id);
+      if (it != fileIndex.end()) return it->second;
+
+      const std::string_view name = PathTable::Name(id);
+      const auto index = static_cast<uint32_t>(files.size());
+      files.push_back(File{time, static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(name.size())});
+      strings.append(name);
+      fileIndex.emplace(id, index);
+      return index;
+   };
+
+   // The rescanned units first, thus their timestamps win over the ones of the old file table.
+   for (auto&& [name, dependencies] : changed_) {
+      const PathTable::Id id = PathTable::Intern(name);
+
+      uint64_t time = 0;
+      for (auto&& dep : dependencies) if (dep.first == id) time = dep.second;
+
+      Unit u{intern(id, time), static_cast<uint32_t>(edges.size()), static_cast<uint32_t>(dependencies.size()), 0};
+      for (auto&& dep : dependencies) edges.push_back(intern(dep.first, dep.second));
+
+      units.push_back(u);
+   }
+
+   // A file the rescanned units stored with another timestamp than the old file table. The units scanned against the old one
+   // would pass the next Validate() with the new one, and keep dependencies the file doesn't have anymore.
+   const auto changed = [&] (uint32_t file) {
+      auto it = fileIndex.find(ids_[file]);
+      return it != fileIndex.end() && files[it->second].time != files_[file].time;
+   };
+
+   // Units which weren't rescanned are kept as they are, unless a file of them changed. Their timestamps are validated on the next run.
+   for (auto&& [name, index] : unitIndex_) {
+      if (changed_.find(std::string{name}) != changed_.end()) continue;
+
+      const Unit& unit = units_[index];
+
+      bool outdated = changed(unit.file);
+      for (uint32_t e = 0; e < unit.edgeCount && !outdated; ++e) outdated = changed(edges_[unit.firstEdge + e]);
+      if (outdated) continue;   // Rescanned when it's needed
+      Unit u{intern(ids_[unit.file], files_[unit.file].time), static_cast<uint32_t>(edges.size()), unit.edgeCount, 0};
+
+      for (uint32_t e = 0; e < unit.edgeCount; ++e) {
+         const uint32_t file = edges_[unit.firstEdge + e];
+         edges.push_back(intern(ids_[file], files_[file].time));
+      }
+
+      units.push_back(u);
+   }
+
+   Head head{magic_, version_, static_cast<uint32_t>(files.size()), static_cast<uint32_t>(units.size()), static_cast<uint32_t>(edges.size()), 0, settings_, strings.size()};
+
+   // The old file is still mapped, and everything we need from it has been copied.
+   names_.clear();
+   ids_.clear();
+   unitIndex_.clear();
+   unchanged_.clear();
+   mapping_.reset();
+
+   std::filesystem::create_directories(file_.parent_path());
+
+   auto tmp = file_;
+   tmp += ".tmp";
+
+   {
+      std::ofstream stream(tmp.string(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+      if (!stream.good()) {
+         std::cerr << "Error on writing dependency database " << file_ << std::endl;
+         return;
+      }
+
+      stream.write(reinterpret_cast<const char*>(&head), sizeof(head));
+      stream.write(reinterpret_cast<const char*>(files.data()), files.size() * sizeof(File));
+      stream.write(reinterpret_cast<const char*>(units.data()), units.size() * sizeof(Unit));
+      stream.write(reinterpret_cast<const char*>(edges.data()), edges.size() * sizeof(uint32_t));
+      stream.write(strings.data(), strings.size());
+
+      if (!stream.good()) {
+         std::cerr << "Error on writing dependency database " << file_ << std::endl;
+         return;
+      }
+   }
+
+   std::filesystem::rename(tmp, file_);
+
+   changed_.clear();
+}
+
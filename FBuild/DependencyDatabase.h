@@ -0,0 +1,96 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include "MemoryMappedFile.h"
+#include "PathTable.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+
+
+// The dependencies of all translation units of one ObjDir, stored in a single file.
+// Every file is stored once in a file table (together with the timestamp it had when it was scanned).
+// The units only reference their dependencies by index into that table.
+//
+// The dependencies depend on the include paths and defines of the target (see CppDepends::Settings::Key).
+// If they changed, the stored ones are dropped.
+//
+// Layout (native byte order):
+//    Head
+//    File[files]
+//    Unit[units]
+//    uint32_t[edges]  (indices into the file table)
+//    char[stringSize] (the names of the files)
+class DependencyDatabase {
+public:
+   DependencyDatabase (const std::filesystem::path& objDir, uint64_t settings);
+
+   // Stats every file of the file table once, using at most the given number of threads (0 = all).
+   // Afterwards Get() compares against this table and doesn't touch the filesystem (or any lock) anymore.
+   void Validate (uint32_t threads);
+
+   // Returns false, if the unit is unknown or one of its dependencies changed since it was stored.
+   // The dependencies come back in the order they were put.
+   bool Get (const std::string& unit, std::vector<PathTable::Id>& dependencies, uint64_t& maxTime);
+   void Put (const std::string& unit, std::vector<std::pair<PathTable::Id, uint64_t>> dependencies);
+
+   void Save ();
+
+private:
+   struct Head {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t files;
+      uint32_t units;
+      uint32_t edges;
+      uint32_t reserved;
+      uint64_t settings;
+      uint64_t stringSize;
+   };
+
+   struct File {
+      uint64_t time;
+      uint32_t nameOffset;
+      uint32_t nameLength;
+   };
+
+   struct Unit {
+      uint32_t file;
+      uint32_t firstEdge;
+      uint32_t edgeCount;
+      uint32_t reserved;
+   };
+
+   static constexpr uint32_t magic_   = 0x42445046;  // "FPDB"
+   static constexpr uint32_t version_ = 2;
+
+   std::filesystem::path             file_;
+   uint64_t                          settings_;
+   std::unique_ptr<MemoryMappedFile> mapping_;
+
+   const File*                                 files_{nullptr};
+   const Unit*                                 units_{nullptr};
+   const uint32_t*                             edges_{nullptr};
+   std::vector<std::string_view>               names_;
+   std::vector<PathTable::Id>                  ids_;
+   std::unordered_map<std::string_view, size_t> unitIndex_;
+   std::vector<char>                           unchanged_;
+
+   std::mutex                                                               changedMutex_;
+   std::unordered_map<std::string, std::vector<std::pair<PathTable::Id, uint64_t>>> changed_;
+
+   void Load ();
+};
+
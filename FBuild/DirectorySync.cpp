@@ -1,4 +1,5 @@
 #include "DirectorySync.h"
+#include "Vfs.h"
 
 #include <iostream>
 #include <fstream>
@@ -41,16 +42,17 @@ void DirectorySync::Copy(const std::filesystem::path& sourceFile, const std::fil
 
    const auto sourceTime = std::filesystem::last_write_time(sourceFile);
    std::filesystem::last_write_time(destFile, sourceTime);
+   Vfs::Changed(destFile);
 
    std::cout << " OK\n";
 }
 
 bool DirectorySync::NeedsCopy(const std::filesystem::path& sourceFile, const std::filesystem::path& destFile)
 {
-   if (!std::filesystem::exists(destFile)) return true;
+   if (!Vfs::Exists(destFile)) return true;
 
-   const auto sourceTime = std::filesystem::last_write_time(sourceFile);
-   const auto destTime = std::filesystem::last_write_time(destFile);
+   const auto sourceTime = Vfs::LastWriteTime(sourceFile);
+   const auto destTime = Vfs::LastWriteTime(destFile);
 
    return destTime < sourceTime;
 }
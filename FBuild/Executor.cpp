@@ -0,0 +1,740 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Executor.h"
+#include "Console.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+
+extern char** environ;
+#endif
+
+
+
+void Execution::Then (std::function<void()> continuation)
+{
+   {
+      std::lock_guard lock(mutex_);
+      if (!done_) {
+         continuations_.push_back(std::move(continuation));
+         return;
+      }
+   }
+
+   continuation();
+}
+
+void Execution::Wait ()
+{
+   std::unique_lock lock(mutex_);
+   finished_.wait(lock, [this] () { return done_.load(); });
+}
+
+// The continuations run before it's done, thus a job's output is written by the time Wait() returns.
+// They might add others meanwhile, those run as well.
+void Execution::Finish ()
+{
+   std::unique_lock lock(mutex_);
+
+   while (!continuations_.empty()) {
+      auto continuations = std::move(continuations_);
+      continuations_.clear();
+      lock.unlock();
+
+      for (auto&& continuation : continuations) {
+         try {
+            continuation();
+         }
+         catch (std::exception& e) {
+            Console::Write(e.what());
+         }
+      }
+
+      lock.lock();
+   }
+
+   done_ = true;
+   lock.unlock();
+
+   finished_.notify_all();
+}
+
+
+
+struct Executor::Child {
+   uint64_t                              id{0};
+   std::shared_ptr<Execution>            execution;
+   int                                   exitCode{-1};
+   std::string                           output;
+   Process::Usage                        usage;
+   std::chrono::steady_clock::time_point start;
+   std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+   std::chrono::milliseconds             timeout{0};
+   std::chrono::steady_clock::time_point drain{std::chrono::steady_clock::time_point::max()};   // Exited, the output is waited for until then
+   bool                                  exited{false};
+   bool                                  outputDone{true};
+   bool                                  killed{false};   // Timed out
+
+#ifdef _WIN32
+   HANDLE                                port{nullptr};
+   HANDLE                                process{nullptr};
+   HANDLE                                pipe{nullptr};
+   HANDLE                                wait{nullptr};
+   HANDLE                                job{nullptr};   // With a timeout: the child and whatever it starts
+   bool                                  cancelled{false};   // The read, the output was waited for long enough
+   OVERLAPPED                            overlapped{};
+   char                                  buffer[4096];
+#else
+   pid_t                                 pid{0};
+   int                                   pipe{-1};
+   int                                   pidfd{-1};
+#endif
+};
+
+struct Executor::Loop {
+   std::mutex                                          mutex;
+   std::unordered_map<uint64_t, std::unique_ptr<Child>> children;
+   uint64_t                                            nextId{1};   // Zero wakes the loop up
+   std::atomic<bool>                                   stop{false};
+   std::thread                                         thread;
+
+#ifdef _WIN32
+   HANDLE                                              port{nullptr};
+#else
+   int                                                 epoll{-1};
+   int                                                 wake{-1};
+   bool                                                pidfds{true};   // Otherwise the children are polled
+#endif
+};
+
+
+
+Executor& Executor::Instance ()
+{
+   static Executor executor;
+   return executor;
+}
+
+size_t Executor::Running ()
+{
+   std::lock_guard lock(loop_->mutex);
+   return loop_->children.size();
+}
+
+// What the child started might keep the pipe open after it exited, its output is waited for that long only.
+static constexpr std::chrono::seconds drainTime{2};
+
+static void Exited (Executor::Child& child)
+{
+   child.exited = true;
+   if (!child.outputDone) child.drain = std::chrono::steady_clock::now() + drainTime;
+}
+
+static void TimedOut (Executor::Child& child)
+{
+   child.killed = true;
+   child.output += "Killed after " + std::to_string(child.timeout.count() / 1000) + " s\n";
+}
+
+// The time the loop may sleep: until the next deadline, or the end of a drain, at most a few ms if the children are polled.
+// The mutex must be locked.
+template<typename Children> static std::chrono::milliseconds Sleep (const Children& children, bool polling)
+{
+   using namespace std::chrono;
+
+   auto next = steady_clock::time_point::max();
+   for (auto&& [id, child] : children) {
+      if (child->exited) next = std::min(next, child->outputDone ? steady_clock::time_point::max() : child->drain);
+      else if (!child->killed) next = std::min(next, child->deadline);
+   }
+
+   milliseconds result = milliseconds::max();
+   if (next != steady_clock::time_point::max()) result = std::max(milliseconds{0}, duration_cast<milliseconds>(next - steady_clock::now()) + milliseconds{1});
+   if (polling && !children.empty()) result = std::min(result, milliseconds{5});
+
+   return result;
+}
+
+// The ones done are taken out. They're finished after unlocking the mutex, the continuations might start other programs.
+template<typename Children> static std::vector<std::unique_ptr<Executor::Child>> Completed (Children& children)
+{
+   std::vector<std::unique_ptr<Executor::Child>> result;
+
+   for (auto it = children.begin(); it != children.end(); ) {
+      if (!it->second->exited || !it->second->outputDone) {
+         ++it;
+         continue;
+      }
+
+      result.push_back(std::move(it->second));
+      it = children.erase(it);
+   }
+
+   return result;
+}
+
+void Executor::Finish (Child& child)
+{
+   const auto duration = std::chrono::steady_clock::now() - child.start;
+   child.usage.milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+   Stats::Add(Stats::Counter::ProcessTime, std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+
+   Execution& execution = *child.execution;
+   execution.exitCode_ = child.exitCode;
+   execution.timedOut_ = child.killed;
+   execution.output_ = std::move(child.output);
+   execution.usage_ = child.usage;
+   execution.Finish();
+}
+
+
+
+#ifdef _WIN32
+
+static void CALLBACK Exited (PVOID context, BOOLEAN)
+{
+   auto child = static_cast<Executor::Child*>(context);
+   ::PostQueuedCompletionStatus(child->port, 0, static_cast<ULONG_PTR>(child->id), nullptr);
+}
+
+// A timeout kills the child and what it started, thus it runs in a job object. Should FBuild die, the job is killed as well.
+static HANDLE CreateJob ()
+{
+   HANDLE job = ::CreateJobObjectA(nullptr, nullptr);
+   if (!job) return nullptr;
+
+   JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits{};
+   limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+   ::SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+
+   return job;
+}
+
+// Once the child exited, the processes it left behind (e.g. mspdbsrv, which other compiles share) go on.
+static void CloseJob (Executor::Child& child)
+{
+   if (!child.job) return;
+
+   if (!child.killed) {
+      JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits{};
+      ::SetInformationJobObject(child.job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+   }
+
+   ::CloseHandle(child.job);
+   child.job = nullptr;
+}
+
+// The completion arrives at the port, even if the read is done at once. The mutex must be locked.
+static void Read (Executor::Child& child)
+{
+   child.overlapped = OVERLAPPED{};
+   if (::ReadFile(child.pipe, child.buffer, sizeof(child.buffer), nullptr, &child.overlapped) || ::GetLastError() == ERROR_IO_PENDING) return;
+
+   ::CloseHandle(child.pipe);
+   child.pipe = nullptr;
+   child.outputDone = true;
+}
+
+Executor::Executor () : loop_{std::make_unique<Loop>()}
+{
+   loop_->port = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+   if (!loop_->port) throw std::runtime_error("Unable to create completion port (" + std::to_string(::GetLastError()) + ")");
+
+   loop_->thread = std::thread{[this] () { Run(); }};
+}
+
+Executor::~Executor ()
+{
+   loop_->stop = true;
+   ::PostQueuedCompletionStatus(loop_->port, 0, 0, nullptr);
+   loop_->thread.join();
+
+   ::CloseHandle(loop_->port);
+}
+
+std::shared_ptr<Execution> Executor::Start (const std::string& commandLine, const std::vector<std::string>& environment, bool capture, std::chrono::milliseconds timeout)
+{
+   Stats::Add(Stats::Counter::ProcessSpawns);
+
+   const auto args = Process::Split(commandLine);
+   if (args.empty()) throw std::runtime_error("Empty command line");
+
+   const auto current = environment.empty() ? Process::CurrentEnvironment() : std::vector<std::string>{};
+
+   std::string application = Process::FindExecutable(args.front(), environment.empty() ? current : environment);
+   std::string command = commandLine;
+
+   // Batch files (e.g. emcc.bat) need the command interpreter.
+   auto extension = std::filesystem::path{application}.extension().string();
+   for (char& ch : extension) ch = static_cast<char>(tolower(ch));
+   if (extension == ".bat" || extension == ".cmd") {
+      application = Process::FindExecutable("cmd.exe", environment.empty() ? current : environment);
+      command = "cmd.exe /d /s /c \"" + commandLine + "\"";
+   }
+
+   std::string block;
+   for (auto&& entry : environment) {
+      block += entry;
+      block += '\0';
+   }
+   block += '\0';
+
+   auto child = std::make_unique<Child>();
+   child->port = loop_->port;
+   child->execution = std::make_shared<Execution>();
+   child->timeout = timeout;
+
+   {
+      std::lock_guard lock(loop_->mutex);
+      child->id = loop_->nextId++;
+   }
+
+   HANDLE readPipe = nullptr;
+   HANDLE writePipe = nullptr;
+
+   STARTUPINFOEXA startupInfo{};
+   startupInfo.StartupInfo.cb = sizeof(startupInfo);
+   DWORD flags = 0;
+   std::vector<char> attributes;
+
+   if (capture) {
+      // Anonymous pipes can't be read asynchronously, thus it's a named one, unique per child.
+      const std::string name = "\\\\.\\pipe\\fbuild-" + std::to_string(::GetCurrentProcessId()) + "-" + std::to_string(child->id);
+
+      readPipe = ::CreateNamedPipeA(name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_WAIT, 1, 0, 65536, 0, nullptr);
+      if (readPipe == INVALID_HANDLE_VALUE) throw std::runtime_error("Unable to create pipe (" + std::to_string(::GetLastError()) + ")");
+
+      SECURITY_ATTRIBUTES security{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+      writePipe = ::CreateFileA(name.c_str(), GENERIC_WRITE, 0, &security, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (writePipe == INVALID_HANDLE_VALUE) {
+         const DWORD error = ::GetLastError();
+         ::CloseHandle(readPipe);
+         throw std::runtime_error("Unable to open pipe (" + std::to_string(error) + ")");
+      }
+
+      startupInfo.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+      startupInfo.StartupInfo.hStdInput = ::GetStdHandle(STD_INPUT_HANDLE);
+      startupInfo.StartupInfo.hStdOutput = writePipe;
+      startupInfo.StartupInfo.hStdError = writePipe;
+
+      // Other jobs start processes at the same time. Only our pipe may be inherited, otherwise it's not closed when our child exits.
+      SIZE_T size = 0;
+      ::InitializeProcThreadAttributeList(nullptr, 1, 0, &size);
+      attributes.resize(size);
+      startupInfo.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes.data());
+      ::InitializeProcThreadAttributeList(startupInfo.lpAttributeList, 1, 0, &size);
+      ::UpdateProcThreadAttribute(startupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &writePipe, sizeof(writePipe), nullptr, nullptr);
+      flags |= EXTENDED_STARTUPINFO_PRESENT;
+   }
+
+   // Suspended until it's in the job, otherwise what it starts right away might escape
+   if (timeout.count()) {
+      child->job = CreateJob();
+      if (child->job) flags |= CREATE_SUSPENDED;
+   }
+
+   PROCESS_INFORMATION processInfo{};
+
+   child->start = std::chrono::steady_clock::now();
+   const BOOL started = ::CreateProcessA(application.c_str(), command.data(), nullptr, nullptr, TRUE, flags, environment.empty() ? nullptr : block.data(), nullptr, &startupInfo.StartupInfo, &processInfo);
+   const DWORD error = ::GetLastError();
+
+   if (capture) {
+      ::DeleteProcThreadAttributeList(startupInfo.lpAttributeList);
+      ::CloseHandle(writePipe);
+   }
+
+   if (!started) {
+      if (readPipe) ::CloseHandle(readPipe);
+      if (child->job) ::CloseHandle(child->job);
+      throw std::runtime_error("Unable to start " + application + " (" + std::to_string(error) + ")");
+   }
+
+   if (child->job) {
+      if (!::AssignProcessToJobObject(child->job, processInfo.hProcess)) {   // Then only the child is killed
+         ::CloseHandle(child->job);
+         child->job = nullptr;
+      }
+      ::ResumeThread(processInfo.hThread);
+   }
+
+   ::CloseHandle(processInfo.hThread);
+
+   child->process = processInfo.hProcess;
+   if (timeout.count()) child->deadline = child->start + timeout;
+
+   auto execution = child->execution;
+   Child& registered = *child;
+
+   std::lock_guard lock(loop_->mutex);
+   loop_->children.emplace(registered.id, std::move(child));
+
+   if (readPipe) {
+      registered.pipe = readPipe;
+      registered.outputDone = false;
+      ::CreateIoCompletionPort(readPipe, loop_->port, static_cast<ULONG_PTR>(registered.id), 0);
+      Read(registered);
+   }
+
+   ::RegisterWaitForSingleObject(&registered.wait, registered.process, Exited, &registered, INFINITE, WT_EXECUTEONLYONCE);
+   if (timeout.count()) ::PostQueuedCompletionStatus(loop_->port, 0, 0, nullptr);   // For the new deadline
+
+   return execution;
+}
+
+void Executor::Run ()
+{
+   for (;;) {
+      DWORD wait;
+      {
+         std::lock_guard lock(loop_->mutex);
+         const auto sleep = Sleep(loop_->children, false);
+         wait = sleep == std::chrono::milliseconds::max() ? INFINITE : static_cast<DWORD>(std::min<int64_t>(sleep.count(), INFINITE - 1));
+      }
+
+      DWORD bytes = 0;
+      ULONG_PTR key = 0;
+      OVERLAPPED* overlapped = nullptr;
+      const BOOL ok = ::GetQueuedCompletionStatus(loop_->port, &bytes, &key, &overlapped, wait);
+      if (!ok && !overlapped) key = 0;   // Timeout
+
+      if (loop_->stop) return;
+
+      std::vector<std::unique_ptr<Child>> completed;
+      {
+         std::lock_guard lock(loop_->mutex);
+
+         auto it = key ? loop_->children.find(static_cast<uint64_t>(key)) : loop_->children.end();
+         if (it != loop_->children.end()) {
+            Child& child = *it->second;
+
+            if (overlapped) {   // Output read, or the pipe is closed
+               if (ok && !child.cancelled) {
+                  child.output.append(child.buffer, bytes);
+                  Read(child);
+               }
+               else {
+                  ::CloseHandle(child.pipe);
+                  child.pipe = nullptr;
+                  child.outputDone = true;
+               }
+            }
+            else {              // Exited
+               ::UnregisterWait(child.wait);
+
+               DWORD exitCode = 1;
+               ::GetExitCodeProcess(child.process, &exitCode);
+               child.exitCode = static_cast<int>(exitCode);
+
+               PROCESS_MEMORY_COUNTERS counters{};
+               if (::K32GetProcessMemoryInfo(child.process, &counters, sizeof(counters))) child.usage.peakMemory = counters.PeakWorkingSetSize;
+
+               ::CloseHandle(child.process);
+               child.process = nullptr;
+               Exited(child);
+               CloseJob(child);
+            }
+         }
+
+         const auto now = std::chrono::steady_clock::now();
+         for (auto&& [id, child] : loop_->children) {
+            if (child->exited) {
+               if (child->outputDone || child->cancelled || now < child->drain) continue;
+
+               ::CancelIoEx(child->pipe, &child->overlapped);   // Its completion closes the pipe
+               child->cancelled = true;
+               child->drain = std::chrono::steady_clock::time_point::max();
+               continue;
+            }
+
+            if (child->killed || now < child->deadline) continue;
+
+            if (child->job) ::TerminateJobObject(child->job, 1);
+            else ::TerminateProcess(child->process, 1);
+            TimedOut(*child);
+         }
+
+         completed = Completed(loop_->children);
+      }
+
+      for (auto&& child : completed) Finish(*child);
+   }
+}
+
+#else
+
+// The exit of a child can be waited for with epoll since Linux 5.3. Before, the children are polled.
+static int OpenPidFd (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+   return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+   (void)pid;
+   errno = ENOSYS;
+   return -1;
+#endif
+}
+
+static void Watch (int epoll, int fd, uint64_t key)
+{
+   epoll_event event{};
+   event.events = EPOLLIN;
+   event.data.u64 = key;
+   ::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void Unwatch (int epoll, int& fd)
+{
+   ::epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+   ::close(fd);
+   fd = -1;
+}
+
+// Everything there is, until the pipe would block. The mutex must be locked.
+static void Read (int epoll, Executor::Child& child)
+{
+   char buffer[4096];
+
+   for (;;) {
+      const auto count = ::read(child.pipe, buffer, sizeof(buffer));
+      if (count > 0) {
+         child.output.append(buffer, count);
+         continue;
+      }
+
+      if (count < 0 && errno == EINTR) continue;
+      if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+      Unwatch(epoll, child.pipe);
+      child.outputDone = true;
+      return;
+   }
+}
+
+// The mutex must be locked.
+static void Reap (int epoll, Executor::Child& child)
+{
+   int status = 0;
+   struct rusage resources{};
+
+   pid_t pid;
+   do pid = ::wait4(child.pid, &status, WNOHANG, &resources);
+   while (pid == -1 && errno == EINTR);
+
+   if (pid == 0) return;
+
+   if (pid == child.pid) {
+      child.usage.peakMemory = static_cast<uint64_t>(resources.ru_maxrss) * 1024;   // Kilobytes
+      child.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+   }
+
+   if (child.pidfd >= 0) Unwatch(epoll, child.pidfd);
+   Exited(child);
+}
+
+Executor::Executor () : loop_{std::make_unique<Loop>()}
+{
+   loop_->epoll = ::epoll_create1(EPOLL_CLOEXEC);
+   loop_->wake = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (loop_->epoll < 0 || loop_->wake < 0) throw std::runtime_error(std::string{"Unable to create the event loop: "} + std::strerror(errno));
+
+   Watch(loop_->epoll, loop_->wake, 0);
+
+   loop_->thread = std::thread{[this] () { Run(); }};
+}
+
+Executor::~Executor ()
+{
+   loop_->stop = true;
+   const uint64_t one = 1;
+   if (::write(loop_->wake, &one, sizeof(one)) < 0) { }
+   loop_->thread.join();
+
+   ::close(loop_->wake);
+   ::close(loop_->epoll);
+}
+
+std::shared_ptr<Execution> Executor::Start (const std::string& commandLine, const std::vector<std::string>& environment, bool capture, std::chrono::milliseconds timeout)
+{
+   Stats::Add(Stats::Counter::ProcessSpawns);
+
+   auto args = Process::Split(commandLine);
+   if (args.empty()) throw std::runtime_error("Empty command line");
+
+   const std::string application = Process::FindExecutable(args.front(), environment.empty() ? Process::CurrentEnvironment() : environment);
+
+   std::vector<char*> argv;
+   for (auto&& arg : args) argv.push_back(arg.data());
+   argv.push_back(nullptr);
+
+   std::vector<std::string> env = environment;
+   std::vector<char*> envp;
+   for (auto&& entry : env) envp.push_back(entry.data());
+   envp.push_back(nullptr);
+
+   // Close-on-exec, thus the children of other jobs don't inherit the pipe. dup2() clears it for stdout and stderr.
+   // Only our end is non-blocking, the child writes as usual.
+   int pipe[2] = {-1, -1};
+   posix_spawn_file_actions_t actions;
+   ::posix_spawn_file_actions_init(&actions);
+
+   if (capture) {
+      if (::pipe2(pipe, O_CLOEXEC) != 0) {
+         ::posix_spawn_file_actions_destroy(&actions);
+         throw std::runtime_error(std::string{"Unable to create pipe: "} + std::strerror(errno));
+      }
+
+      ::fcntl(pipe[0], F_SETFL, ::fcntl(pipe[0], F_GETFL) | O_NONBLOCK);
+      ::posix_spawn_file_actions_adddup2(&actions, pipe[1], 1);
+      ::posix_spawn_file_actions_adddup2(&actions, pipe[1], 2);
+   }
+
+   // A timeout kills the child and what it started, thus it leads a process group of its own. Otherwise it stays in
+   // FBuild's, where Ctrl+C reaches it.
+   posix_spawnattr_t attributes;
+   ::posix_spawnattr_init(&attributes);
+   if (timeout.count()) {
+      ::posix_spawnattr_setpgroup(&attributes, 0);
+      ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+   }
+
+   auto child = std::make_unique<Child>();
+   child->execution = std::make_shared<Execution>();
+   child->timeout = timeout;
+   child->start = std::chrono::steady_clock::now();
+   if (timeout.count()) child->deadline = child->start + timeout;
+
+   const int rc = ::posix_spawn(&child->pid, application.c_str(), &actions, &attributes, argv.data(), environment.empty() ? environ : envp.data());
+   ::posix_spawn_file_actions_destroy(&actions);
+   ::posix_spawnattr_destroy(&attributes);
+
+   if (capture) ::close(pipe[1]);
+
+   if (rc != 0) {
+      if (capture) ::close(pipe[0]);
+      throw std::runtime_error("Unable to start " + application + ": " + std::strerror(rc));
+   }
+
+   auto execution = child->execution;
+
+   std::lock_guard lock(loop_->mutex);
+
+   child->id = loop_->nextId++;
+
+   if (capture) {
+      child->pipe = pipe[0];
+      child->outputDone = false;
+      Watch(loop_->epoll, child->pipe, child->id * 2);
+   }
+
+   // A child which exited already is still there to be reaped, thus it can't be missed.
+   if (loop_->pidfds) {
+      child->pidfd = OpenPidFd(child->pid);
+      if (child->pidfd >= 0) {
+         ::fcntl(child->pidfd, F_SETFD, FD_CLOEXEC);
+         Watch(loop_->epoll, child->pidfd, child->id * 2 + 1);
+      }
+      else loop_->pidfds = false;
+   }
+
+   loop_->children.emplace(child->id, std::move(child));
+
+   // For the new deadline, or to start polling
+   if (timeout.count() || !loop_->pidfds) {
+      const uint64_t one = 1;
+      if (::write(loop_->wake, &one, sizeof(one)) < 0) { }
+   }
+
+   return execution;
+}
+
+void Executor::Run ()
+{
+   epoll_event events[64];
+
+   for (;;) {
+      int wait;
+      {
+         std::lock_guard lock(loop_->mutex);
+         const auto sleep = Sleep(loop_->children, !loop_->pidfds);
+         wait = sleep == std::chrono::milliseconds::max() ? -1 : static_cast<int>(std::min<int64_t>(sleep.count(), 1 << 30));
+      }
+
+      const int count = ::epoll_wait(loop_->epoll, events, 64, wait);
+
+      if (loop_->stop) return;
+
+      std::vector<std::unique_ptr<Child>> completed;
+      {
+         std::lock_guard lock(loop_->mutex);
+
+         for (int i = 0; i < count; ++i) {
+            const uint64_t key = events[i].data.u64;
+            if (key == 0) {
+               uint64_t value;
+               while (::read(loop_->wake, &value, sizeof(value)) > 0) { }
+               continue;
+            }
+
+            auto it = loop_->children.find(key / 2);
+            if (it == loop_->children.end()) continue;
+
+            if (key % 2 == 0) Read(loop_->epoll, *it->second);
+            else Reap(loop_->epoll, *it->second);
+         }
+
+         const auto now = std::chrono::steady_clock::now();
+         for (auto&& [id, child] : loop_->children) {
+            if (!child->exited && child->pidfd < 0) Reap(loop_->epoll, *child);
+
+            if (child->exited) {
+               if (child->outputDone || now < child->drain) continue;
+
+               Read(loop_->epoll, *child);   // What's left
+               if (child->outputDone) continue;
+
+               Unwatch(loop_->epoll, child->pipe);
+               child->outputDone = true;
+               continue;
+            }
+
+            if (child->killed || now < child->deadline) continue;
+
+            ::kill(-child->pid, SIGKILL);   // The group, only children with a timeout have a deadline
+            TimedOut(*child);
+         }
+
+         completed = Completed(loop_->children);
+      }
+
+      for (auto&& child : completed) Finish(*child);
+   }
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include "Process.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+
+// One started program. Done once it exited and its output is read completely.
+class Execution {
+public:
+   bool Done () const { return done_; }
+
+   // Valid once done
+   int ExitCode () const                { return exitCode_; }
+   bool TimedOut () const               { return timedOut_; }
+   const std::string& Output () const   { return output_; }
+   const Process::Usage& Usage () const { return usage_; }
+
+   // Runs on the thread of the event loop once the program is done (right away, if it is already).
+   // Thus it has to be short, anything more is submitted to the JobSystem. It must not wait for the execution.
+   void Then (std::function<void()> continuation);
+
+   // Blocks the thread until the program is done.
+   void Wait ();
+
+   // co_await: The coroutine goes on as a job, with the priority of the job starting the program.
+   bool await_ready () const { return Done(); }
+   int await_resume () const { return ExitCode(); }
+
+   template<typename Handle> void await_suspend (Handle handle)
+   {
+      Then([handle, priority = JobSystem::CurrentPriority()] () {
+         JobSystem::Instance().Submit([handle] () mutable { handle.resume(); }, priority);
+      });
+   }
+
+private:
+   friend class Executor;
+
+   std::atomic<bool>                  done_{false};
+   int                                exitCode_{-1};
+   bool                               timedOut_{false};
+   std::string                        output_;
+   Process::Usage                     usage_;
+   std::mutex                         mutex_;
+   std::condition_variable            finished_;
+   std::vector<std::function<void()>> continuations_;
+
+   void Finish ();
+};
+
+
+
+// Runs the programs of the build from a single thread with an event loop (epoll on Linux, an I/O completion port on Windows).
+// It reads their output, reaps them and kills the ones running too long. No thread waits for a running program,
+// thus there can be far more programs running than threads, e.g. when the compilers only pass the work on to other machines.
+class Executor {
+public:
+   static Executor& Instance ();
+
+   ~Executor ();
+
+   // Throws if the program can't be started. Without capture, the program writes to the console of FBuild.
+   // The program is killed once it runs longer than the timeout (zero: no limit).
+   std::shared_ptr<Execution> Start (const std::string& commandLine, const std::vector<std::string>& environment, bool capture,
+                                     std::chrono::milliseconds timeout = std::chrono::milliseconds{0});
+
+   size_t Running ();
+
+   // Defined by the platform's implementation
+   struct Child;
+   struct Loop;
+
+private:
+   std::unique_ptr<Loop> loop_;
+
+   Executor ();
+
+   void Run ();
+   static void Finish (Child& child);
+};
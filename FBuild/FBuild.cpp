@@ -6,20 +6,52 @@
  */
 
 #include "JavaScript.h"
+#include "BuildGraph.h"
+#include "SignatureStore.h"
+#include "Console.h"
+#include "Stats.h"
+#include "Governor.h"
+#include "Jobserver.h"
+#include "Process.h"
+#include "JobSystem.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
 
-#include <windows.h>
-
 int main (int argc, char** argv)
 {
    try {
+      // Options of FBuild itself start with "--", everything else is passed to the script.
       std::vector<std::string> args;
-      for (int i = 1; i < argc; ++i) args.emplace_back(argv[i]);
+      Governor& governor = Governor::Instance();
+      Governor::Priority priority = Governor::Priority::Low;
+      unsigned long linkJobs = 0;
+      bool jobserver = true;
+
+      for (int i = 1; i < argc; ++i) {
+         const std::string arg = argv[i];
+         if (arg.rfind("--joblog=", 0) == 0) Console::OpenJobLog(arg.substr(9));
+         else if (arg.rfind("--trace=", 0) == 0) Console::OpenTrace(arg.substr(8));
+         else if (arg == "--stats") Stats::Enable(true);
+         else if (arg.rfind("--jobs=", 0) == 0) governor.Jobs(static_cast<uint32_t>(std::stoul(arg.substr(7))));
+         else if (arg.rfind("--link-jobs=", 0) == 0) linkJobs = std::stoul(arg.substr(12));
+         else if (arg.rfind("--memory=", 0) == 0) governor.Memory(std::stoull(arg.substr(9)) << 20);   // MB
+         else if (arg == "--priority=normal") priority = Governor::Priority::Normal;
+         else if (arg == "--priority=low") priority = Governor::Priority::Low;
+         else if (arg == "--no-jobserver") jobserver = false;
+         else if (arg.rfind("--timeout=", 0) == 0) Process::JobTimeout(std::chrono::seconds{std::stoul(arg.substr(10))});
+         else args.emplace_back(arg);
+      }
+
+      if (linkJobs) governor.Slots(Governor::Class::Link, static_cast<uint32_t>(linkJobs));
+      governor.Apply(priority);
+      JobSystem::Threads(std::min(governor.Cpus(), governor.Slots(Governor::Class::Compile)));   // The tools run on the Executor
+      if (jobserver) Jobserver::Start(governor.Slots(Governor::Class::Compile));   // Before the toolchain environments are captured, they pass MAKEFLAGS on
 
-      ::SetPriorityClass(::GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
+      SignatureStore::Instance().Load("FBuild.signatures");  // Written back on exit
 
       JavaScript js(args);
 
@@ -32,12 +64,24 @@ int main (int argc, char** argv)
          "   else throw error;"
          "}";
 
-      js.ExecuteString(script, "Script");
+      {
+         Console::Span span{"script", "FBuild.js"};
+         Stats::Timer timer{Stats::Counter::ScriptTime};   // Including the targets built right away (not deferred)
+         js.ExecuteString(script, "Script");
+      }
+
+      {
+         Console::Span span{"script", "Deferred targets"};
+         BuildGraph::Instance().Execute();
+      }
+
+      if (Stats::Enabled()) Console::Write(Stats::Report());
 
       return 0;
    }
    catch (std::exception& e) {
       std::cerr << e.what() << std::endl;
+      if (Stats::Enabled()) Console::Write(Stats::Report());
       return 5;
    }
 }
\ No newline at end of file
@@ -6,18 +6,19 @@
  */
 
 #include "FileOutOfDate.h"
+#include "Vfs.h"
 
 #include <filesystem>
 
 
 bool FileOutOfDate::Go () const
 {
-   if (!std::filesystem::exists(parent)) return true;
+   if (!Vfs::Exists(parent)) return true;
 
-   const auto parentTime = std::filesystem::last_write_time(parent);
+   const auto parentTime = Vfs::LastWriteTime(parent);
 
    for (size_t i = 0; i < files.size(); ++i) {
-      if (std::filesystem::last_write_time(files[i]) > parentTime) return true;
+      if (Vfs::LastWriteTime(files[i]) > parentTime) return true;
    }
 
    return false;
@@ -7,6 +7,8 @@
 
 #include "FileToCpp.h"
 #include "MemoryMappedFile.h"
+#include "SignatureStore.h"
+#include "Vfs.h"
 
 #include <iostream>
 #include <fstream>
@@ -28,9 +30,15 @@ void FileToCpp::CheckParams ()
 
 bool FileToCpp::NeedsRebuild ()
 {
+   Signature sig;
+   sig.Add(nameForNamespace).Add(nameForArray).Add(nameForPtr).Add(intro).Add(outro).Add(additional);
+   sig.Add(varConst ? "const" : "").Add(terminatingNull ? "null" : "");
+   sig.AddFile(infile);
+   signature = sig.Value();
+
    if (!dependencyCheck) return true;
-   if (!std::filesystem::exists(outfile)) return true;
-   return std::filesystem::last_write_time(infile) > std::filesystem::last_write_time(outfile);
+   if (!Vfs::Exists(outfile)) return true;
+   return SignatureStore::Instance().Changed(outfile, signature);
 }
 
 void FileToCpp::Create ()
@@ -83,4 +91,10 @@ void FileToCpp::Create ()
 
    if (outro.size()) out << outro;
    out << "\n\n";
+
+   out.close();
+   if (out.fail()) throw std::runtime_error("Error writing " + outfile);
+
+   Vfs::Changed(outfile);
+   SignatureStore::Instance().Record(outfile, signature);
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 
 class FileToCpp {
    bool        dependencyCheck;
@@ -21,12 +22,13 @@ class FileToCpp {
    std::string additional;
    bool        varConst;
    bool        terminatingNull;
+   uint64_t    signature;
 
    void CheckParams ();
    bool NeedsRebuild ();
 
 public:
-   FileToCpp () : dependencyCheck(true), varConst(true), terminatingNull(false) { }
+   FileToCpp () : dependencyCheck(true), varConst(true), terminatingNull(false), signature(0) { }
 
    void DependencyCheck (bool v)    { dependencyCheck = v; }
    void Const (bool v)              { varConst = v; }
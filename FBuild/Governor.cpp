@@ -0,0 +1,302 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Governor.h"
+#include "Executor.h"
+#include "JobSystem.h"
+#include "TimingHistory.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+
+
+// Without a history, until the first process of the class is done.
+static constexpr uint64_t defaultCompileMemory = uint64_t{1} << 30;
+static constexpr uint64_t defaultLinkMemory    = uint64_t{2} << 30;
+
+static constexpr uint64_t unlimited = ~uint64_t{0};
+
+
+#ifndef _WIN32
+
+static std::string ReadLine (const std::filesystem::path& file)
+{
+   std::ifstream stream(file);
+   std::string line;
+   std::getline(stream, line);
+   return line;
+}
+
+// The file of the controller in the cgroup of this process. Containers usually mount their own cgroup as the root.
+static std::filesystem::path CgroupFile (const std::string& controller, const std::string& name)
+{
+   std::ifstream stream("/proc/self/cgroup");
+   std::string line;
+
+   while (std::getline(stream, line)) {
+      // v2: "0::/path", v1: "4:cpu,cpuacct:/path"
+      const auto first = line.find(':');
+      const auto second = line.find(':', first + 1);
+      if (first == std::string::npos || second == std::string::npos) continue;
+
+      const auto controllers = "," + line.substr(first + 1, second - first - 1) + ",";
+      const auto path = line.substr(second + 1);
+
+      std::filesystem::path root;
+      if (controllers == ",,") root = "/sys/fs/cgroup";
+      else if (controllers.find("," + controller + ",") != std::string::npos) root = std::filesystem::path{"/sys/fs/cgroup"} / controllers.substr(1, controllers.size() - 2);
+      else continue;
+
+      std::error_code ec;
+      if (std::filesystem::exists(root / path.substr(1) / name, ec)) return root / path.substr(1) / name;
+      if (std::filesystem::exists(root / name, ec)) return root / name;
+   }
+
+   return {};
+}
+
+static uint64_t Number (const std::string& text)
+{
+   if (text.empty() || text == "max" || text[0] == '-') return unlimited;
+   return std::strtoull(text.c_str(), nullptr, 10);
+}
+
+static uint32_t CgroupCpus ()
+{
+   uint64_t quota = unlimited;
+   uint64_t period = 0;
+
+   auto file = CgroupFile("", "cpu.max");   // v2: "quota period"
+   if (!file.empty()) {
+      std::istringstream stream(ReadLine(file));
+      std::string q;
+      stream >> q >> period;
+      quota = Number(q);
+   }
+   else {
+      file = CgroupFile("cpu", "cpu.cfs_quota_us");
+      if (!file.empty()) {
+         quota = Number(ReadLine(file));
+         period = Number(ReadLine(CgroupFile("cpu", "cpu.cfs_period_us")));
+      }
+   }
+
+   if (quota == unlimited || !period || period == unlimited) return 0;
+   return static_cast<uint32_t>(std::max<uint64_t>(1, (quota + period - 1) / period));
+}
+
+static uint64_t CgroupMemory ()
+{
+   auto file = CgroupFile("", "memory.max");
+   if (file.empty()) file = CgroupFile("memory", "memory.limit_in_bytes");   // v1 reports "unlimited" as a huge number
+   if (file.empty()) return unlimited;
+
+   return Number(ReadLine(file));
+}
+
+static uint64_t AvailableMemory ()
+{
+   std::ifstream stream("/proc/meminfo");
+   std::string name;
+   uint64_t value = 0;
+
+   while (stream >> name >> value) {
+      if (name == "MemAvailable:") return value * 1024;
+      stream.ignore(256, '\n');
+   }
+
+   return static_cast<uint64_t>(::sysconf(_SC_PHYS_PAGES)) * static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+#endif
+
+
+
+Governor& Governor::Instance ()
+{
+   static Governor governor;
+   return governor;
+}
+
+Governor::Governor () : largest_{defaultCompileMemory, defaultLinkMemory}
+{
+   uint32_t cpus = std::thread::hardware_concurrency();
+
+#ifdef _WIN32
+   MEMORYSTATUSEX status{};
+   status.dwLength = sizeof(status);
+   memory_ = ::GlobalMemoryStatusEx(&status) ? status.ullAvailPhys : unlimited;
+#else
+   cpu_set_t set;
+   if (::sched_getaffinity(0, sizeof(set), &set) == 0) cpus = static_cast<uint32_t>(CPU_COUNT(&set));
+
+   const uint32_t quota = CgroupCpus();
+   if (quota) cpus = std::min(cpus, quota);
+
+   memory_ = std::min(AvailableMemory(), CgroupMemory());   // Inside a container, MemAvailable is the host's
+#endif
+
+   cpus_ = cpus ? cpus : 2;
+   Jobs(cpus_);
+}
+
+void Governor::Jobs (uint32_t v)
+{
+   v = v ? v : 1;
+   slots_[Index(Class::Compile)] = v;
+   slots_[Index(Class::Link)] = std::max<uint32_t>(1, std::min(v, cpus_) / 4);
+}
+
+void Governor::Apply (Priority priority)
+{
+   if (priority == Priority::Normal) return;
+
+#ifdef _WIN32
+   ::SetPriorityClass(::GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
+#else
+   if (::nice(5) == -1) { }   // Like BELOW_NORMAL_PRIORITY_CLASS. Not being able to is no reason to fail.
+#endif
+}
+
+// Whatever the estimate, a process is started if nothing else runs. Otherwise a job bigger than the memory would wait forever.
+// The mutex must be locked.
+bool Governor::Fits (size_t i, uint64_t estimate) const
+{
+   if (running_[i] >= slots_[i]) return false;
+   return !reserved_ || reserved_ + estimate <= memory_;
+}
+
+void Governor::Acquire (Class c, uint64_t estimate, Granted granted)
+{
+   const size_t i = Index(c);
+
+   {
+      std::lock_guard lock(mutex_);
+      if (!estimate) estimate = largest_[i];
+
+      if (!Fits(i, estimate)) {
+         Stats::Add(Stats::Counter::GovernorWaits);
+         waiting_.push_back(Waiting{i, estimate, std::move(granted), std::chrono::steady_clock::now()});
+         return;
+      }
+
+      ++running_[i];
+      reserved_ += estimate;
+   }
+
+   granted(estimate);
+}
+
+// The ones waiting which fit now are started. A small one may pass a big one, which waits for more memory.
+void Governor::Release (Class c, uint64_t estimate, uint64_t used)
+{
+   const size_t i = Index(c);
+   std::vector<Waiting> admitted;
+
+   {
+      std::lock_guard lock(mutex_);
+      --running_[i];
+      reserved_ -= estimate;
+
+      // The defaults are guesses, the first real value replaces them
+      if (used && (!measured_[i] || used > largest_[i])) largest_[i] = used;
+      if (used) measured_[i] = true;
+
+      for (auto it = waiting_.begin(); it != waiting_.end(); ) {
+         if (!Fits(it->index, it->estimate)) {
+            ++it;
+            continue;
+         }
+
+         ++running_[it->index];
+         reserved_ += it->estimate;
+         admitted.push_back(std::move(*it));
+         it = waiting_.erase(it);
+      }
+   }
+
+   for (auto&& waiting : admitted) {
+      Stats::Add(Stats::Counter::GovernorWaitTime, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waiting.since).count());
+      waiting.granted(waiting.estimate);
+   }
+}
+
+void Governor::Admit (Class c, const std::string& output, const Process::Usage& usage, std::function<void(std::unique_ptr<Slot>)> start)
+{
+   Acquire(c, TimingHistory::Instance().PeakMemory(output), [c, &usage, start = std::move(start)] (uint64_t estimate) {
+      // After the local limits: no token is held while waiting for them
+      Jobserver::Acquire([c, estimate, &usage, start] (const Jobserver::Token& token) {
+         start(std::unique_ptr<Slot>{new Slot{c, estimate, usage, token}});
+      });
+   });
+}
+
+
+
+// The slot is given back as soon as the tool exited. Then a job of the waiting one's priority wakes it up.
+int Governor::RunJob (Class c, const std::string& output, const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment,
+                      Process::Usage* usage)
+{
+   struct Running {
+      Process::Usage        usage;
+      std::unique_ptr<Slot> slot;
+      int                   exitCode{-1};
+      std::exception_ptr    exception;
+      std::atomic<bool>     done{false};
+   };
+
+   auto running = std::make_shared<Running>();
+   const int64_t priority = JobSystem::CurrentPriority();
+
+   Admit(c, output, running->usage, [running, name, commandLine, environment, priority] (std::unique_ptr<Slot> slot) {
+      running->slot = std::move(slot);
+
+      try {
+         auto execution = Process::StartJob(name, commandLine, environment);
+         execution->Then([running, priority, done = execution.get()] () {
+            running->exitCode = done->ExitCode();
+            running->usage = done->Usage();
+            running->slot.reset();
+            JobSystem::Instance().Submit([running] () { running->done = true; }, priority);
+         });
+      }
+      catch (...) {
+         running->exception = std::current_exception();
+         running->slot.reset();
+         JobSystem::Instance().Submit([running] () { running->done = true; }, priority);
+      }
+   });
+
+   JobSystem::Instance().WaitFor([&running] () { return running->done.load(); });
+
+   if (running->exception) std::rethrow_exception(running->exception);
+   if (usage) *usage = running->usage;
+
+   return running->exitCode;
+}
+
+Governor::Slot::~Slot ()
+{
+   Jobserver::Release(token_);
+   Instance().Release(class_, estimate_, usage_.peakMemory);
+}
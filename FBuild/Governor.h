@@ -0,0 +1,109 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include "Process.h"
+#include "Jobserver.h"
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+
+
+
+// Decides how many tools (compilers, linkers) run at once, thus a build fits into the CPUs and the memory it may use.
+// The limits are the machine's, or the container's (cgroup v1 or v2) if they're lower.
+//
+// Every process is expected to need as much memory as it did in the last build (see TimingHistory) and is started
+// once that much is free. Compiles and links have separate slots, thus a few big links don't squeeze out the compiles.
+// Then it takes a token of the jobserver (see Jobserver), shared with make and whatever else runs in the same build.
+//
+// Admission doesn't take a thread: the processes waiting are queued, and started by the one giving a slot back.
+class Governor {
+public:
+   enum class Class { Compile, Link };
+   enum class Priority { Low, Normal };
+
+   static Governor& Instance ();
+
+   // Overrides of the detected limits (FBuild's command line). Before the first job.
+   // Jobs are the tools running at once. More than CPUs make sense if the compilers pass the work on to other machines.
+   void Jobs (uint32_t v);
+   void Memory (uint64_t bytes)           { memory_ = bytes; }
+   void Slots (Class c, uint32_t v)       { slots_[Index(c)] = v ? v : 1; }
+
+   uint32_t Cpus () const                 { return cpus_; }
+   uint64_t Memory () const               { return memory_; }
+   uint32_t Slots (Class c) const         { return slots_[Index(c)]; }
+
+   // The scheduling priority of FBuild and thus of the tools it starts. Low by default, the machine stays usable meanwhile.
+   void Apply (Priority priority);
+
+   // Held while a tool runs.
+   // The usage is the one of the tool: its peak memory is the estimate for the outputs built the first time.
+   class Slot {
+   public:
+      ~Slot ();
+
+      Slot (const Slot&) = delete;
+      Slot& operator= (const Slot&) = delete;
+
+   private:
+      friend class Governor;
+
+      Class                 class_;
+      uint64_t              estimate_{0};
+      const Process::Usage& usage_;
+      Jobserver::Token      token_;
+
+      Slot (Class c, uint64_t estimate, const Process::Usage& usage, const Jobserver::Token& token)
+         : class_{c}, estimate_{estimate}, usage_{usage}, token_{token} { }
+   };
+
+   // Calls start once the tool fits: right away, or on the thread which gives a slot or a token back (e.g. the Executor's).
+   // Thus start has to be short, like starting the tool. No thread waits meanwhile, and a token is held by running tools only.
+   void Admit (Class c, const std::string& output, const Process::Usage& usage, std::function<void(std::unique_ptr<Slot>)> start);
+
+   // Process::RunJob once the tool fits, for the jobs which wait for their tool. It's started by the one admitting it, and the
+   // thread waiting executes other jobs meanwhile (see JobSystem::WaitFor). Thus the tools admitted never wait for a worker.
+   int RunJob (Class c, const std::string& output, const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment,
+               Process::Usage* usage = nullptr);
+
+private:
+   typedef std::function<void(uint64_t estimate)> Granted;
+
+   struct Waiting {
+      size_t                                index;
+      uint64_t                              estimate;
+      Granted                               granted;
+      std::chrono::steady_clock::time_point since;
+   };
+
+   uint32_t            cpus_;
+   uint64_t            memory_;
+   uint32_t            slots_[2];
+   uint32_t            running_[2]{0, 0};
+   uint64_t            largest_[2];     // Peak memory of one process, for the ones without a history
+   bool                measured_[2]{false, false};
+   uint64_t            reserved_{0};
+   std::mutex          mutex_;
+   std::deque<Waiting> waiting_;        // In the order they came
+
+   Governor ();
+
+   static size_t Index (Class c) { return c == Class::Compile ? 0 : 1; }
+
+   bool Fits (size_t i, uint64_t estimate) const;
+   void Acquire (Class c, uint64_t estimate, Granted granted);
+   void Release (Class c, uint64_t estimate, uint64_t used);
+};
@@ -0,0 +1,114 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Hash.h"
+
+#include <cstring>
+
+
+
+static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft (uint64_t value, int bits)
+{
+   return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t Read64 (const unsigned char* p)
+{
+   uint64_t value;
+   std::memcpy(&value, p, sizeof(value));
+   return value;
+}
+
+static inline uint32_t Read32 (const unsigned char* p)
+{
+   uint32_t value;
+   std::memcpy(&value, p, sizeof(value));
+   return value;
+}
+
+static inline uint64_t Round (uint64_t acc, uint64_t input)
+{
+   acc += input * prime2;
+   acc = RotateLeft(acc, 31);
+   return acc * prime1;
+}
+
+static inline uint64_t MergeRound (uint64_t acc, uint64_t value)
+{
+   acc ^= Round(0, value);
+   return acc * prime1 + prime4;
+}
+
+
+
+uint64_t Hash64 (const void* data, size_t size, uint64_t seed)
+{
+   const unsigned char* p = static_cast<const unsigned char*>(data);
+   const unsigned char* const end = p + size;
+
+   uint64_t h;
+
+   if (size >= 32) {
+      // Four independent lanes. The CPU runs them in parallel.
+      uint64_t v1 = seed + prime1 + prime2;
+      uint64_t v2 = seed + prime2;
+      uint64_t v3 = seed;
+      uint64_t v4 = seed - prime1;
+
+      const unsigned char* const limit = end - 32;
+      do {
+         v1 = Round(v1, Read64(p));
+         v2 = Round(v2, Read64(p + 8));
+         v3 = Round(v3, Read64(p + 16));
+         v4 = Round(v4, Read64(p + 24));
+         p += 32;
+      } while (p <= limit);
+
+      h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+      h = MergeRound(h, v1);
+      h = MergeRound(h, v2);
+      h = MergeRound(h, v3);
+      h = MergeRound(h, v4);
+   }
+   else {
+      h = seed + prime5;
+   }
+
+   h += static_cast<uint64_t>(size);
+
+   while (p + 8 <= end) {
+      h ^= Round(0, Read64(p));
+      h = RotateLeft(h, 27) * prime1 + prime4;
+      p += 8;
+   }
+
+   if (p + 4 <= end) {
+      h ^= static_cast<uint64_t>(Read32(p)) * prime1;
+      h = RotateLeft(h, 23) * prime2 + prime3;
+      p += 4;
+   }
+
+   while (p < end) {
+      h ^= (*p) * prime5;
+      h = RotateLeft(h, 11) * prime1;
+      ++p;
+   }
+
+   h ^= h >> 33;
+   h *= prime2;
+   h ^= h >> 29;
+   h *= prime3;
+   h ^= h >> 32;
+
+   return h;
+}
@@ -0,0 +1,19 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+
+// XXH64. Not cryptographic, but fast and good enough to tell whether a file changed.
+uint64_t Hash64 (const void* data, size_t size, uint64_t seed = 0);
+
+inline uint64_t Hash64 (std::string_view text, uint64_t seed = 0) { return Hash64(text.data(), text.size(), seed); }
+
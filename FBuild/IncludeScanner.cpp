@@ -0,0 +1,983 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "IncludeScanner.h"
+#include "Bits.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <initializer_list>
+#include <string_view>
+#include <unordered_set>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FB_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(FB_X86) && !defined(_MSC_VER)
+#define FB_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FB_TARGET(isa)
+#endif
+
+
+
+namespace
+{
+   using Includes = std::vector<std::pair<char, std::string>>;
+
+   // A directive: only blanks between the start of the line and the '#'.
+   inline bool AtLineStart (const char* begin, const char* hash)
+   {
+      for (const char* it = hash; it != begin; ) {
+         const char ch = *--it;
+         if (ch == '\n') return true;
+         if (ch != ' ' && ch != '\t') return false;
+      }
+
+      return true;
+   }
+
+   inline const char* SkipBlanks (const char* it, const char* end)
+   {
+      while (it != end && (*it == ' ' || *it == '\t')) ++it;
+      return it;
+   }
+
+   // The name of an include. it points behind "include". Returns where the search for the next directive continues.
+   inline const char* Include (const char* it, const char* end, Includes& includes)
+   {
+      it = SkipBlanks(it, end);
+      if (it == end) return end;
+
+      const char open = *it;
+      const char close = open == '"' ? '"' : open == '<' ? '>' : 0;
+      if (!close) return it;
+
+      const char* name = ++it;
+      while (it != end && *it != close && *it != '\n') ++it;
+      if (it == end) return end;
+
+      if (*it == close && it != name) includes.emplace_back(open, std::string(name, it));
+
+      return it;
+   }
+
+   // The directive starting at the '#'.
+   inline const char* Directive (const char* hash, const char* end, Includes& includes)
+   {
+      static constexpr char include[] = "include";
+      static constexpr size_t includeLength = sizeof(include) - 1;
+
+      const char* it = SkipBlanks(hash + 1, end);
+
+      if (static_cast<size_t>(end - it) < includeLength || std::memcmp(it, include, includeLength) != 0) return it;
+      return Include(it + includeLength, end, includes);
+   }
+
+   // The candidates of one block of 64 bytes, one bit per '#'. Returns where the search continues.
+   inline const char* Candidates (const char* begin, const char* block, uint64_t mask, const char* end, Includes& includes)
+   {
+      const char* next = block;
+
+      for (; mask; mask &= mask - 1) {
+         const char* hash = block + CountTrailingZeros(mask);
+         if (hash < next || !AtLineStart(begin, hash)) continue;
+
+         next = Directive(hash, end, includes);
+      }
+
+      return std::max(next, block + 64);
+   }
+
+   void ScanScalar (const char* begin, const char* it, const char* end, Includes& includes)
+   {
+      while (it != end) {
+         const char* hash = static_cast<const char*>(std::memchr(it, '#', end - it));
+         if (!hash) return;
+
+         it = AtLineStart(begin, hash) ? Directive(hash, end, includes) : hash + 1;
+      }
+   }
+
+#ifdef FB_X86
+   // 64 bytes per round. Most rounds have no '#' at all, they cost four compares and a test.
+   FB_TARGET("sse2") void ScanSse2 (const char* begin, const char* it, const char* end, Includes& includes)
+   {
+      const __m128i hash = _mm_set1_epi8('#');
+
+      while (end - it >= 64) {
+         const __m128i* block = reinterpret_cast<const __m128i*>(it);
+         const __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128(block + 0), hash);
+         const __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128(block + 1), hash);
+         const __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128(block + 2), hash);
+         const __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128(block + 3), hash);
+
+         if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3)))) {
+            it += 64;
+            continue;
+         }
+
+         const uint64_t mask = static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m0)))
+                             | static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m1))) << 16
+                             | static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m2))) << 32
+                             | static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m3))) << 48;
+
+         it = Candidates(begin, it, mask, end, includes);
+      }
+
+      ScanScalar(begin, it, end, includes);
+   }
+
+   FB_TARGET("avx2") void ScanAvx2 (const char* begin, const char* it, const char* end, Includes& includes)
+   {
+      const __m256i hash = _mm256_set1_epi8('#');
+
+      while (end - it >= 64) {
+         const __m256i* block = reinterpret_cast<const __m256i*>(it);
+         const __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(block + 0), hash);
+         const __m256i m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), hash);
+         const __m256i any = _mm256_or_si256(m0, m1);
+
+         if (_mm256_testz_si256(any, any)) {
+            it += 64;
+            continue;
+         }
+
+         const uint64_t mask = static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m0)))
+                             | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m1))) << 32;
+
+         it = Candidates(begin, it, mask, end, includes);
+      }
+
+      ScanScalar(begin, it, end, includes);
+   }
+
+   bool CpuHasAvx2 ()
+   {
+#ifdef _MSC_VER
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7) return false;
+
+      __cpuid(info, 1);
+      const bool osxsave = (info[2] & (1 << 27)) != 0;
+      const bool avx = (info[2] & (1 << 28)) != 0;
+      if (!osxsave || !avx) return false;
+      if ((_xgetbv(0) & 6) != 6) return false;   // The OS saves the ymm registers
+
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#else
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+   }
+#endif
+
+   using ScanFunction = void (*) (const char* begin, const char* it, const char* end, Includes& includes);
+
+   ScanFunction Function (IncludeScanner::Isa isa)
+   {
+      switch (isa) {
+#ifdef FB_X86
+      case IncludeScanner::Isa::Avx2: return ScanAvx2;
+      case IncludeScanner::Isa::Sse2: return ScanSse2;
+#endif
+      default:                        return ScanScalar;
+      }
+   }
+
+   Includes Scan (const char* begin, const char* end, ScanFunction scan)
+   {
+      Includes includes;
+      if (begin && begin != end) scan(begin, begin, end, includes);
+      return includes;
+   }
+}
+
+
+
+// The precise scan: Comments and literals are skipped, and so are the regions of conditions which are known to be false.
+// Conditions are three-valued. A macro which isn't one of the target's is unknown, as a header might define it.
+// So is a macro of the target which a file (un)defines, this one or, as far as the caller knows, any other.
+// Both branches of an unknown condition are scanned, thus the dependencies are never less than the actual ones.
+namespace
+{
+   enum class Tri { False, True, Unknown };
+
+   Tri Not (Tri v)        { return v == Tri::Unknown ? v : v == Tri::True ? Tri::False : Tri::True; }
+   Tri And (Tri a, Tri b) { return a == Tri::False || b == Tri::False ? Tri::False : a == Tri::True && b == Tri::True ? Tri::True : Tri::Unknown; }
+   Tri Or (Tri a, Tri b)  { return a == Tri::True || b == Tri::True ? Tri::True : a == Tri::False && b == Tri::False ? Tri::False : Tri::Unknown; }
+
+   // Without the locale, these are called for every character of a directive.
+   inline bool IdentifierChar (char ch) { return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_'; }
+   inline bool Space (char ch)          { return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\f' || ch == '\v'; }
+
+
+   // #if expressions: integers, macros, defined, and the operators of C. Whatever isn't understood is unknown.
+   class Condition {
+   public:
+      Condition (std::string_view text, const IncludeScanner::Macros& macros, const std::unordered_set<std::string>& redefined, IncludeScanner::MacroUse* use)
+         : it_{text.data()}, end_{text.data() + text.size()}, macros_{macros}, redefined_{redefined}, use_{use} { }
+
+      Tri Evaluate ()
+      {
+         const Value v = Ternary();
+         Blanks();
+         if (failed_ || it_ != end_ || !v.known) return Tri::Unknown;
+         return v.value ? Tri::True : Tri::False;
+      }
+
+   private:
+      struct Value {
+         bool    known;
+         int64_t value;
+      };
+
+      const char*                     it_;
+      const char*                     end_;
+      const IncludeScanner::Macros&   macros_;
+      const std::unordered_set<std::string>& redefined_;
+      IncludeScanner::MacroUse*       use_;
+      bool                            failed_{false};
+
+      static Value Unknown ()          { return Value{false, 0}; }
+      static Value Known (int64_t v)   { return Value{true, v}; }
+
+      void Blanks () { while (it_ != end_ && Space(*it_)) ++it_; }
+
+      bool Take (char op)
+      {
+         Blanks();
+         if (it_ == end_ || *it_ != op) return false;
+         if (op == '!' && it_ + 1 != end_ && it_[1] == '=') return false;   // Not the first half of "!="
+
+         ++it_;
+         return true;
+      }
+
+   public:
+      // A macro, if the target defines it and no file (re)defines it.
+      static const std::string* Macro (std::string_view name, const IncludeScanner::Macros& macros, const std::unordered_set<std::string>& redefined, IncludeScanner::MacroUse* use)
+      {
+         if (macros.empty()) return nullptr;
+
+         const std::string key{name};
+         if (redefined.count(key)) return nullptr;
+
+         auto found = macros.find(key);
+         if (found == macros.end()) return nullptr;
+
+         if (use) use->assumed.push_back(key);
+         return &found->second;
+      }
+
+   private:
+      const std::string* Macro (std::string_view name) const { return Macro(name, macros_, redefined_, use_); }
+
+      std::string_view Identifier ()
+      {
+         Blanks();
+         const char* start = it_;
+         while (it_ != end_ && IdentifierChar(*it_)) ++it_;
+         return std::string_view(start, it_ - start);
+      }
+
+      // Decimal, octal, hexadecimal or binary, with suffixes like U or L. Mostly a version, like 201103L.
+      static Value Number (std::string_view text)
+      {
+         if (text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) return Unknown();
+
+         size_t i = 0;
+         int base = 10;
+         if (text.size() > 1 && text[0] == '0') {
+            const char prefix = text[1] | 0x20;
+            base = prefix == 'x' ? 16 : prefix == 'b' ? 2 : 8;
+            i = base == 8 ? 1 : 2;
+         }
+
+         uint64_t v = 0;
+         for (; i != text.size(); ++i) {
+            const char ch = text[i];
+            const int digit = ch >= '0' && ch <= '9' ? ch - '0' : (ch | 0x20) >= 'a' && (ch | 0x20) <= 'f' ? (ch | 0x20) - 'a' + 10 : base;
+            if (digit >= base) break;
+            v = v * base + digit;
+         }
+
+         for (; i != text.size(); ++i) {
+            const char ch = text[i] | 0x20;
+            if (ch != 'u' && ch != 'l') return Unknown();
+         }
+
+         return Known(static_cast<int64_t>(v));
+      }
+
+      Value Primary ()
+      {
+         Blanks();
+         if (it_ == end_) {
+            failed_ = true;
+            return Unknown();
+         }
+
+         if (Take('(')) {
+            const Value v = Ternary();
+            if (!Take(')')) failed_ = true;
+            return v;
+         }
+
+         if (isdigit(static_cast<unsigned char>(*it_))) return Number(Identifier());
+
+         const std::string_view name = Identifier();
+         if (name.empty()) {
+            failed_ = true;
+            return Unknown();
+         }
+
+         if (name == "defined") {
+            const bool parenthesized = Take('(');
+            const std::string_view macro = Identifier();
+            if (macro.empty() || (parenthesized && !Take(')'))) failed_ = true;
+
+            return Macro(macro) ? Known(1) : Unknown();
+         }
+
+         if (name == "true") return Known(1);
+         if (name == "false") return Known(0);
+
+         Blanks();
+         if (it_ != end_ && *it_ == '(') {   // Function-like macro or __has_include
+            failed_ = true;
+            return Unknown();
+         }
+
+         const std::string* value = Macro(name);
+         if (!value) return Unknown();
+
+         return Number(*value);
+      }
+
+      Value Unary ()
+      {
+         if (Take('!')) { const Value v = Unary(); return v.known ? Known(!v.value) : v; }
+         if (Take('-')) { const Value v = Unary(); return v.known ? Known(-v.value) : v; }
+         if (Take('+')) return Unary();
+         if (Take('~')) { const Value v = Unary(); return v.known ? Known(~v.value) : v; }
+
+         return Primary();
+      }
+
+      // A binary operator of C, by precedence: || is 1, * 10. None is 0.
+      struct Operator {
+         char first;
+         char second;
+         int  precedence;
+      };
+
+      // "<" isn't the first half of "<<" or "<=", "&" not the one of "&&".
+      Operator Peek ()
+      {
+         Blanks();
+         if (it_ == end_) return Operator{0, 0, 0};
+
+         const char ch = *it_;
+         const char next = it_ + 1 != end_ ? it_[1] : 0;
+
+         switch (ch) {
+         case '|': return next == '|' ? Operator{ch, next, 1} : Operator{ch, 0, 3};
+         case '&': return next == '&' ? Operator{ch, next, 2} : Operator{ch, 0, 5};
+         case '^': return Operator{ch, 0, 4};
+         case '=':
+         case '!': return next == '=' ? Operator{ch, next, 6} : Operator{0, 0, 0};
+         case '<':
+         case '>': return next == ch ? Operator{ch, next, 8} : next == '=' ? Operator{ch, next, 7} : Operator{ch, 0, 7};
+         case '+':
+         case '-': return Operator{ch, 0, 9};
+         case '*':
+         case '/':
+         case '%': return Operator{ch, 0, 10};
+         default:  return Operator{0, 0, 0};
+         }
+      }
+
+      static Value Apply (const Operator& op, Value a, Value b)
+      {
+         // A false operand decides &&, a true one ||. Even if the other one is unknown.
+         if (op.precedence == 1) {
+            if ((a.known && a.value) || (b.known && b.value)) return Known(1);
+            return a.known && b.known ? Known(0) : Unknown();
+         }
+         if (op.precedence == 2) {
+            if ((a.known && !a.value) || (b.known && !b.value)) return Known(0);
+            return a.known && b.known ? Known(1) : Unknown();
+         }
+
+         if (!a.known || !b.known) return Unknown();
+         const int64_t x = a.value;
+         const int64_t y = b.value;
+
+         switch (op.first) {
+         case '|': return Known(x | y);
+         case '&': return Known(x & y);
+         case '^': return Known(x ^ y);
+         case '=': return Known(x == y);
+         case '!': return Known(x != y);
+         case '<':
+            if (op.second == '<') return y < 0 || y > 62 ? Unknown() : Known(x << y);
+            return Known(op.second == '=' ? x <= y : x < y);
+         case '>':
+            if (op.second == '>') return y < 0 || y > 62 ? Unknown() : Known(x >> y);
+            return Known(op.second == '=' ? x >= y : x > y);
+         case '+': return Known(x + y);
+         case '-': return Known(x - y);
+         case '*': return Known(x * y);
+         default:
+            if (y == 0) return Unknown();
+            return op.first == '/' ? Known(x / y) : Known(x % y);
+         }
+      }
+
+      // Precedence climbing: the operators of at least the given precedence, left to right.
+      Value Binary (int precedence)
+      {
+         Value left = Unary();
+
+         for (;;) {
+            const Operator op = Peek();
+            if (op.precedence < precedence) return left;
+
+            it_ += op.second ? 2 : 1;
+            left = Apply(op, left, Binary(op.precedence + 1));
+         }
+      }
+
+      Value Ternary ()
+      {
+         const Value condition = Binary(1);
+         if (!Take('?')) return condition;
+
+         const Value yes = Ternary();
+         if (!Take(':')) failed_ = true;
+         const Value no = Ternary();
+
+         if (!condition.known) return yes.known && no.known && yes.value == no.value ? yes : Unknown();
+         return condition.value ? yes : no;
+      }
+   };
+
+
+   // The candidates of the precise scan, one bit per byte of a block of 64 bytes: '#', '"', '\'' and the '/' of "/*",
+   // which might start a directive, a literal or a comment. Line comments aren't among them, they're found from the
+   // candidates on their line (see LineComment).
+
+   // The high bit of every byte of x which is zero. Eight bytes at a time, without a carry from one to the next.
+   inline uint64_t Zero (uint64_t x)
+   {
+      return ~(((x & 0x7f7f7f7f7f7f7f7full) + 0x7f7f7f7f7f7f7f7full) | x) & 0x8080808080808080ull;
+   }
+
+   inline uint64_t Repeat (unsigned char ch) { return 0x0101010101010101ull * ch; }
+
+   // The high bits of the eight bytes, as the low eight bits.
+   inline uint64_t Gather (uint64_t highBits)
+   {
+      return ((highBits >> 7) * 0x0102040810204080ull) >> 56;
+   }
+
+   // The mask of the first block at or behind block with a candidate. block is moved there.
+   // 65 bytes are read per block: the one behind it tells whether a '/' at its end starts a comment. Thus only blocks
+   // with more than 64 bytes up to end are searched. If none of them has one, block is the first of the others.
+   uint64_t MaskScalar (const char*& block, const char* end)
+   {
+      for (; end - block > 64; block += 64) {
+         uint64_t bytes[8];
+         uint64_t any = 0;
+
+         // Without branches, a test per word costs more than it saves.
+         for (int i = 0; i < 8; ++i) {
+            uint64_t word;
+            uint64_t next;
+            std::memcpy(&word, block + i * 8, 8);
+            std::memcpy(&next, block + i * 8 + 1, 8);
+
+            // '"' and '#' differ in the lowest bit only.
+            bytes[i] = Zero((word | Repeat(1)) ^ Repeat('#')) | Zero(word ^ Repeat('\'')) | Zero((word ^ Repeat('/')) | (next ^ Repeat('*')));
+            any |= bytes[i];
+         }
+
+         if (!any) continue;
+
+         uint64_t mask = 0;
+         for (int i = 0; i < 8; ++i) mask |= Gather(bytes[i]) << (i * 8);
+         return mask;
+      }
+
+      return 0;
+   }
+
+#ifdef FB_X86
+   FB_TARGET("sse2") uint64_t MaskSse2 (const char*& block, const char* end)
+   {
+      const __m128i slash = _mm_set1_epi8('/');
+      const __m128i star = _mm_set1_epi8('*');
+      const __m128i hash = _mm_set1_epi8('#');
+      const __m128i one = _mm_set1_epi8(1);
+      const __m128i apostrophe = _mm_set1_epi8('\'');
+
+      for (; end - block > 64; block += 64) {
+         __m128i found[4];
+
+         for (int i = 0; i < 4; ++i) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16 + 1));
+
+            const __m128i comment = _mm_and_si128(_mm_cmpeq_epi8(bytes, slash), _mm_cmpeq_epi8(next, star));
+            const __m128i quoteOrHash = _mm_cmpeq_epi8(_mm_or_si128(bytes, one), hash);   // They differ in the lowest bit only
+            found[i] = _mm_or_si128(_mm_or_si128(quoteOrHash, comment), _mm_cmpeq_epi8(bytes, apostrophe));
+         }
+
+         const __m128i any = _mm_or_si128(_mm_or_si128(found[0], found[1]), _mm_or_si128(found[2], found[3]));
+         if (!_mm_movemask_epi8(any)) continue;
+
+         uint64_t mask = 0;
+         for (int i = 0; i < 4; ++i) mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(found[i]))) << (i * 16);
+         return mask;
+      }
+
+      return 0;
+   }
+
+   // The candidates of 32 bytes. '"', '#' and '\'' are looked up by their low nibble, if the high one is 2.
+   FB_TARGET("avx2") inline __m256i CandidatesAvx2 (const char* at)
+   {
+      const __m256i table = _mm256_setr_epi8(-1, -1, 0x20, 0x20, -1, -1, -1, 0x20, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             -1, -1, 0x20, 0x20, -1, -1, -1, 0x20, -1, -1, -1, -1, -1, -1, -1, -1);
+
+      const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+      const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at + 1));
+
+      const __m256i quoteOrHash = _mm256_cmpeq_epi8(_mm256_shuffle_epi8(table, bytes), _mm256_and_si256(bytes, _mm256_set1_epi8(static_cast<char>(0xf0))));
+      const __m256i comment = _mm256_and_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/')), _mm256_cmpeq_epi8(next, _mm256_set1_epi8('*')));
+      return _mm256_or_si256(quoteOrHash, comment);
+   }
+
+   FB_TARGET("avx2") uint64_t MaskAvx2 (const char*& block, const char* end)
+   {
+      for (; end - block > 64; block += 64) {
+         const __m256i m0 = CandidatesAvx2(block);
+         const __m256i m1 = CandidatesAvx2(block + 32);
+
+         const __m256i any = _mm256_or_si256(m0, m1);
+         if (_mm256_testz_si256(any, any)) continue;
+
+         return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m0)))
+              | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m1))) << 32;
+      }
+
+      return 0;
+   }
+#endif
+
+   using MaskFunction = uint64_t (*) (const char*& block, const char* end);
+
+   MaskFunction PreciseFunction (IncludeScanner::Isa isa)
+   {
+      switch (isa) {
+#ifdef FB_X86
+      case IncludeScanner::Isa::Avx2: return MaskAvx2;
+      case IncludeScanner::Isa::Sse2: return MaskSse2;
+#endif
+      default:                        return MaskScalar;
+      }
+   }
+
+   // The mask of the block at the current position is kept. Thus the next candidate is mostly found by a few bit operations.
+   class Cursor {
+   public:
+      Cursor (const char* end, MaskFunction mask) : end_{end}, function_{mask}, block_{end} { }
+
+      // The next candidate at or behind it, or end.
+      const char* Candidate (const char* it)
+      {
+         while (it < end_) {
+            if (it < block_ || it - block_ >= 64) {
+               Move(it);
+               if (it < block_) it = block_;
+            }
+
+            const uint64_t mask = mask_ & (~uint64_t{0} << (it - block_));
+            if (mask) return block_ + CountTrailingZeros(mask);
+
+            it = block_ + 64;
+         }
+
+         return end_;
+      }
+
+   private:
+      const char*  end_;
+      MaskFunction function_;
+      const char*  block_;
+      uint64_t     mask_{0};
+      char         tail_[65];
+
+      // To the first block from it with a candidate. The last one is copied, padded with zeros.
+      void Move (const char* it)
+      {
+         block_ = it;
+         mask_ = function_(block_, end_);
+         if (end_ - block_ > 64) return;
+
+         std::memset(tail_, 0, sizeof(tail_));
+         std::memcpy(tail_, block_, end_ - block_);
+
+         const char* block = tail_;
+         mask_ = function_(block, tail_ + sizeof(tail_));
+      }
+   };
+
+   // The ends of lines and comments are close, mostly. memchr finds them faster than the masks would.
+   const char* EndOfLine (const char* it, const char* end)
+   {
+      const char* found = static_cast<const char*>(std::memchr(it, '\n', end - it));
+      return found ? found : end;
+   }
+
+   // it points behind the "/*". Searches the '/', as doc comments are full of '*'.
+   const char* SkipBlockComment (const char* it, const char* end)
+   {
+      for (const char* start = it; it != end; ++it) {
+         it = static_cast<const char*>(std::memchr(it, '/', end - it));
+         if (!it) return end;
+         if (it != start && it[-1] == '*') return it + 1;
+      }
+
+      return end;
+   }
+
+   // it points behind the opening quote. Literals end at the end of the line, at the latest.
+   const char* SkipLiteral (const char* it, const char* end, char quote)
+   {
+      for (; it != end; ++it) {
+         if (*it == '\\' && it + 1 != end) ++it;
+         else if (*it == quote) return it + 1;
+         else if (*it == '\n') return it;
+      }
+
+      return end;
+   }
+
+   // R"delimiter( ... )delimiter". it points behind the quote.
+   const char* SkipRawString (const char* it, const char* end)
+   {
+      const char* open = static_cast<const char*>(std::memchr(it, '(', std::min<size_t>(end - it, 17)));
+      if (!open) return SkipLiteral(it, end, '"');
+
+      const std::string close = ")" + std::string(it, open) + "\"";
+      const char* found = std::search(open + 1, end, close.begin(), close.end());
+      return found == end ? end : found + close.size();
+   }
+
+   // A ' that follows a number is a digit separator (1'000'000), otherwise it starts a character literal.
+   bool DigitSeparator (const char* begin, const char* apostrophe)
+   {
+      const char* it = apostrophe;
+      while (it != begin && (IdentifierChar(it[-1]) || it[-1] == '\'' || it[-1] == '.')) --it;
+      return it != apostrophe && isdigit(static_cast<unsigned char>(*it));
+   }
+
+   bool RawStringPrefix (const char* begin, const char* quote)
+   {
+      if (quote == begin || quote[-1] != 'R') return false;
+
+      const char* it = quote - 1;
+      while (it != begin && IdentifierChar(it[-1])) --it;
+
+      const std::string prefix(it, quote);
+      return prefix == "R" || prefix == "LR" || prefix == "uR" || prefix == "UR" || prefix == "u8R";
+   }
+
+   // The logical line of a directive without comments. it points behind the name of the directive.
+   // Without text, the line is just skipped.
+   const char* DirectiveText (const char* it, const char* end, std::string* text)
+   {
+      // Line by line. Within a line, a '/' is rare.
+      for (;;) {
+         const char* line = EndOfLine(it, end);
+         const char* slash = static_cast<const char*>(std::memchr(it, '/', line - it));
+
+         if (slash) {
+            if (text) text->append(it, slash);
+            if (slash + 1 != end && slash[1] == '/') return line;
+
+            if (slash + 1 != end && slash[1] == '*') {
+               it = SkipBlockComment(slash + 2, end);
+               if (text) *text += ' ';
+            }
+            else {
+               if (text) *text += '/';
+               it = slash + 1;
+            }
+            continue;
+         }
+
+         const char* last = line != it && line[-1] == '\r' ? line - 1 : line;
+         const bool continued = line != end && last != it && last[-1] == '\\';
+
+         if (text) text->append(it, continued ? last - 1 : line);
+         if (!continued) return line;
+
+         if (text) *text += ' ';
+         it = line + 1;
+      }
+   }
+
+   // Whether a "//" behind from and on the line of at turns at into a comment. at may be the second '/' itself.
+   bool LineComment (const char* from, const char* at)
+   {
+      for (const char* it = at; it != from; --it) {
+         if (it[-1] == '\n') return false;
+         if (it[-1] == '/' && *it == '/') return true;
+      }
+
+      return false;
+   }
+
+   struct Region {
+      bool parentLive;
+      Tri  live;    // This branch
+      Tri  taken;   // One of the branches so far
+   };
+
+   enum class Kind { Include, Define, If, Ifdef, Ifndef, Elif, Elifdef, Elifndef, Else, Endif, Other };   // Define: #undef too
+
+   // Mostly, the length tells the directives apart.
+   Kind Classify (std::string_view name)
+   {
+      switch (name.size()) {
+      case 2:  return name == "if" ? Kind::If : Kind::Other;
+      case 4:  return name == "elif" ? Kind::Elif : name == "else" ? Kind::Else : Kind::Other;
+      case 5:  return name == "endif" ? Kind::Endif : name == "ifdef" ? Kind::Ifdef : name == "undef" ? Kind::Define : Kind::Other;
+      case 6:  return name == "define" ? Kind::Define : name == "ifndef" ? Kind::Ifndef : Kind::Other;
+      case 7:  return name == "include" ? Kind::Include : name == "elifdef" ? Kind::Elifdef : Kind::Other;
+      case 8:  return name == "elifndef" ? Kind::Elifndef : Kind::Other;
+      default: return Kind::Other;
+      }
+   }
+
+   class PreciseScanner {
+   public:
+      PreciseScanner (const char* begin, const char* end, const IncludeScanner::Macros& macros, const std::unordered_set<std::string>& unknown, IncludeScanner::MacroUse* use, MaskFunction mask)
+         : begin_{begin}, end_{end}, macros_{macros}, redefined_{unknown}, use_{use}, cursor_{end, mask} { }
+
+      Includes Scan ()
+      {
+         // Behind the last directive, literal or comment. Candidates can't be in a line comment which started before.
+         const char* from = begin_;
+
+         for (const char* it = cursor_.Candidate(begin_); it != end_; it = cursor_.Candidate(it)) {
+            const char ch = *it;
+
+            if (ch == '#' ? !AtLineStart(begin_, it) : ch == '\'' && DigitSeparator(begin_, it)) {
+               ++it;
+               continue;
+            }
+
+            if (ch == '#') it = Directive(it + 1);
+            else if (LineComment(from, it)) it = EndOfLine(it, end_);
+            else if (ch == '/') it = SkipBlockComment(it + 2, end_);
+            else if (ch == '"') it = RawStringPrefix(begin_, it) ? SkipRawString(it + 1, end_) : SkipLiteral(it + 1, end_, '"');
+            else it = SkipLiteral(it + 1, end_, '\'');
+
+            from = it;
+         }
+
+         if (use_) {
+            std::sort(use_->assumed.begin(), use_->assumed.end());
+            use_->assumed.erase(std::unique(use_->assumed.begin(), use_->assumed.end()), use_->assumed.end());
+         }
+
+         return std::move(includes_);
+      }
+
+   private:
+      const char*                     begin_;
+      const char*                     end_;
+      const IncludeScanner::Macros&   macros_;
+      std::unordered_set<std::string> redefined_;
+      IncludeScanner::MacroUse*       use_;
+      Cursor                          cursor_;
+      std::vector<Region>             regions_;
+      std::string                     text_;
+      Includes                        includes_;
+
+      bool Live () const { return regions_.empty() || (regions_.back().parentLive && regions_.back().live != Tri::False); }
+
+      // The condition of #if, #ifdef or #ifndef. #ifdef X is known, if X is a macro of the target.
+      // Within a region which is false anyway, it doesn't matter.
+      Tri Evaluate (Kind kind, bool parentLive)
+      {
+         if (!parentLive) return Tri::Unknown;
+         if (kind == Kind::If || kind == Kind::Elif) return Condition{text_, macros_, redefined_, use_}.Evaluate();
+
+         size_t first = 0;
+         while (first != text_.size() && Space(text_[first])) ++first;
+         size_t last = first;
+         while (last != text_.size() && IdentifierChar(text_[last])) ++last;
+
+         const Tri defined = Condition::Macro(std::string_view(text_).substr(first, last - first), macros_, redefined_, use_) ? Tri::True : Tri::Unknown;
+         return kind == Kind::Ifdef || kind == Kind::Elifdef ? defined : Not(defined);
+      }
+
+      // it points behind the '#'. Returns where the directive ends.
+      const char* Directive (const char* it)
+      {
+         it = SkipBlanks(it, end_);
+         const char* nameStart = it;
+         while (it != end_ && IdentifierChar(*it)) ++it;
+         const Kind kind = Classify(std::string_view(nameStart, it - nameStart));
+
+         if (kind == Kind::Include) {
+            if (!Live()) return EndOfLine(it, end_);
+
+            it = Include(it, end_, includes_);
+            return it != end_ && *it == '"' ? it + 1 : it;   // The closing quote isn't the start of a literal
+         }
+
+         // Only the name matters: from here on, its value is unknown. Unless it's a macro of the target, it was unknown before.
+         if (kind == Kind::Define) {
+            const char* name = SkipBlanks(it, end_);
+            const char* nameEnd = name;
+            while (nameEnd != end_ && IdentifierChar(*nameEnd)) ++nameEnd;
+
+            if (nameEnd != name && !macros_.empty() && Live()) {
+               std::string key(name, nameEnd);
+               if (macros_.count(key) && redefined_.insert(key).second && use_) use_->defined.push_back(std::move(key));
+            }
+
+            return DirectiveText(nameEnd, end_, nullptr);
+         }
+
+         text_.clear();
+         it = DirectiveText(it, end_, kind == Kind::Other || kind == Kind::Else || kind == Kind::Endif ? nullptr : &text_);
+
+         switch (kind) {
+         case Kind::If:
+         case Kind::Ifdef:
+         case Kind::Ifndef: {
+            const bool live = Live();
+            const Tri condition = Evaluate(kind, live);
+            regions_.push_back(Region{live, condition, condition});
+            break;
+         }
+         case Kind::Elif:
+         case Kind::Elifdef:
+         case Kind::Elifndef:
+            if (!regions_.empty()) {
+               Region& region = regions_.back();
+               const Tri condition = Evaluate(kind, region.parentLive);
+               region.live = And(Not(region.taken), condition);
+               region.taken = Or(region.taken, condition);
+            }
+            break;
+         case Kind::Else:
+            if (!regions_.empty()) {
+               Region& region = regions_.back();
+               region.live = Not(region.taken);
+               region.taken = Tri::True;
+            }
+            break;
+         case Kind::Endif:
+            if (!regions_.empty()) regions_.pop_back();
+            break;
+         default:
+            break;
+         }
+
+         return it;
+      }
+   };
+
+   Includes PreciseScan (const char* begin, const char* end, const IncludeScanner::Macros& macros, const std::unordered_set<std::string>& unknown, IncludeScanner::MacroUse* use, MaskFunction mask)
+   {
+      if (!begin || begin == end) return Includes{};
+      return PreciseScanner{begin, end, macros, unknown, use, mask}.Scan();
+   }
+}
+
+
+
+namespace IncludeScanner
+{
+   bool Supported (Isa isa)
+   {
+      switch (isa) {
+      case Isa::Scalar: return true;
+#ifdef FB_X86
+      case Isa::Sse2:   return true;
+      case Isa::Avx2:   {
+         static const bool avx2 = CpuHasAvx2();
+         return avx2;
+      }
+#endif
+      default:          return false;
+      }
+   }
+
+   Isa Best ()
+   {
+      static const Isa best = Supported(Isa::Avx2) ? Isa::Avx2 : Supported(Isa::Sse2) ? Isa::Sse2 : Isa::Scalar;
+      return best;
+   }
+
+   const char* Name (Isa isa)
+   {
+      switch (isa) {
+      case Isa::Avx2: return "AVX2";
+      case Isa::Sse2: return "SSE2";
+      default:        return "Scalar";
+      }
+   }
+
+   std::vector<std::pair<char, std::string>> Scan (const char* begin, const char* end)
+   {
+      static const ScanFunction scan = Function(Best());
+      return ::Scan(begin, end, scan);
+   }
+
+   std::vector<std::pair<char, std::string>> Scan (const char* begin, const char* end, Isa isa)
+   {
+      if (!Supported(isa)) isa = Isa::Scalar;
+      return ::Scan(begin, end, Function(isa));
+   }
+
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros)
+   {
+      static const MaskFunction mask = PreciseFunction(Best());
+      return PreciseScan(begin, end, macros, {}, nullptr, mask);
+   }
+
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros, Isa isa)
+   {
+      if (!Supported(isa)) isa = Isa::Scalar;
+      return PreciseScan(begin, end, macros, {}, nullptr, PreciseFunction(isa));
+   }
+
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros, const std::unordered_set<std::string>& unknown, MacroUse& use)
+   {
+      static const MaskFunction mask = PreciseFunction(Best());
+      return PreciseScan(begin, end, macros, unknown, &use, mask);
+   }
+}
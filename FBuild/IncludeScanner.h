@@ -0,0 +1,47 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+
+
+// Finds the #include directives of a file. The search for the '#' that starts a line runs 16 (SSE2) or 32 (AVX2) bytes at a time.
+// The instruction set is chosen once, at runtime.
+//
+// The precise scan skips comments and literals, and the regions of #if, #ifdef etc. which are false for the macros of the target.
+namespace IncludeScanner
+{
+   enum class Isa { Scalar, Sse2, Avx2 };
+
+   Isa         Best ();
+   bool        Supported (Isa isa);
+   const char* Name (Isa isa);
+
+   // The includes in the order of the file: '"' or '<', and the name as written.
+   std::vector<std::pair<char, std::string>> Scan (const char* begin, const char* end);
+   std::vector<std::pair<char, std::string>> Scan (const char* begin, const char* end, Isa isa);
+
+   // Name -> value ("1", if the define has no value)
+   using Macros = std::unordered_map<std::string, std::string>;
+
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros);
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros, Isa isa);
+
+   // The macros of the target a file defines or undefines, and those its conditions relied on.
+   struct MacroUse {
+      std::vector<std::string> defined;
+      std::vector<std::string> assumed;
+   };
+
+   // Other files might (un)define macros of the target, before this one tests them. Those in unknown aren't relied on.
+   std::vector<std::pair<char, std::string>> ScanPrecise (const char* begin, const char* end, const Macros& macros, const std::unordered_set<std::string>& unknown, MacroUse& use);
+}
@@ -14,6 +14,9 @@
 #include "DirectorySync.h"
 #include "ToolChain.h"
 #include "MemoryMappedFile.h"
+#include "BuildGraph.h"
+#include "Vfs.h"
+#include "Stats.h"
 
 #include "JsCopy.h"
 #include "JsLib.h"
@@ -26,7 +29,7 @@
 #include "JsMoc.h"
 #include "JsUic.h"
 
-#include <Shlwapi.h>
+#include "Wildcard.h"
 
 
 JavaScript::JavaScript (const std::vector<std::string>& args)
@@ -92,6 +95,12 @@ JavaScript::JavaScript (const std::vector<std::string>& args)
    duk_push_c_function(duktapeContext, JsToolChain, DUK_VARARGS);
    duk_put_prop_string(duktapeContext, -2, "ToolChain");
 
+   duk_push_c_function(duktapeContext, JsDeferred, DUK_VARARGS);
+   duk_put_prop_string(duktapeContext, -2, "Deferred");
+
+   duk_push_c_function(duktapeContext, JsStats, DUK_VARARGS);
+   duk_put_prop_string(duktapeContext, -2, "Stats");
+
    duk_pop(duktapeContext);
 
    JsCopy::Register(duktapeContext);
@@ -236,13 +245,21 @@ duk_ret_t JavaScript::JsExecuteFile(duk_context* duktapeContext)
    return 0;
 }
 
+static int System (const std::string& command)
+{
+   Stats::Add(Stats::Counter::ProcessSpawns);
+   Stats::Timer timer{Stats::Counter::ProcessTime};
+
+   return std::system(command.c_str());
+}
+
 duk_ret_t JavaScript::JsSystem(duk_context* duktapeContext)
 {
    if (duk_is_constructor_call(duktapeContext)) JavaScriptHelper::Throw(duktapeContext, "System() can't be constructed");
 
    std::string command = duk_require_string(duktapeContext, 0);
 
-   int rc = std::system(command.c_str());
+   int rc = System(command);
 
    duk_push_int(duktapeContext, rc);
    return 1;
@@ -293,8 +310,10 @@ duk_ret_t JavaScript::JsRun(duk_context* duktapeContext)
 
    if (catchOutput) command += " 1>" + tmpfile.string() + " 2>&1";
 
-   std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-   int rc = std::system(cmd.c_str()); 
+   const std::string setEnv = ToolChain::SetEnvBatchCall();
+   std::string cmd = setEnv.empty() ? command : setEnv + " & " + command;
+   int rc = System(cmd);
+   Vfs::Clear();   // No idea what the command wrote
    if (rc) JavaScriptHelper::Throw(duktapeContext, "Error running command " + command);
 
    if (catchOutput) {
@@ -325,10 +344,11 @@ duk_ret_t JavaScript::JsTouch(duk_context* duktapeContext)
 
    try {
       for (const auto& filename : files) {
-         if (!std::filesystem::exists(filename)) throw std::exception(std::string("File " + filename + " does not exist").c_str());
-         if (!std::filesystem::is_regular_file(filename)) throw std::exception(std::string(filename + " is not a file").c_str());
+         if (!std::filesystem::exists(filename)) throw std::runtime_error("File " + filename + " does not exist");
+         if (!std::filesystem::is_regular_file(filename)) throw std::runtime_error(filename + " is not a file");
 
          std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now());
+         Vfs::Changed(filename);
       }
    }
    catch (std::exception& e) {
@@ -360,14 +380,21 @@ duk_ret_t JavaScript::JsGlob(duk_context* duktapeContext)
    duk_push_array(duktapeContext);
    unsigned int idx = 0;
 
+#ifdef _WIN32
    char buffer[8192];
+#endif
 
    if (std::filesystem::exists(path)) {
       std::for_each(std::filesystem::directory_iterator(path), std::filesystem::directory_iterator(), [&] (const std::filesystem::directory_entry& entry) {
          if (std::filesystem::is_regular_file(entry.path())) {
-            if (PathMatchSpec(entry.path().filename().string().c_str(), pattern.c_str())) {
+            if (MatchesWildcard(entry.path().filename().string(), pattern)) {
+#ifdef _WIN32
                char* fullpath = _fullpath(buffer, entry.path().string().c_str(), sizeof(buffer));
                if (!fullpath) JavaScriptHelper::Throw(duktapeContext, "Error getting full path for " + entry.path().string());
+#else
+               const std::string absolute = std::filesystem::absolute(entry.path()).lexically_normal().string();
+               const char* fullpath = absolute.c_str();
+#endif
 
                duk_push_string(duktapeContext, fullpath);
                duk_put_prop_index(duktapeContext, -2, idx);
@@ -477,9 +504,15 @@ duk_ret_t JavaScript::JsSetEnv(duk_context* duktapeContext)
    arg += "=";
    arg += duk_require_string(duktapeContext, 1);
 
+#ifdef _WIN32
    int rc = _putenv(arg.c_str());
+#else
+   int rc = ::setenv(duk_require_string(duktapeContext, 0), duk_require_string(duktapeContext, 1), 1);
+#endif
    if (rc) JavaScriptHelper::Throw(duktapeContext, "Error putting environment " + arg);
 
+   ToolChain::ResetEnvironment();
+
    return 0;
 }
 
@@ -523,3 +556,60 @@ duk_ret_t JavaScript::JsToolChain(duk_context* duktapeContext)
       JavaScriptHelper::Throw(duktapeContext, "To many arguments for ToolChain");
    }
 }
+
+duk_ret_t JavaScript::JsDeferred(duk_context* duktapeContext)
+{
+   if (duk_is_constructor_call(duktapeContext)) JavaScriptHelper::Throw(duktapeContext, "Deferred() can't be constructed");
+
+   auto& buildGraph = BuildGraph::Instance();
+
+   auto argc = duk_get_top(duktapeContext);
+
+   if (argc == 0) {
+      duk_push_boolean(duktapeContext, buildGraph.Deferred());
+      return 1;
+   }
+   else if (argc == 1) {
+      const bool deferred = duk_to_boolean(duktapeContext, 0);
+
+      if (!deferred) {  // Leaving the deferred mode builds all targets registered so far
+         try {
+            buildGraph.Execute();
+         }
+         catch (std::exception& e) {
+            JavaScriptHelper::Throw(duktapeContext, e.what());
+         }
+      }
+
+      buildGraph.Deferred(deferred);
+      return 0;
+   }
+   else {
+      JavaScriptHelper::Throw(duktapeContext, "One argument for Deferred() expected");
+   }
+}
+
+duk_ret_t JavaScript::JsStats(duk_context* duktapeContext)
+{
+   if (duk_is_constructor_call(duktapeContext)) JavaScriptHelper::Throw(duktapeContext, "Stats() can't be constructed");
+
+   auto argc = duk_get_top(duktapeContext);
+
+   if (argc == 0) {
+      duk_push_object(duktapeContext);
+
+      for (auto&& [name, value] : Stats::All()) {
+         duk_push_number(duktapeContext, value);
+         duk_put_prop_string(duktapeContext, -2, name.c_str());
+      }
+
+      return 1;
+   }
+   else if (argc == 1) {
+      Stats::Enable(duk_to_boolean(duktapeContext, 0));
+      return 0;
+   }
+   else {
+      JavaScriptHelper::Throw(duktapeContext, "At most one argument for Stats() expected");
+   }
+}
@@ -36,6 +36,8 @@ class JavaScript {
    static duk_ret_t JsSetEnv(duk_context* duktapeContext);
    static duk_ret_t JsDirectorySync(duk_context* duktapeContext);
    static duk_ret_t JsToolChain(duk_context* duktapeContext);
+   static duk_ret_t JsDeferred(duk_context* duktapeContext);
+   static duk_ret_t JsStats(duk_context* duktapeContext);
 
 public:
    JavaScript (const std::vector<std::string>& args);
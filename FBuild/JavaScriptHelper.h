@@ -10,6 +10,7 @@
 #include "../Duktape/duktape.h"
 
 #include <string_view> 
+#include <mutex>
 
 
 namespace JavaScriptHelper {
@@ -107,12 +108,12 @@ namespace JavaScriptHelper {
    template<typename T>
    T* CppObject(duk_context* duktapeContext)
    {
-      if (!duk_is_object(duktapeContext, -1)) throw std::exception("Internal Error: expected object on top of the stack");
+      if (!duk_is_object(duktapeContext, -1)) throw std::runtime_error("Internal Error: expected object on top of the stack");
       duk_get_prop_string(duktapeContext, -1, "__Ptr");
-      if (!duk_is_pointer(duktapeContext, -1)) throw std::exception("Internal Error: expected property '__Ptr' to hold the C++ Object");
+      if (!duk_is_pointer(duktapeContext, -1)) throw std::runtime_error("Internal Error: expected property '__Ptr' to hold the C++ Object");
       void* ptr = duk_get_pointer(duktapeContext, -1);
       duk_pop(duktapeContext);
-      if (!ptr) throw std::exception("Internal Error: Nullpointer! C++ Object ist Null");
+      if (!ptr) throw std::runtime_error("Internal Error: Nullpointer! C++ Object ist Null");
       return static_cast<T*>(ptr);
    }
 
@@ -127,6 +128,16 @@ namespace JavaScriptHelper {
       duk_pop(duktapeContext);
    }
 
+   // Keeps the object at the given index alive, e.g. while a deferred target still refers to it.
+   inline void StashObject(duk_context* duktapeContext, int index, const std::string& key, void* obj)
+   {
+      std::string k = key + std::to_string((size_t)obj);
+      duk_push_global_stash(duktapeContext);
+      duk_dup(duktapeContext, index < 0 ? index - 1 : index);
+      duk_put_prop_string(duktapeContext, -2, k.c_str());
+      duk_pop(duktapeContext);
+   }
+
    inline void PushStashedCallback(duk_context* duktapeContext, const std::string& key, void* obj)
    {
       std::string k = key + std::to_string((size_t)obj);
@@ -134,8 +145,17 @@ namespace JavaScriptHelper {
       duk_get_prop_string(duktapeContext, -1, k.c_str());
    }
 
+   // Deferred targets call their callbacks from the worker threads. Duktape isn't threadsafe, thus these calls are serialized.
+   inline std::mutex& CallbackMutex()
+   {
+      static std::mutex mutex;
+      return mutex;
+   }
+
    inline void CallStashedCallback(duk_context* duktapeContext, const std::string& key, void* obj)
    {
+      std::lock_guard lock(CallbackMutex());
+
       int top = duk_get_top(duktapeContext);
 
       std::string k = key + std::to_string((size_t)obj);
@@ -0,0 +1,365 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <limits>
+
+
+
+static thread_local size_t workerIndex = std::numeric_limits<size_t>::max();
+static thread_local int64_t currentPriority = 0;
+static uint32_t threadCount = 0;
+
+
+
+JobSystem& JobSystem::Instance ()
+{
+   static JobSystem jobSystem;
+   return jobSystem;
+}
+
+void JobSystem::Threads (uint32_t threads)
+{
+   threadCount = threads;
+}
+
+JobSystem::JobSystem ()
+{
+   uint32_t cpus = threadCount ? threadCount : std::thread::hardware_concurrency();
+   if (!cpus) cpus = 2;
+
+   // The thread waiting for the jobs executes jobs as well.
+   const uint32_t workers = cpus > 1 ? cpus - 1 : 1;
+
+   for (uint32_t i = 0; i <= workers; ++i) queues_.emplace_back(std::make_unique<Queue>());
+   for (uint32_t i = 0; i < workers; ++i) workers_.emplace_back([this, i] () { Worker(i); });
+}
+
+JobSystem::~JobSystem ()
+{
+   {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+   }
+   signal_.notify_all();
+
+   for (auto&& worker : workers_) worker.join();
+}
+
+JobSystem::JobPtr JobSystem::Submit (Job::Function function, int64_t priority, const std::vector<JobPtr>& dependencies)
+{
+   auto job = std::make_shared<Job>();
+   job->function_ = std::move(function);
+   job->priority_ = priority;
+   job->sequence_ = sequence_++;
+
+   for (auto&& dependency : dependencies) {
+      if (!dependency) continue;
+
+      std::lock_guard lock(dependency->mutex_);
+      if (!dependency->done_) {
+         ++job->pending_;
+         dependency->dependents_.push_back(job);
+      }
+      else if (dependency->failed_ || dependency->cancelled_) {
+         job->cancelled_ = true;
+      }
+   }
+
+   if (--job->pending_ == 0) Enqueue(job);
+
+   return job;
+}
+
+void JobSystem::Cancel (const JobPtr& job)
+{
+   if (job) job->cancelled_ = true;
+}
+
+void JobSystem::Wait (const JobPtr& job)
+{
+   if (!job) return;
+
+   WaitFor([&job] () { return job->Done(); });
+
+   if (job->exception_) std::rethrow_exception(job->exception_);
+}
+
+void JobSystem::Wait (const std::vector<JobPtr>& jobs)
+{
+   for (auto&& job : jobs) Wait(job);
+}
+
+void JobSystem::WaitFor (const std::function<bool()>& predicate)
+{
+   while (!predicate()) {
+      auto job = Dequeue();
+      if (job) {
+         Execute(job);
+         continue;
+      }
+
+      std::unique_lock lock(mutex_);
+      signal_.wait(lock, [&] () { return queued_ > 0 || predicate(); });
+   }
+}
+
+bool JobSystem::RunsLater (const JobPtr& a, const JobPtr& b)
+{
+   if (a->priority_ != b->priority_) return a->priority_ < b->priority_;
+   return a->sequence_ > b->sequence_;
+}
+
+void JobSystem::Enqueue (const JobPtr& job)
+{
+   Queue& queue = workerIndex < workers_.size() ? *queues_[workerIndex] : *queues_.back();
+
+   {
+      std::lock_guard lock(queue.mutex);
+      queue.heap.push_back(job);
+      std::push_heap(queue.heap.begin(), queue.heap.end(), RunsLater);
+      ++queued_;
+   }
+
+   Notify();
+}
+
+JobSystem::JobPtr JobSystem::Pop (Queue& queue)
+{
+   std::lock_guard lock(queue.mutex);
+   if (queue.heap.empty()) return JobPtr{};
+
+   std::pop_heap(queue.heap.begin(), queue.heap.end(), RunsLater);
+
+   JobPtr job = std::move(queue.heap.back());
+   queue.heap.pop_back();
+   --queued_;
+
+   return job;
+}
+
+JobSystem::JobPtr JobSystem::Dequeue ()
+{
+   if (!queued_) return JobPtr{};
+
+   const size_t own = workerIndex < workers_.size() ? workerIndex : queues_.size() - 1;
+
+   // Take from the own queue, unless another queue has something more important. Then steal that.
+   size_t best = queues_.size();
+   int64_t bestPriority = std::numeric_limits<int64_t>::min();
+
+   for (size_t n = 0; n < queues_.size(); ++n) {
+      const size_t i = (own + n) % queues_.size();
+      Queue& queue = *queues_[i];
+
+      std::unique_lock lock(queue.mutex, std::defer_lock);
+      if (i == own) lock.lock();
+      else if (!lock.try_lock()) continue;
+
+      if (queue.heap.empty()) continue;
+      if (best == queues_.size() || queue.heap.front()->priority_ > bestPriority) {
+         best = i;
+         bestPriority = queue.heap.front()->priority_;
+      }
+   }
+
+   if (best != queues_.size()) {
+      auto job = Pop(*queues_[best]);
+      if (job) return job;
+   }
+
+   for (size_t n = 0; n < queues_.size(); ++n) {
+      auto job = Pop(*queues_[(own + n) % queues_.size()]);
+      if (job) return job;
+   }
+
+   return JobPtr{};
+}
+
+int64_t JobSystem::CurrentPriority ()
+{
+   return currentPriority;
+}
+
+void JobSystem::Execute (const JobPtr& job)
+{
+   if (!job->cancelled_) {
+      // Executed while waiting within another job, thus the priority of that one is restored afterwards.
+      const int64_t outer = currentPriority;
+      currentPriority = job->priority_;
+
+      try {
+         job->function_();
+      }
+      catch (...) {
+         job->exception_ = std::current_exception();
+         job->failed_ = true;
+      }
+
+      currentPriority = outer;
+   }
+
+   job->function_ = nullptr;
+
+   Finish(job);
+}
+
+void JobSystem::Finish (const JobPtr& job)
+{
+   std::vector<JobPtr> dependents;
+
+   {
+      std::lock_guard lock(job->mutex_);
+      job->done_ = true;
+      dependents.swap(job->dependents_);
+   }
+
+   const bool propagateCancel = job->failed_ || job->cancelled_;
+
+   for (auto&& dependent : dependents) {
+      if (propagateCancel) dependent->cancelled_ = true;
+      if (--dependent->pending_ == 0) Enqueue(dependent);
+   }
+
+   Notify();
+}
+
+void JobSystem::Worker (size_t index)
+{
+   workerIndex = index;
+
+   for (;;) {
+      auto job = Dequeue();
+      if (job) {
+         Execute(job);
+         continue;
+      }
+
+      std::unique_lock lock(mutex_);
+      signal_.wait(lock, [this] () { return stop_ || queued_ > 0; });
+      if (stop_ && !queued_) return;
+   }
+}
+
+void JobSystem::Notify ()
+{
+   {
+      std::lock_guard lock(mutex_);
+   }
+   signal_.notify_all();
+}
+
+
+
+
+
+
+
+JobGroup::~JobGroup ()
+{
+   if (remaining_ == 0) return;
+
+   Cancel();
+
+   try {
+      Wait();
+   }
+   catch (...) { }
+}
+
+void JobGroup::Add (Job::Function function, int64_t priority)
+{
+   ++remaining_;
+
+   {
+      std::lock_guard lock(mutex_);
+      if (cancelled_) {
+         --remaining_;
+         return;
+      }
+
+      if (maxConcurrency_ && running_ >= maxConcurrency_) {
+         auto it = std::upper_bound(pending_.begin(), pending_.end(), priority, [] (int64_t p, const Pending& pending) {
+            return p > pending.priority;
+         });
+         pending_.insert(it, Pending{std::move(function), priority});
+         return;
+      }
+
+      ++running_;
+   }
+
+   Submit(Pending{std::move(function), priority});
+}
+
+void JobGroup::Submit (Pending pending)
+{
+   JobSystem::Instance().Submit([this, function = std::move(pending.function)] () {
+      struct Next {
+         JobGroup* group;
+
+         ~Next ()
+         {
+            Pending next{};
+            bool hasNext = false;
+
+            {
+               std::lock_guard lock(group->mutex_);
+               --group->running_;
+
+               if (!group->cancelled_ && !group->pending_.empty()) {
+                  next = std::move(group->pending_.front());
+                  group->pending_.pop_front();
+                  ++group->running_;
+                  hasNext = true;
+               }
+            }
+
+            if (hasNext) group->Submit(std::move(next));
+
+            --group->remaining_;  // Must be the last access to the group. Wait() might return right after.
+         }
+      } next{this};
+
+      {
+         std::lock_guard lock(mutex_);
+         if (cancelled_) return;
+      }
+
+      try {
+         function();
+      }
+      catch (...) {
+         std::lock_guard lock(mutex_);
+         if (!exception_) exception_ = std::current_exception();
+      }
+   }, pending.priority);
+}
+
+void JobGroup::Cancel ()
+{
+   std::lock_guard lock(mutex_);
+   cancelled_ = true;
+   remaining_ -= pending_.size();
+   pending_.clear();
+}
+
+void JobGroup::Wait ()
+{
+   JobSystem::Instance().WaitFor([this] () { return remaining_ == 0; });
+
+   std::exception_ptr exception;
+   {
+      std::lock_guard lock(mutex_);
+      exception.swap(exception_);
+   }
+
+   if (exception) std::rethrow_exception(exception);
+}
+
@@ -0,0 +1,144 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+
+
+class JobSystem;
+
+
+class Job {
+public:
+   typedef std::function<void()> Function;
+
+   bool Done () const      { return done_; }
+   bool Cancelled () const { return cancelled_; }
+   bool Failed () const    { return failed_; }
+
+   int64_t Priority () const { return priority_; }
+
+private:
+   friend class JobSystem;
+
+   Function                          function_;
+   int64_t                           priority_{0};
+   uint64_t                          sequence_{0};
+   std::atomic<uint32_t>             pending_{1};
+   std::atomic<bool>                 cancelled_{false};
+   std::atomic<bool>                 failed_{false};
+   std::atomic<bool>                 done_{false};
+   std::exception_ptr                exception_;
+   std::mutex                        mutex_;
+   std::vector<std::shared_ptr<Job>> dependents_;
+};
+
+
+
+// One process-wide pool of worker threads, shared by everything that runs in parallel.
+// Every worker owns a queue, ordered by priority. Idle workers steal from the others.
+// A thread waiting for a job executes other jobs meanwhile, thus waiting from within a job doesn't block a worker.
+class JobSystem {
+public:
+   typedef std::shared_ptr<Job> JobPtr;
+
+   static JobSystem& Instance ();
+
+   // Threads, including the one waiting for the jobs. Before the first use. Zero: one per CPU.
+   static void Threads (uint32_t threads);
+
+   ~JobSystem ();
+
+   // The job runs once all dependencies are done. If a dependency failed or was cancelled, the job is cancelled as well.
+   JobPtr Submit (Job::Function function, int64_t priority = 0, const std::vector<JobPtr>& dependencies = {});
+
+   // Jobs which haven't started yet are skipped (and so are their dependents).
+   void Cancel (const JobPtr& job);
+
+   // Rethrows the exception of a failed job.
+   void Wait (const JobPtr& job);
+   void Wait (const std::vector<JobPtr>& jobs);
+   void WaitFor (const std::function<bool()>& predicate);
+
+   uint32_t Workers () const { return static_cast<uint32_t>(workers_.size()); }
+
+   // The priority of the job running on this thread, zero outside of jobs. For jobs which submit jobs of their own.
+   static int64_t CurrentPriority ();
+
+private:
+   struct Queue {
+      std::mutex          mutex;
+      std::vector<JobPtr> heap;
+   };
+
+   std::vector<std::unique_ptr<Queue>> queues_;   // One per worker, the last one for all other threads
+   std::vector<std::thread>            workers_;
+   std::atomic<uint64_t>               sequence_{0};
+   std::atomic<size_t>                 queued_{0};
+   std::mutex                          mutex_;
+   std::condition_variable             signal_;
+   bool                                stop_{false};
+
+   JobSystem ();
+
+   static bool RunsLater (const JobPtr& a, const JobPtr& b);
+
+   void Enqueue (const JobPtr& job);
+   JobPtr Dequeue ();
+   JobPtr Pop (Queue& queue);
+   void Execute (const JobPtr& job);
+   void Finish (const JobPtr& job);
+   void Worker (size_t index);
+   void Notify ();
+};
+
+
+
+// A set of jobs of one step (e.g. compiling the files of a target).
+// With a maximum concurrency, only that many of the group's jobs are submitted at once. The rest is submitted as the others finish,
+// the ones with the highest priority first.
+class JobGroup {
+public:
+   explicit JobGroup (uint32_t maxConcurrency = 0, int64_t priority = 0) : maxConcurrency_{maxConcurrency}, priority_{priority} { }
+   ~JobGroup ();
+
+   void Add (Job::Function function, int64_t priority);
+   void Add (Job::Function function) { Add(std::move(function), priority_); }
+
+   void Cancel ();
+
+   // Rethrows the first exception thrown by one of the jobs.
+   void Wait ();
+
+private:
+   struct Pending {
+      Job::Function function;
+      int64_t       priority;
+   };
+
+   uint32_t                         maxConcurrency_;
+   int64_t                          priority_;
+   std::mutex                       mutex_;
+   std::deque<Pending>              pending_;
+   std::exception_ptr               exception_;
+   uint32_t                         running_{0};
+   std::atomic<size_t>              remaining_{0};
+   bool                             cancelled_{false};
+
+   void Submit (Pending pending);
+};
+
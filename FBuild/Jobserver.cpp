@@ -0,0 +1,276 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Jobserver.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+
+
+namespace
+{
+   typedef std::function<void(const Jobserver::Token&)> Granted;
+
+   std::atomic<bool> active{false};
+
+   std::mutex          mutex;
+   bool                implicitUsed{false};
+   std::deque<Granted> waiting;
+   bool                reading{false};   // The thread taking the tokens of the pool runs
+
+#ifdef _WIN32
+   HANDLE semaphore = nullptr;
+#else
+   int readFd = -1;
+   int writeFd = -1;
+#endif
+
+   // The last one counts. --jobserver-fds is the name up to make 4.1.
+   std::string Auth (const std::string& makeflags)
+   {
+      std::istringstream stream(makeflags);
+      std::string word, auth;
+
+      while (stream >> word) {
+         if (word.rfind("--jobserver-auth=", 0) == 0) auth = word.substr(17);
+         else if (word.rfind("--jobserver-fds=", 0) == 0) auth = word.substr(16);
+      }
+
+      return auth;
+   }
+
+   void SetMakeflags (const std::string& makeflags, const std::string& jobserver)
+   {
+      const std::string value = makeflags + (makeflags.empty() ? "" : " ") + jobserver;
+#ifdef _WIN32
+      _putenv_s("MAKEFLAGS", value.c_str());
+#else
+      ::setenv("MAKEFLAGS", value.c_str(), 1);
+#endif
+   }
+
+   void Broken (const std::string& reason)
+   {
+      if (active.exchange(false)) std::cerr << "Not using the jobserver: " << reason << std::endl;
+   }
+
+#ifdef _WIN32
+
+   bool Join (const std::string& auth)
+   {
+      semaphore = ::OpenSemaphoreA(SYNCHRONIZE | SEMAPHORE_MODIFY_STATE, FALSE, auth.c_str());
+      if (!semaphore) std::cerr << "Not using the jobserver: unable to open the semaphore " << auth << std::endl;
+      return semaphore != nullptr;
+   }
+
+   bool Create (uint32_t jobs, const std::string& makeflags)
+   {
+      const auto tokens = static_cast<LONG>(jobs > 1 ? jobs - 1 : 0);
+      const std::string name = "fbuild_semaphore_" + std::to_string(::GetCurrentProcessId());
+
+      semaphore = ::CreateSemaphoreA(nullptr, tokens, tokens > 0 ? tokens : 1, name.c_str());
+      if (!semaphore) return false;
+
+      SetMakeflags(makeflags, "-j" + std::to_string(jobs) + " --jobserver-auth=" + name);
+      return true;
+   }
+
+#else
+
+   // make passes the pipe only to the rules it knows to be make (prefixed with + or using $(MAKE)).
+   bool Join (const std::string& auth)
+   {
+      if (auth.rfind("fifo:", 0) == 0) {
+         readFd = writeFd = ::open(auth.c_str() + 5, O_RDWR | O_CLOEXEC);
+         if (readFd < 0) std::cerr << "Not using the jobserver: unable to open " << auth.substr(5) << std::endl;
+         return readFd >= 0;
+      }
+
+      const auto comma = auth.find(',');
+      if (comma != std::string::npos) {
+         readFd = std::atoi(auth.c_str());
+         writeFd = std::atoi(auth.c_str() + comma + 1);
+      }
+
+      if (readFd < 0 || writeFd < 0 || ::fcntl(readFd, F_GETFD) == -1 || ::fcntl(writeFd, F_GETFD) == -1) {
+         std::cerr << "Not using the jobserver: make didn't pass it on (prefix the rule with +)" << std::endl;
+         return false;
+      }
+
+      return true;
+   }
+
+   // A pipe, as it's understood by all versions of make. Inherited by the processes started.
+   bool Create (uint32_t jobs, const std::string& makeflags)
+   {
+      int fds[2];
+      if (::pipe(fds) != 0) return false;
+
+      readFd = fds[0];
+      writeFd = fds[1];
+
+      for (uint32_t i = 1; i < jobs; ++i) {
+         if (::write(writeFd, "+", 1) != 1) return false;
+      }
+
+      SetMakeflags(makeflags, "-j" + std::to_string(jobs) + " --jobserver-auth=" + std::to_string(readFd) + "," + std::to_string(writeFd));
+      return true;
+   }
+
+#endif
+
+   // Blocks until make's pool has a token.
+   Jobserver::Token Take ()
+   {
+      Jobserver::Token token;
+
+#ifdef _WIN32
+      if (::WaitForSingleObject(semaphore, INFINITE) == WAIT_OBJECT_0) token.held = true;
+      else Broken("waiting for the semaphore failed");
+#else
+      for (;;) {
+         char value;
+         const auto count = ::read(readFd, &value, 1);
+         if (count == 1) {
+            token.value = value;
+            token.held = true;
+            break;
+         }
+
+         if (count < 0 && errno == EINTR) continue;
+
+         // make 4.3 passes the pipe non-blocking. Another reader might be faster, thus the read is tried again.
+         if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd readable{readFd, POLLIN, 0};
+            if (::poll(&readable, 1, -1) >= 0 || errno == EINTR) continue;
+         }
+
+         Broken("reading a token failed");
+         break;
+      }
+#endif
+
+      return token;
+   }
+
+   void Give (const Jobserver::Token& token)
+   {
+#ifdef _WIN32
+      ::ReleaseSemaphore(semaphore, 1, nullptr);
+#else
+      while (::write(writeFd, &token.value, 1) < 0 && errno == EINTR) { }
+#endif
+   }
+
+   // Takes tokens of make's pool as long as someone waits. Those taken after the implicit token went to the last one are given back.
+   void Read ()
+   {
+      for (;;) {
+         {
+            std::lock_guard lock(mutex);
+            if (waiting.empty()) {
+               reading = false;
+               return;
+            }
+         }
+
+         const Jobserver::Token token = Take();
+
+         Granted next;
+         {
+            std::lock_guard lock(mutex);
+            if (!waiting.empty()) {
+               next = std::move(waiting.front());
+               waiting.pop_front();
+            }
+         }
+
+         if (next) next(token);
+         else if (token.held) Give(token);
+      }
+   }
+}
+
+
+
+namespace Jobserver
+{
+   void Start (uint32_t jobs)
+   {
+      const char* env = std::getenv("MAKEFLAGS");
+      const std::string makeflags = env ? env : "";
+      const std::string auth = Auth(makeflags);
+
+      active = auth.empty() ? Create(jobs, makeflags) : Join(auth);
+   }
+
+   bool Active ()
+   {
+      return active;
+   }
+
+   // While a token is awaited, the implicit one might be given back. It goes to the first one waiting, as make does.
+   void Acquire (Granted granted)
+   {
+      Token token;
+
+      if (active) {
+         std::lock_guard lock(mutex);
+
+         if (implicitUsed) {
+            waiting.push_back(std::move(granted));
+            if (!reading) {
+               reading = true;
+               std::thread{Read}.detach();   // Never joined: at exit, it might still wait for make
+            }
+            return;
+         }
+
+         implicitUsed = true;
+         token.implicit = true;
+      }
+
+      granted(token);
+   }
+
+   void Release (const Token& token)
+   {
+      if (token.implicit) {
+         Granted next;
+         {
+            std::lock_guard lock(mutex);
+            if (waiting.empty()) implicitUsed = false;
+            else {
+               next = std::move(waiting.front());
+               waiting.pop_front();
+            }
+         }
+
+         if (next) next(token);
+         return;
+      }
+
+      if (token.held) Give(token);
+   }
+}
@@ -0,0 +1,35 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+
+
+// GNU make's jobserver: a pool of tokens, one per job that may run besides the first (every process owns one implicitly).
+// Started from make, FBuild takes the tokens of make's pool (MAKEFLAGS --jobserver-auth: a fifo or a pipe, a semaphore on Windows).
+// Otherwise it creates a pool of its own and passes it on in MAKEFLAGS, thus a make (or ninja) started by the script
+// shares the CPUs with the compiles instead of starting as many jobs again.
+namespace Jobserver
+{
+   struct Token {
+      bool implicit{false};
+      bool held{false};
+      char value{'+'};
+   };
+
+   // Joins the pool of MAKEFLAGS, or creates one for the given number of jobs. Before the first job.
+   void Start (uint32_t jobs);
+   bool Active ();
+
+   // Calls granted with a token: right away, if one is free. Otherwise on the thread which waits for the pool, or the one
+   // giving the implicit token back. If the pool is broken (e.g. make didn't pass the pipe on), it's not used anymore.
+   void Acquire (std::function<void(const Token&)> granted);
+   void Release (const Token& token);
+}
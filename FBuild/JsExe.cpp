@@ -6,6 +6,8 @@
  */
 
 #include "JsExe.h"
+#include "BuildGraph.h"
+#include "TimingHistory.h"
 
 #include <filesystem>
 
@@ -536,6 +538,33 @@ duk_ret_t JsExe::BeforeLink(duk_context* duktapeContext)
    }
 }
 
+void JsExe::DoCompile()
+{
+   compiler.Compile();
+
+   if (!resourceCompiler.Files().empty()) {
+      resourceCompiler.DependencyCheck(compiler.DependencyCheck());
+      resourceCompiler.Outdir(compiler.ObjDir());
+      resourceCompiler.Compile();
+   }
+}
+
+void JsExe::DoLink()
+{
+   linker.Build(compiler.Build());
+
+   std::vector<std::string> objFiles;
+   for (auto&& f : compiler.ObjFiles()) {
+      if (std::filesystem::file_size(f) != 0) objFiles.push_back(f);
+   }
+   linker.Files(objFiles);
+
+   if (!resourceCompiler.Files().empty()) linker.AddFiles(resourceCompiler.Outfiles());
+   linker.DependencyCheck(compiler.DependencyCheck());
+   linker.ObjDir(compiler.ObjDir());
+   linker.Link();
+}
+
 duk_ret_t JsExe::Create(duk_context* duktapeContext)
 {
    try {
@@ -546,26 +575,33 @@ duk_ret_t JsExe::Create(duk_context* duktapeContext)
 
       if (args != 0) JavaScriptHelper::Throw(duktapeContext, "No arguments for Exe::Create() expected");
 
-      obj->compiler.Compile();
-
-      bool rc = !obj->resourceCompiler.Outfiles().empty();
-      if (rc) {
-         obj->resourceCompiler.DependencyCheck(obj->compiler.DependencyCheck());
-         obj->resourceCompiler.Outdir(obj->compiler.ObjDir());
-         obj->resourceCompiler.Compile();
+      auto& buildGraph = BuildGraph::Instance();
+      if (!buildGraph.Deferred()) {
+         obj->DoCompile();
+         obj->DoLink();
+         return 1;
       }
 
-      obj->linker.Build(obj->compiler.Build());
+      JavaScriptHelper::StashObject(duktapeContext, -1, "JsExe::Create", obj);
 
-      std::vector<std::string> objFiles;
-      for (auto&& f : obj->compiler.ObjFiles()) {
-         if (std::filesystem::file_size(f) != 0) objFiles.push_back(f);
-      }
-      obj->linker.Files(objFiles);
+      BuildGraph::MakeAbsolute(obj->compiler);
+      BuildGraph::MakeAbsolute(obj->linker);
+      BuildGraph::MakeAbsolute(obj->resourceCompiler);
+
+      BuildGraph::Target target;
+      target.name = obj->linker.Output();
+      target.timing = TimingHistory::LinkStep(obj->compiler.ObjDir(), obj->linker.Output());
+
+      target.inputs = obj->linker.LibFiles();
+
+      target.outputs.push_back(obj->linker.Output());
+      if (!obj->linker.ImportLib().empty()) target.outputs.push_back(obj->linker.ImportLib());
+      else target.outputs.push_back(std::filesystem::path{obj->linker.Output()}.replace_extension(".lib").string());
+
+      target.compile = [obj] () { obj->DoCompile(); };
+      target.link = [obj] () { obj->DoLink(); };
 
-      if (rc) obj->linker.AddFiles(obj->resourceCompiler.Outfiles());
-      obj->linker.DependencyCheck(obj->compiler.DependencyCheck());
-      obj->linker.Link();
+      buildGraph.Add(std::move(target));
 
       return 1;
    }
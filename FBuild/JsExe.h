@@ -48,6 +48,9 @@ class JsExe {
 
    static duk_ret_t Create(duk_context* duktapeContext);
 
+   void DoCompile();
+   void DoLink();
+
 public:
 
    static void Register(duk_context* duktapeContext);
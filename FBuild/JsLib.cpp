@@ -6,6 +6,8 @@
  */
 
 #include "JsLib.h"
+#include "BuildGraph.h"
+#include "TimingHistory.h"
 
 #include <iostream>
 #include <filesystem>
@@ -408,6 +410,24 @@ duk_ret_t JsLib::BeforeLink(duk_context* duktapeContext)
    }
 }
 
+void JsLib::DoCompile()
+{
+   compiler.Compile();
+}
+
+void JsLib::DoLink()
+{
+   std::vector<std::string> objFiles;
+   for (auto&& f : compiler.ObjFiles()) {
+      if (std::filesystem::file_size(f) != 0) objFiles.push_back(f);
+   }
+   librarian.Files(objFiles);
+
+   librarian.DependencyCheck(compiler.DependencyCheck());
+   librarian.ObjDir(compiler.ObjDir());
+   librarian.Create();
+}
+
 duk_ret_t JsLib::Create(duk_context* duktapeContext)
 {
    try {
@@ -418,17 +438,26 @@ duk_ret_t JsLib::Create(duk_context* duktapeContext)
 
       if (args != 0) JavaScriptHelper::Throw(duktapeContext, "No arguments for Lib::Create() expected");
 
-      obj->compiler.Compile();
-
-      std::vector<std::string> objFiles;
-      for (auto&& f : obj->compiler.ObjFiles()) {
-         if (std::filesystem::file_size(f) != 0) objFiles.push_back(f);
+      auto& buildGraph = BuildGraph::Instance();
+      if (!buildGraph.Deferred()) {
+         obj->DoCompile();
+         obj->DoLink();
+         return 1;
       }
-      obj->librarian.Files(objFiles);
 
+      JavaScriptHelper::StashObject(duktapeContext, -1, "JsLib::Create", obj);
+
+      BuildGraph::MakeAbsolute(obj->compiler);
+      BuildGraph::MakeAbsolute(obj->librarian);
+
+      BuildGraph::Target target;
+      target.name = obj->librarian.Output();
+      target.timing = TimingHistory::LinkStep(obj->compiler.ObjDir(), obj->librarian.Output());
+      target.outputs.push_back(obj->librarian.Output());
+      target.compile = [obj] () { obj->DoCompile(); };
+      target.link = [obj] () { obj->DoLink(); };
 
-      obj->librarian.DependencyCheck(obj->compiler.DependencyCheck());
-      obj->librarian.Create();
+      buildGraph.Add(std::move(target));
 
       return 1;
    }
@@ -39,6 +39,9 @@ class JsLib {
 
    static duk_ret_t Create(duk_context* duktapeContext);
 
+   void DoCompile();
+   void DoLink();
+
 public:
 
    static void Register(duk_context* duktapeContext);
@@ -7,6 +7,12 @@
 
 #include "Librarian.h"
 #include "ToolChain.h"
+#include "Process.h"
+#include "Console.h"
+#include "SignatureStore.h"
+#include "TimingHistory.h"
+#include "Governor.h"
+#include "Vfs.h"
 
 #include <cstdlib>
 #include <algorithm>
@@ -16,40 +22,56 @@
 
 
 
-bool ActualLibrarian::NeedsRebuild () const
+bool ActualLibrarian::NeedsRebuild (const std::string& command)
 {
-   if (!librarian.DependencyCheck()) return true;
-   if (!std::filesystem::exists(librarian.Output())) return true;
+   Console::Span span{"check", "Check " + librarian.Output()};
 
-   const auto parentTime = std::filesystem::last_write_time(librarian.Output());
+   Signature sig;
+   sig.Add(command);
 
-   for (auto&& f : librarian.Files()) {
-      if (std::filesystem::last_write_time(f) > parentTime) return true;
-   }
+   for (auto&& f : librarian.Files()) sig.AddFile(f);
+
+   signature = sig.Value();
+
+   if (!librarian.DependencyCheck()) return true;
+   if (!Vfs::Exists(librarian.Output())) return true;
+
+   return SignatureStore::Instance().Changed(librarian.Output(), signature);
+}
 
-   return false;
+void ActualLibrarian::RecordSignature () const
+{
+   Vfs::Changed(librarian.Output());
+   SignatureStore::Instance().Record(librarian.Output(), signature);
 }
 
 
 
 
+std::string ActualLibrarianVisualStudio::CommandLine () const
+{
+   std::string command = "-NOLOGO ";
+   command += "-OUT:\"" + librarian.Output() + "\" ";
+   
+   for (auto&& f : librarian.Files()) command += "\"" + f + "\" ";
+
+   return command;
+}
+
 void ActualLibrarianVisualStudio::Create ()
 {
    if (librarian.Files().empty()) return;
    if (librarian.Output().empty()) throw std::runtime_error("Mising 'Output'");
 
-   if (!NeedsRebuild()) return;
+   if (!NeedsRebuild(CommandLine())) return;
 
-   std::cout << "\nCreating Lib (" << ToolChain::ToolChain() << " " << ToolChain::Platform() << ")" << std::endl;
+   Console::Write("\nCreating Lib (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
 
    librarian.DoBeforeLink();
 
    std::filesystem::create_directories(std::filesystem::path(librarian.Output()).remove_filename());
 
-   std::string command = "-NOLOGO ";
-   command += "-OUT:\"" + librarian.Output() + "\" ";
-   
-   for (auto&& f : librarian.Files()) command += "\"" + f + "\" ";
+   std::string command = CommandLine();
 
    if (command.size() > 8000) {
       auto rsp = std::filesystem::temp_directory_path() / std::filesystem::path(librarian.Output()).filename();
@@ -62,23 +84,38 @@ void ActualLibrarianVisualStudio::Create ()
       command.insert(0, "Lib ");
    }
 
-   std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-   int rc = std::system(cmd.c_str());
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(librarian.ObjDir(), librarian.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, librarian.Output(), command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Error creating lib");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
 }
 
 
 
 
 
+std::string ActualLibrarianEmscripten::CommandLine () const
+{
+   std::string command = "emcc -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 ";
+
+   command += "-o \"" + librarian.Output() + "\" ";
+
+   for (auto&& f : librarian.Files()) command += "\"" + f + "\" ";
+
+   return command;
+}
+
 void ActualLibrarianEmscripten::Create ()
 {
    if (librarian.Files().empty()) return;
    if (librarian.Output().empty()) throw std::runtime_error("Mising 'Output'");
 
-   if (!NeedsRebuild()) return;
+   if (!NeedsRebuild(CommandLine())) return;
 
-   std::cout << "\nCreating Lib (" << ToolChain::ToolChain() << ")" << std::endl;
+   Console::Write("\nCreating Lib (" + ToolChain::ToolChain() + ")");
 
    librarian.DoBeforeLink();
 
@@ -86,14 +123,59 @@ void ActualLibrarianEmscripten::Create ()
 
    std::filesystem::create_directories(std::filesystem::path(librarian.Output()).remove_filename());
 
-   std::string command = "emcc -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 ";
+   std::string command = CommandLine();
+
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(librarian.ObjDir(), librarian.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, librarian.Output(), command, ToolChain::Environment(), &usage);
+   if (rc != 0) throw std::runtime_error("Error creating lib");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
+}
+
 
-   command += "-o \"" + librarian.Output() + "\" ";
+
+
+
+// A thin archive only references the objects. Nothing is copied, the objects stay where the compiler put them.
+std::string ActualLibrarianAr::CommandLine () const
+{
+   const char* ar = std::getenv("AR");
+   std::string command = ar ? std::string{ar} : "ar";
+
+   command += " rcsT \"" + librarian.Output() + "\" ";
 
    for (auto&& f : librarian.Files()) command += "\"" + f + "\" ";
 
-   int rc = std::system(command.c_str());
+   return command;
+}
+
+void ActualLibrarianAr::Create ()
+{
+   if (librarian.Files().empty()) return;
+   if (librarian.Output().empty()) throw std::runtime_error("Mising 'Output'");
+
+   if (!NeedsRebuild(CommandLine())) return;
+
+   Console::Write("\nCreating Lib (" + ToolChain::ToolChain() + ")");
+
+   librarian.DoBeforeLink();
+
+   // ar adds to an existing archive. Members of removed files would stay.
+   if (std::filesystem::exists(librarian.Output())) std::filesystem::remove(librarian.Output());
+
+   std::filesystem::create_directories(std::filesystem::path(librarian.Output()).remove_filename());
+
+   std::string command = CommandLine();
+
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(librarian.ObjDir(), librarian.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, librarian.Output(), command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Error creating lib");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
 }
 
 
@@ -105,8 +187,10 @@ void Librarian::Create ()
    const auto toolChain = ToolChain::ToolChain();
    if (toolChain.substr(0, 4) == "MSVC") actualLibrarian.reset(new ActualLibrarianVisualStudio{*this});
    else if (toolChain == "EMSCRIPTEN") actualLibrarian.reset(new ActualLibrarianEmscripten{*this});
+   else if (toolChain == "GCC" || toolChain == "CLANG") actualLibrarian.reset(new ActualLibrarianAr{*this});
    else throw std::runtime_error("Unbekannte Toolchain: " + toolChain);
 
+   Console::Span span{"target", "Create " + Output()};
    actualLibrarian->Create();
 }
 
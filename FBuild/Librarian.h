@@ -17,8 +17,10 @@ class Librarian;
 class ActualLibrarian {
 protected:
    Librarian& librarian;
+   uint64_t   signature{0};
 
-   bool NeedsRebuild () const;
+   bool NeedsRebuild (const std::string& command);
+   void RecordSignature () const;
 
 public:
    ActualLibrarian (Librarian& librarian) : librarian{librarian} { }
@@ -32,6 +34,8 @@ public:
 
 
 class ActualLibrarianVisualStudio : public ActualLibrarian {
+   std::string CommandLine () const;
+
 public:
    ActualLibrarianVisualStudio (Librarian& librarian) : ActualLibrarian{librarian} { }
 
@@ -43,6 +47,8 @@ public:
 
 
 class ActualLibrarianEmscripten : public ActualLibrarian {
+   std::string CommandLine () const;
+
 public:
    ActualLibrarianEmscripten (Librarian& librarian) : ActualLibrarian{librarian} { }
 
@@ -52,10 +58,23 @@ public:
 
 
 
+class ActualLibrarianAr : public ActualLibrarian {
+   std::string CommandLine () const;
+
+public:
+   ActualLibrarianAr (Librarian& librarian) : ActualLibrarian{librarian} { }
+
+   void Create () override;
+};
+
+
+
+
 class Librarian {
    std::unique_ptr<ActualLibrarian> actualLibrarian;
 
    std::string              output;
+   std::string              objDir;
    std::vector<std::string> files;
    bool                     dependencyCheck;
    std::function<void()>    beforeLink;
@@ -64,6 +83,7 @@ public:
    Librarian () : actualLibrarian{new ActualLibrarian{*this}} { }
 
    void Output (std::string v)                       { output = std::move(v); }
+   void ObjDir (std::string v)                       { objDir = std::move(v); }
    void Files (std::vector<std::string> v)           { files = std::move(v); }
    void AddFile (const std::string& file)            { files.push_back(file); }
    void AddFiles (const std::vector<std::string>& f) { std::copy(f.cbegin(), f.cend(), back_inserter(files)); }
@@ -71,6 +91,7 @@ public:
    void BeforeLink (std::function<void()> v)         { beforeLink = std::move(v); }
 
    const std::string&              Output () const          { return output; }
+   const std::string&              ObjDir () const          { return objDir; }   // The one of the objects, if any
    const std::vector<std::string>& Files () const           { return files; }
    bool                            DependencyCheck () const { return dependencyCheck; }
    const std::function<void()>&    BeforeLink () const      { return beforeLink; }
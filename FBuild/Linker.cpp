@@ -7,6 +7,12 @@
 
 #include "Linker.h"
 #include "ToolChain.h"
+#include "Process.h"
+#include "Console.h"
+#include "SignatureStore.h"
+#include "TimingHistory.h"
+#include "Governor.h"
+#include "Vfs.h"
 
 #include <algorithm>
 #include <fstream>
@@ -26,47 +32,52 @@ inline bool Exe (const std::string& filename)
 
 
 
-bool ActualLinker::NeedsRebuild () const
+// A thin archive (ar T) only holds the names of the objects. Its contents don't change when they do.
+static bool ThinArchive (const std::string& file)
 {
-   if (!linker.DependencyCheck()) return true;
-   if (!std::filesystem::exists(linker.Output())) return true;
-
-   const auto parentTime = std::filesystem::last_write_time(linker.Output());
+   char magic[8] = {};
+   std::ifstream stream(file, std::ios::binary);
+   stream.read(magic, sizeof(magic));
+   return stream && std::string_view{magic, sizeof(magic)} == "!<thin>\n";
+}
 
-   for (auto&& file : linker.Files()) {
-      if (std::filesystem::last_write_time(file) > parentTime) return true;
-   }
+bool ActualLinker::NeedsRebuild (const std::string& command)
+{
+   Console::Span span{"check", "Check " + linker.Output()};
 
-   for (auto&& lib : linker.Libs()) {
-      for (auto&& path : linker.Libpath()) {
-         const auto file = path + "/" + lib;
-         if (std::filesystem::exists(file)) {
-            if (std::filesystem::last_write_time(file) > parentTime) return true;
-         }
-      }
-   }
+   Signature sig;
+   sig.Add(command);
 
-   return false;
-}
+   for (auto&& file : linker.Files()) sig.AddFile(file);
 
+   for (auto&& file : linker.LibFiles()) {
+      if (!Vfs::Exists(file)) continue;
 
+      sig.AddFile(file);
+      if (ThinArchive(file)) sig.Add(std::to_string(SignatureStore::Instance().Recorded(file)));   // Signature covers the objects
+   }
 
+   signature = sig.Value();
 
+   if (!linker.DependencyCheck()) return true;
+   if (!Vfs::Exists(linker.Output())) return true;
 
+   return SignatureStore::Instance().Changed(linker.Output(), signature);
+}
 
-void ActualLinkerVisualStudio::Link ()
+void ActualLinker::RecordSignature () const
 {
-   if (linker.Files().empty()) return;
-   if (linker.Output().empty()) throw std::runtime_error("Mising 'Output'");
+   Vfs::Changed(linker.Output());
+   SignatureStore::Instance().Record(linker.Output(), signature);
+}
 
-   if (!NeedsRebuild()) return;
 
-   std::cout << "\nLinking (" << ToolChain::ToolChain() << " " << ToolChain::Platform() << ")" << std::endl;
 
-   linker.DoBeforeLink();
 
-   std::filesystem::create_directories(std::filesystem::path(linker.Output()).remove_filename());
 
+
+std::string ActualLinkerVisualStudio::CommandLine () const
+{
    bool debug = linker.Build() == "Debug";
 
    std::string command = "-NOLOGO -LARGEADDRESSAWARE -STACK:3000000 ";
@@ -94,6 +105,24 @@ void ActualLinkerVisualStudio::Link ()
       if (env) command += std::string(env) + " ";
    }
 
+   return command;
+}
+
+void ActualLinkerVisualStudio::Link ()
+{
+   if (linker.Files().empty()) return;
+   if (linker.Output().empty()) throw std::runtime_error("Mising 'Output'");
+
+   if (!NeedsRebuild(CommandLine())) return;
+
+   Console::Write("\nLinking (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
+
+   linker.DoBeforeLink();
+
+   std::filesystem::create_directories(std::filesystem::path(linker.Output()).remove_filename());
+
+   std::string command = CommandLine();
+
    if (command.size() > 8000) {
       auto rsp = std::filesystem::temp_directory_path() / std::filesystem::path(linker.Output()).filename();
       rsp.replace_extension(".rsp");
@@ -105,9 +134,13 @@ void ActualLinkerVisualStudio::Link ()
       command.insert(0, "link ");
    }
 
-   std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-   int rc = std::system(cmd.c_str());
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(linker.ObjDir(), linker.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, linker.Output(), command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Link-Error");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
 }
 
 
@@ -126,7 +159,7 @@ std::vector<std::string> ActualLinkerEmscripten::LibsWithPath () const
       bool gotIt = false;
 
       for (auto&& path : linker.Libpath()) {
-         if (std::filesystem::exists(path + "/" + lib)) {
+         if (Vfs::Exists(path + "/" + lib)) {
             result.push_back(path + "/" + lib);
             gotIt = true;
          }
@@ -138,14 +171,34 @@ std::vector<std::string> ActualLinkerEmscripten::LibsWithPath () const
    return result;
 }
 
+std::string ActualLinkerEmscripten::CommandLine () const
+{
+   bool debug = linker.Build() == "Debug";
+
+
+   std::string command = "emcc -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 ";
+
+   if (debug) command += "-g -O1 -D_DEBUG ";
+   else command += "-O3 -DNDEBUG ";
+
+   if (!linker.Args().empty()) command += linker.Args() + " ";
+
+   command += "-o \"" + linker.Output() + "\" ";
+
+   for (auto&& f : linker.Files()) command += "\"" + f + "\" ";
+   for (auto&& f : LibsWithPath()) command += "\"" + f + "\" ";
+
+   return command;
+}
+
 void ActualLinkerEmscripten::Link ()
 {
    if (linker.Files().empty()) return;
    if (linker.Output().empty()) throw std::runtime_error("Mising 'Output'");
 
-   if (!NeedsRebuild()) return;
+   if (!NeedsRebuild(CommandLine())) return;
 
-   std::cout << "\nLinking (" << ToolChain::ToolChain() << ")" << std::endl;
+   Console::Write("\nLinking (" + ToolChain::ToolChain() + ")");
 
    linker.DoBeforeLink();
 
@@ -153,23 +206,104 @@ void ActualLinkerEmscripten::Link ()
 
    std::filesystem::create_directories(std::filesystem::path(linker.Output()).remove_filename());
 
+   std::string command = CommandLine();
+
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(linker.ObjDir(), linker.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, linker.Output(), command, ToolChain::Environment(), &usage);
+   if (rc != 0) throw std::runtime_error("Link-Error");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
+}
+
+
+
+
+
+
+
+
+std::vector<std::string> ActualLinkerGcc::LibsWithPath () const
+{
+   std::vector<std::string> result;
+
+   for (auto&& lib : linker.Libs()) {
+      auto it = std::find_if(linker.Libpath().cbegin(), linker.Libpath().cend(), [&lib] (const std::string& path) {
+         return Vfs::Exists(path + "/" + lib);
+      });
+
+      if (it != linker.Libpath().cend()) result.push_back("\"" + *it + "/" + lib + "\"");
+      else if (std::filesystem::path{lib}.has_extension()) result.push_back("-l:" + lib);   // libfoo.a, libfoo.so
+      else result.push_back("-l" + lib);                                                     // foo, searched by the linker
+   }
+
+   return result;
+}
+
+std::string ActualLinkerGcc::CommandLine () const
+{
    bool debug = linker.Build() == "Debug";
 
+   const char* cxx = std::getenv("CXX");
+   std::string command = cxx ? std::string{cxx} : ToolChain::ToolChain() == "CLANG" ? "clang++" : "g++";
 
-   std::string command = "emcc -s DISABLE_EXCEPTION_CATCHING=0 -s ALLOW_MEMORY_GROWTH=1 --memory-init-file 0 ";
+   command += " -pthread ";
 
-   if (debug) command += "-g -O1 -D_DEBUG ";
-   else command += "-O3 -DNDEBUG ";
+   if (ToolChain::Platform() == "x86") command += "-m32 ";
+   else command += "-m64 ";
+
+   if (debug) command += "-g ";
+
+   if (std::filesystem::path{linker.Output()}.extension() == ".so") command += "-shared ";
 
    if (!linker.Args().empty()) command += linker.Args() + " ";
 
    command += "-o \"" + linker.Output() + "\" ";
 
    for (auto&& f : linker.Files()) command += "\"" + f + "\" ";
-   for (auto&& f : LibsWithPath()) command += "\"" + f + "\" ";
+   for (auto&& f : linker.Libpath()) command += "-L\"" + f + "\" ";
+   for (auto&& f : LibsWithPath()) command += f + " ";
+
+   const char* env = std::getenv("FB_LINKER");
+   if (env) command += std::string(env) + " ";
 
-   int rc = std::system(command.c_str());
+   if (debug) {
+      env = std::getenv("FB_LINKER_DEBUG");
+      if (env) command += std::string(env) + " ";
+   }
+   else {
+      env = std::getenv("FB_LINKER_RELEASE");
+      if (env) command += std::string(env) + " ";
+   }
+
+   return command;
+}
+
+void ActualLinkerGcc::Link ()
+{
+   if (linker.Files().empty()) return;
+   if (linker.Output().empty()) throw std::runtime_error("Mising 'Output'");
+
+   if (!NeedsRebuild(CommandLine())) return;
+
+   Console::Write("\nLinking (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
+
+   linker.DoBeforeLink();
+
+   if (std::filesystem::exists(linker.Output())) std::filesystem::remove(linker.Output());
+
+   std::filesystem::create_directories(std::filesystem::path(linker.Output()).remove_filename());
+
+   std::string command = CommandLine();
+
+   Process::Usage usage;
+   const auto step = TimingHistory::LinkStep(linker.ObjDir(), linker.Output());
+   int rc = Governor::Instance().RunJob(Governor::Class::Link, step, linker.Output(), command, ToolChain::Environment(), &usage);
    if (rc != 0) throw std::runtime_error("Link-Error");
+
+   TimingHistory::Instance().Record(step, usage);
+   RecordSignature();
 }
 
 
@@ -179,13 +313,37 @@ void ActualLinkerEmscripten::Link ()
 
 
 
+std::vector<std::string> Linker::LibFiles () const
+{
+   const auto toolChain = ToolChain::ToolChain();
+   const bool gcc = toolChain == "GCC" || toolChain == "CLANG";
+
+   std::vector<std::string> result;
+
+   for (auto&& lib : libs) {
+      std::vector<std::string> names{lib};
+      if (gcc && !std::filesystem::path{lib}.has_extension()) {
+         names.push_back("lib" + lib + ".a");
+         names.push_back("lib" + lib + ".so");
+      }
+
+      for (auto&& path : libpath) {
+         for (auto&& name : names) result.push_back(path + "/" + name);
+      }
+   }
+
+   return result;
+}
+
 void Linker::Link ()
 {
    const auto toolChain = ToolChain::ToolChain();
    if (toolChain.substr(0, 4) == "MSVC") actualLinker.reset(new ActualLinkerVisualStudio{*this});
    else if (toolChain == "EMSCRIPTEN") actualLinker.reset(new ActualLinkerEmscripten{*this});
+   else if (toolChain == "GCC" || toolChain == "CLANG") actualLinker.reset(new ActualLinkerGcc{*this});
    else throw std::runtime_error("Unbekannte Toolchain: " + toolChain);
 
+   Console::Span span{"target", "Link " + Output()};
    actualLinker->Link();
 }
 
@@ -19,9 +19,11 @@ class Linker;
 
 class ActualLinker {
 protected:
-   Linker& linker;
+   Linker&  linker;
+   uint64_t signature{0};
 
-   bool NeedsRebuild () const;
+   bool NeedsRebuild (const std::string& command);
+   void RecordSignature () const;
 
 public:
    ActualLinker (Linker& linker) : linker{linker} { }
@@ -36,6 +38,8 @@ public:
 
 
 class ActualLinkerVisualStudio : public ActualLinker {
+   std::string CommandLine () const;
+
 public:
    ActualLinkerVisualStudio (Linker& linker) : ActualLinker{linker} { }
 
@@ -49,6 +53,7 @@ public:
 
 class ActualLinkerEmscripten : public ActualLinker {
    std::vector<std::string> LibsWithPath () const;
+   std::string CommandLine () const;
 
 public:
    ActualLinkerEmscripten (Linker& linker) : ActualLinker{linker} { }
@@ -62,11 +67,28 @@ public:
 
 
 
+class ActualLinkerGcc : public ActualLinker {
+   std::vector<std::string> LibsWithPath () const;
+   std::string CommandLine () const;
+
+public:
+   ActualLinkerGcc (Linker& linker) : ActualLinker{linker} { }
+
+   void Link () override;
+};
+
+
+
+
+
+
+
 class Linker {
    std::unique_ptr<ActualLinker> actualLinker;
 
    bool                     debug;
    std::string              output;
+   std::string              objDir;
    std::string              importLib;
    std::string              def;
    std::vector<std::string> libpath;
@@ -88,6 +110,7 @@ public:
       else throw std::runtime_error("Excpected <Release> or <Debug> for Build");
    }
    void Output (std::string v)                       { output = std::move(v); }
+   void ObjDir (std::string v)                       { objDir = std::move(v); }
    void ImportLib (std::string v)                    { importLib = std::move(v); }
    void Def (std::string v)                          { def = std::move(v); }
    void Libpath (std::vector<std::string> v)         { libpath = std::move(v); }
@@ -100,6 +123,7 @@ public:
 
    std::string                     Build () const           { return debug ? "Debug" : "Release"; }
    const std::string               Output () const          { return output; }
+   const std::string&              ObjDir () const          { return objDir; }   // The one of the objects, if any
    const std::string               ImportLib () const       { return importLib; }
    const std::string               Def () const             { return def; }
    const std::vector<std::string>& Libpath () const         { return libpath; }
@@ -111,6 +135,9 @@ public:
 
    void DoBeforeLink () { if (beforeLink) beforeLink(); }
 
+   // Every file a library might be, in every library path. For GCC/CLANG, "foo" is libfoo.a or libfoo.so (-lfoo).
+   std::vector<std::string> LibFiles () const;
+
    void Link ();
 };
 
@@ -7,17 +7,29 @@
 
 #include "Moc.h"
 #include "MemoryMappedFile.h"
+#include "JobSystem.h"
+#include "Process.h"
+#include "Console.h"
+#include "SignatureStore.h"
+#include "TimingHistory.h"
+#include "Governor.h"
+#include "Vfs.h"
 
 #include <filesystem>
 #include <mutex>
-#include <thread>
 #include <atomic>
 #include <iostream>
 #include <fstream>
 
 Moc::Moc (const std::string& qtBinDirectory)
 {
-   auto exe = std::filesystem::path{qtBinDirectory} / "moc.exe";
+#ifdef _WIN32
+   const char* executable = "moc.exe";
+#else
+   const char* executable = "moc";
+#endif
+
+   auto exe = std::filesystem::path{qtBinDirectory} / executable;
    if (!std::filesystem::exists(exe)) throw std::runtime_error{exe.string() + " doesn't exist"};
    exe.make_preferred();
    mocExe_ = exe.string();
@@ -30,61 +42,58 @@ void Moc::Compile()
 
    if (!std::filesystem::exists(outDir_)) std::filesystem::create_directories(outDir_);
 
-   std::vector<std::string> todo{files_};
    std::atomic<uint32_t> errors{0};
    std::mutex mutex{};
+   JobGroup jobs{};
+
+   const int64_t priority = JobSystem::CurrentPriority();
 
-   const auto threadFunction = [&] () {
-      std::string file{};
-      std::string outFile{};
-      std::string command{};
+   for (auto it = files_.rbegin(); it != files_.rend(); ++it) {
+      const auto expected = static_cast<int64_t>(TimingHistory::Instance().Expected(OutFile(*it)));
 
-      for (;;) {
+      jobs.Add([&, file = *it] () {
          try {
+            const std::string outFile = OutFile(file);
+
             {
                std::lock_guard guard{mutex};
-               const auto it = todo.rbegin();
-               if (it == todo.rend()) break;
-               file = (*it);
-               todo.pop_back();
-
-               outFile = OutFile(file);
                outFiles_.emplace_back(outFile);
             }
 
-            if (!NeedsRebuild(file, outFile)) continue;
+            uint64_t signature = 0;
+            if (!NeedsRebuild(file, outFile, signature)) return;
 
             if (!NeedsMoc(file)) {
                std::ofstream emptyFile{outFile, std::ofstream::trunc};
+               SignatureStore::Instance().Record(outFile, signature);
             }
             else {
-               std::cout << "Moc: " << file << std::endl;
+               Console::Write("Moc: " + file);
 
-               command = mocExe_ + " -o \"" + outFile + "\" ";
+               std::string command = mocExe_ + " -o \"" + outFile + "\" ";
                command += file;
-               int rc = std::system(command.c_str());
+               Process::Usage usage;
+               int rc = Governor::Instance().RunJob(Governor::Class::Compile, outFile, file, command, Process::CurrentEnvironment(), &usage);
                if (rc != 0) ++errors;
+               else {
+                  TimingHistory::Instance().Record(outFile, usage);
+                  SignatureStore::Instance().Record(outFile, signature);
+               }
             }
 
          }
          catch (std::exception& e) {
-            std::cout << e.what() << std::endl;
+            Console::Write(e.what());
             ++errors;
          }
          catch (...) {
             ++errors;
          }
-      }
-   };
-
-   size_t threadCount = std::thread::hardware_concurrency();
-   if (!threadCount) threadCount = 2;
-   if (threadCount > todo.size()) threadCount = todo.size();
-
-   std::vector<std::thread> threads;
-   for (size_t i = 0; i < threadCount; ++i) threads.emplace_back(std::thread{threadFunction});
+      }, priority + expected);
+   }
 
-   for (auto&& thread : threads) thread.join();
+   jobs.Wait();
+   Vfs::Changed(outDir_);
 
    if (errors) throw std::runtime_error("Moc Error");
 
@@ -108,12 +117,14 @@ std::string Moc::OutFile(const std::string& inFile) const
    return outfile.string();
 }
 
-bool Moc::NeedsRebuild(const std::string& inFile, const std::string& outFile) const
+bool Moc::NeedsRebuild(const std::string& inFile, const std::string& outFile, uint64_t& signature) const
 {
+   signature = Signature{}.Add(mocExe_).AddFile(inFile).Value();
+
    if (!dependencyCheck_) return true;
-   if (!std::filesystem::exists(outFile)) return true;
+   if (!Vfs::Exists(outFile)) return true;
 
-   return std::filesystem::last_write_time(outFile) < std::filesystem::last_write_time(inFile);
+   return SignatureStore::Instance().Changed(outFile, signature);
 }
 
 bool Moc::NeedsMoc(const std::string& file) const
@@ -0,0 +1,102 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "PathTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+
+
+
+namespace
+{
+   // The names are looked up without a lock. Thus the table never moves: it's made of pages, which are allocated once.
+   constexpr size_t pageBits  = 12;
+   constexpr size_t pageSize  = size_t{1} << pageBits;
+   constexpr size_t pageCount = size_t{1} << 16;
+
+   constexpr size_t blockSize = 64 * 1024;
+
+   std::shared_mutex                                   mutex;
+   std::unordered_map<std::string_view, PathTable::Id> ids;
+   std::unique_ptr<std::string_view[]>                 pages[pageCount];
+   std::atomic<PathTable::Id>                          count{0};
+
+   // The strings are packed into large blocks instead of one allocation each.
+   std::vector<std::unique_ptr<char[]>> blocks;
+   char*                                next{nullptr};
+   size_t                               left{0};
+
+   std::string_view Store (std::string_view text)
+   {
+      if (text.size() > left) {
+         const size_t size = std::max(blockSize, text.size());
+         blocks.emplace_back(new char[size]);
+         next = blocks.back().get();
+         left = size;
+      }
+
+      std::memcpy(next, text.data(), text.size());
+      const std::string_view stored{next, text.size()};
+
+      next += text.size();
+      left -= text.size();
+
+      return stored;
+   }
+}
+
+
+
+
+namespace PathTable
+{
+   Id Intern (std::string_view path)
+   {
+      {
+         std::shared_lock lock(mutex);
+         auto it = ids.find(path);
+         if (it != ids.end()) return it->second;
+      }
+
+      std::unique_lock lock(mutex);
+      auto it = ids.find(path);
+      if (it != ids.end()) return it->second;
+
+      const Id id = count.load(std::memory_order_relaxed);
+      if ((id >> pageBits) >= pageCount) throw std::runtime_error("Too many paths");
+
+      auto& page = pages[id >> pageBits];
+      if (!page) page.reset(new std::string_view[pageSize]);
+
+      const std::string_view stored = Store(path);
+      page[id & (pageSize - 1)] = stored;
+      ids.emplace(stored, id);
+
+      count.store(id + 1, std::memory_order_release);
+
+      return id;
+   }
+
+   std::string_view Name (Id id)
+   {
+      return pages[id >> pageBits][id & (pageSize - 1)];
+   }
+
+   size_t Size ()
+   {
+      return count.load(std::memory_order_acquire);
+   }
+}
@@ -0,0 +1,29 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+
+// Every path the dependency scan comes across is stored once for the whole run and referenced by a 32 bit id.
+// The same string always gets the same id. Ids and names stay valid until the process ends.
+// Ids are handed out in order of appearance, thus they differ from run to run: never persist them, and sort by Name() where the order matters.
+namespace PathTable
+{
+   using Id = uint32_t;
+
+   constexpr Id None = ~Id{0};
+
+   Id Intern (std::string_view path);
+   std::string_view Name (Id id);
+
+   // All ids are less than Size()
+   size_t Size ();
+}
@@ -0,0 +1,205 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Process.h"
+#include "Executor.h"
+#include "Console.h"
+
+#include <filesystem>
+#include <stdexcept>
+#include <cstring>
+#include <chrono>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+extern char** environ;
+#endif
+
+
+
+namespace Process {
+
+#ifdef _WIN32
+   static constexpr char pathSeparator = ';';
+#else
+   static constexpr char pathSeparator = ':';
+#endif
+
+   static bool SameName (const std::string& entry, const std::string& name)
+   {
+      if (entry.size() <= name.size() || entry[name.size()] != '=') return false;
+
+#ifdef _WIN32
+      return _strnicmp(entry.c_str(), name.c_str(), name.size()) == 0;
+#else
+      return entry.compare(0, name.size(), name) == 0;
+#endif
+   }
+
+   static std::string Variable (const std::vector<std::string>& environment, const std::string& name)
+   {
+      for (auto&& entry : environment) {
+         if (SameName(entry, name)) return entry.substr(name.size() + 1);
+      }
+
+      return std::string{};
+   }
+
+   std::vector<std::string> Split (const std::string& commandLine)
+   {
+      std::vector<std::string> result;
+
+      std::string arg;
+      bool quoted = false;
+      bool inArg = false;
+
+      for (char ch : commandLine) {
+         if (ch == '"') {
+            quoted = !quoted;
+            inArg = true;
+         }
+         else if ((ch == ' ' || ch == '\t') && !quoted) {
+            if (inArg) result.push_back(arg);
+            arg.clear();
+            inArg = false;
+         }
+         else {
+            arg += ch;
+            inArg = true;
+         }
+      }
+
+      if (inArg) result.push_back(arg);
+
+      return result;
+   }
+
+   std::string FindExecutable (const std::string& name, const std::vector<std::string>& environment)
+   {
+#ifdef _WIN32
+      const std::vector<std::string> extensions{"", ".exe", ".bat", ".cmd"};
+#else
+      const std::vector<std::string> extensions{""};
+#endif
+
+      const auto probe = [&extensions] (const std::filesystem::path& file) -> std::string {
+         for (auto&& extension : extensions) {
+            auto candidate = file;
+            candidate += extension;
+
+            std::error_code ec;
+            if (std::filesystem::is_regular_file(candidate, ec)) return candidate.make_preferred().string();
+         }
+         return std::string{};
+      };
+
+      const std::filesystem::path file{name};
+      if (file.has_parent_path()) {
+         auto found = probe(file);
+         if (!found.empty()) return found;
+      }
+      else {
+         const auto path = Variable(environment, "PATH");
+
+         size_t begin = 0;
+         while (begin <= path.size()) {
+            auto end = path.find(pathSeparator, begin);
+            if (end == std::string::npos) end = path.size();
+
+            const auto directory = path.substr(begin, end - begin);
+            if (!directory.empty()) {
+               auto found = probe(std::filesystem::path{directory} / file);
+               if (!found.empty()) return found;
+            }
+
+            begin = end + 1;
+         }
+      }
+
+      throw std::runtime_error("Unable to find " + name);
+   }
+
+#ifdef _WIN32
+
+   std::vector<std::string> CurrentEnvironment ()
+   {
+      std::vector<std::string> result;
+
+      char* block = ::GetEnvironmentStringsA();
+      if (!block) return result;
+
+      for (const char* entry = block; *entry; entry += std::strlen(entry) + 1) {
+         if (*entry != '=') result.emplace_back(entry);  // Skip the per drive directories, e.g. "=C:=C:\..."
+      }
+
+      ::FreeEnvironmentStringsA(block);
+
+      return result;
+   }
+
+#else
+
+   std::vector<std::string> CurrentEnvironment ()
+   {
+      std::vector<std::string> result;
+      for (char** entry = environ; entry && *entry; ++entry) result.emplace_back(*entry);
+      return result;
+   }
+
+#endif
+
+   static std::chrono::milliseconds jobTimeout{0};
+
+   void JobTimeout (std::chrono::milliseconds timeout)
+   {
+      jobTimeout = timeout;
+   }
+
+   int Run (const std::string& commandLine, const std::vector<std::string>& environment, std::string* output, Usage* usage)
+   {
+      auto execution = Executor::Instance().Start(commandLine, environment, output != nullptr);
+      execution->Wait();
+
+      if (output) *output += execution->Output();
+      if (usage) *usage = execution->Usage();
+
+      return execution->ExitCode();
+   }
+
+   std::shared_ptr<Execution> StartJob (const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment)
+   {
+      const auto start = std::chrono::steady_clock::now();
+
+      std::shared_ptr<Execution> execution;
+      try {
+         execution = Executor::Instance().Start(commandLine, environment, true, jobTimeout);
+      }
+      catch (std::exception& e) {
+         Console::Job(name, commandLine, start, -1, std::string{e.what()} + "\n");
+         throw;
+      }
+
+      // Not the execution itself, it would own its continuation.
+      execution->Then([name, commandLine, start, done = execution.get()] () {
+         Console::Job(name, commandLine, start, done->ExitCode(), done->Output());
+      });
+
+      return execution;
+   }
+
+   int RunJob (const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment, Usage* usage)
+   {
+      auto execution = StartJob(name, commandLine, environment);
+      execution->Wait();
+
+      if (usage) *usage = execution->Usage();
+
+      return execution->ExitCode();
+   }
+}
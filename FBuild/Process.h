@@ -0,0 +1,51 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+
+class Execution;
+
+
+// Starts programs directly (CreateProcess/posix_spawn) instead of going through a shell. They run on the Executor.
+namespace Process {
+
+   // What running the program took
+   struct Usage {
+      uint64_t milliseconds{0};
+      uint64_t peakMemory{0};    // Bytes, the peak working set (resident set size) of the program
+   };
+
+   // The first (optionally quoted) word of the command line is searched in the PATH of the given environment.
+   // The environment consists of "NAME=value" entries. Returns the exit code of the program.
+   // With an output, stdout and stderr of the program are captured there instead of going to the console.
+   int Run (const std::string& commandLine, const std::vector<std::string>& environment, std::string* output = nullptr, Usage* usage = nullptr);
+
+   // Runs the program as one job of the build: Its output is written to the console at once when it's finished,
+   // thus it doesn't interleave with other jobs. It's also added to the job log (see Console).
+   int RunJob (const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment, Usage* usage = nullptr);
+
+   // Like RunJob, without waiting for the program. Its output is written once it's done, before the continuations run.
+   std::shared_ptr<Execution> StartJob (const std::string& name, const std::string& commandLine, const std::vector<std::string>& environment);
+
+   // Jobs running longer are killed (zero: no limit).
+   void JobTimeout (std::chrono::milliseconds timeout);
+
+   // Splits a command line into its arguments, the way the Windows runtime does (quotes group, and are removed).
+   std::vector<std::string> Split (const std::string& commandLine);
+
+   std::string FindExecutable (const std::string& name, const std::vector<std::string>& environment);
+
+   std::vector<std::string> CurrentEnvironment ();
+}
+
@@ -8,6 +8,9 @@
 #include "ResourceCompiler.h"
 #include "CppDepends.h"
 #include "ToolChain.h"
+#include "Process.h"
+#include "Console.h"
+#include "Vfs.h"
 
 #include <algorithm>
 #include <cstdlib>
@@ -27,7 +30,7 @@ inline std::string Inc(const std::vector<std::string>& includes)
 
 inline uint64_t LastWriteTime (const std::filesystem::path& file)
 {
-   return std::chrono::duration_cast<std::chrono::seconds>(std::filesystem::last_write_time(file).time_since_epoch()).count();
+   return std::chrono::duration_cast<std::chrono::seconds>(Vfs::LastWriteTime(file).time_since_epoch()).count();
 }
 
 
@@ -43,9 +46,12 @@ std::string ResourceCompiler::Outfile (const std::string& infile) const
 bool ResourceCompiler::NeedsRebuild (const std::string& infile, const std::string& outfile) const
 {
    if (!dependencyCheck) return true;
-   if (!std::filesystem::exists(outfile)) return true;
+   if (!Vfs::Exists(outfile)) return true;
 
-   CppDepends dep(infile);
+   CppDepends::Settings settings;
+   for (auto&& include : includes) settings.AddIncludePath(include);
+
+   CppDepends dep(infile, settings);
    return LastWriteTime(outfile) < dep.MaxTime(); 
 }
 
@@ -61,13 +67,14 @@ void ResourceCompiler::Compile () const
    std::for_each(files.cbegin(), files.cend(), [&] (const std::string& file) {
       std::string outfile = Outfile(file);
       if (NeedsRebuild(file, outfile)) {
-         if (++count) std::cout << "\nCompiling Resources (" << ToolChain::ToolChain() << " " << ToolChain::Platform() << ")" << std::endl;
+         if (++count) Console::Write("\nCompiling Resources (" + ToolChain::ToolChain() + " " + ToolChain::Platform() + ")");
          if (std::filesystem::exists(outfile)) std::filesystem::remove(outfile);
          std::string command = "RC -nologo " + Inc(includes) + " -fo\"" + outfile + "\" " + file;
 
-         std::string cmd = ToolChain::SetEnvBatchCall() + " & " + command;
-         int rc = std::system(cmd.c_str());
+         int rc = Process::RunJob(file, command, ToolChain::Environment());
          if (rc != 0) throw std::runtime_error("Error compiling resources");
+
+         Vfs::Changed(outfile);
       }
    });
 }
@@ -0,0 +1,251 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "SignatureStore.h"
+#include "Hash.h"
+#include "MemoryMappedFile.h"
+#include "BinaryStream.h"
+#include "Vfs.h"
+#include "Stats.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+
+
+namespace
+{
+   // FileHash() per PathTable::Id. The pages are allocated once and never move, thus they're read without a lock.
+   struct Memo {
+      std::atomic<uint64_t> hash{0};
+      std::atomic<uint64_t> generation{0};   // Of the Vfs, zero: not hashed yet
+   };
+
+   constexpr size_t pageBits  = 12;
+   constexpr size_t pageSize  = size_t{1} << pageBits;
+   constexpr size_t pageCount = size_t{1} << 16;
+
+   std::atomic<Memo*> memos[pageCount];
+
+   Memo& MemoOf (PathTable::Id file)
+   {
+      auto& page = memos[file >> pageBits];
+
+      Memo* memo = page.load(std::memory_order_acquire);
+      if (!memo) {
+         auto fresh = std::make_unique<Memo[]>(pageSize);
+         if (page.compare_exchange_strong(memo, fresh.get(), std::memory_order_acq_rel)) memo = fresh.release();
+      }
+
+      return memo[file & (pageSize - 1)];
+   }
+}
+
+
+
+Signature& Signature::Add (std::string_view text)
+{
+   const uint64_t length = text.size();
+   data_.append(reinterpret_cast<const char*>(&length), sizeof(length));
+   data_.append(text);
+   return *this;
+}
+
+Signature& Signature::AddFile (const std::string& file)
+{
+   const uint64_t hash = SignatureStore::Instance().FileHash(file);
+   data_.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+   return *this;
+}
+
+Signature& Signature::AddFile (PathTable::Id file)
+{
+   const uint64_t hash = SignatureStore::Instance().FileHash(file);
+   data_.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+   return *this;
+}
+
+uint64_t Signature::Value () const
+{
+   return Hash64(data_);
+}
+
+
+
+
+SignatureStore& SignatureStore::Instance ()
+{
+   static SignatureStore signatureStore;
+   return signatureStore;
+}
+
+SignatureStore::~SignatureStore ()
+{
+   try {
+      Save();
+   }
+   catch (std::exception& e) {
+      std::cerr << "Error on writing signatures " << file_ << ": " << e.what() << std::endl;
+   }
+}
+
+std::string SignatureStore::Key (const std::string& file)
+{
+   return std::filesystem::absolute(file).lexically_normal().make_preferred().string();
+}
+
+void SignatureStore::Load (const std::filesystem::path& file)
+{
+   std::lock_guard lock(mutex_);
+
+   file_ = std::filesystem::absolute(file);
+   files_.clear();
+   signatures_.clear();
+   dirty_ = false;
+
+   std::ifstream stream(file_.string(), std::ifstream::in | std::ifstream::binary);
+   if (!stream.good()) return;
+
+   uint32_t version = 0;
+   stream > version;
+   if (version != version_) return;
+
+   size_t count = 0;
+   stream > count;
+   for (size_t i = 0; i < count && stream.good(); ++i) {
+      std::string name;
+      FileEntry entry;
+      stream > name > entry.time > entry.size > entry.hash;
+      files_.emplace(std::move(name), entry);
+   }
+
+   stream > count;
+   for (size_t i = 0; i < count && stream.good(); ++i) {
+      std::string name;
+      uint64_t signature;
+      stream > name > signature;
+      signatures_.emplace(std::move(name), signature);
+   }
+
+   if (!stream.good()) {
+      std::cerr << "Ignoring damaged signatures " << file_ << std::endl;
+      files_.clear();
+      signatures_.clear();
+   }
+}
+
+void SignatureStore::Save ()
+{
+   std::lock_guard lock(mutex_);
+
+   if (!dirty_ || file_.empty()) return;
+
+   auto tmp = file_;
+   tmp += ".tmp";
+
+   {
+      std::ofstream stream(tmp.string(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+      if (!stream.good()) throw std::runtime_error("Unable to open " + tmp.string());
+
+      stream < version_;
+
+      stream < files_.size();
+      for (auto&& [name, entry] : files_) stream < name < entry.time < entry.size < entry.hash;
+
+      stream < signatures_.size();
+      for (auto&& [name, signature] : signatures_) stream < name < signature;
+
+      if (!stream.good()) throw std::runtime_error("Unable to write " + tmp.string());
+   }
+
+   std::filesystem::rename(tmp, file_);
+   dirty_ = false;
+}
+
+uint64_t SignatureStore::FileHash (const std::string& file)
+{
+   const auto key = Key(file);
+
+   if (!Vfs::IsFile(key)) return 0;
+   const auto time = Vfs::LastWriteTime(key);
+   const auto size = Vfs::FileSize(key);
+
+   const uint64_t ticks = static_cast<uint64_t>(time.time_since_epoch().count());
+
+   {
+      std::lock_guard lock(mutex_);
+      auto it = files_.find(key);
+      if (it != files_.end() && it->second.time == ticks && it->second.size == size) return it->second.hash;
+   }
+
+   Stats::Add(Stats::Counter::FilesHashed);
+   Stats::Add(Stats::Counter::BytesHashed, size);
+
+   uint64_t hash = Hash64(nullptr, 0);
+   if (size) {
+      const MemoryMappedFile mmf{key};
+      hash = Hash64(mmf.CBegin(), mmf.Size());
+   }
+
+   std::lock_guard lock(mutex_);
+   files_[key] = FileEntry{ticks, size, hash};
+   dirty_ = true;
+
+   return hash;
+}
+
+uint64_t SignatureStore::FileHash (PathTable::Id file)
+{
+   const uint64_t generation = Vfs::Generation();
+
+   Memo& memo = MemoOf(file);
+   if (memo.generation.load(std::memory_order_acquire) == generation) return memo.hash.load(std::memory_order_relaxed);
+
+   const uint64_t hash = FileHash(std::string{PathTable::Name(file)});
+
+   memo.hash.store(hash, std::memory_order_relaxed);
+   memo.generation.store(generation, std::memory_order_release);
+
+   return hash;
+}
+
+bool SignatureStore::Known (const std::string& output) const
+{
+   const auto key = Key(output);
+
+   std::lock_guard lock(mutex_);
+   return signatures_.find(key) != signatures_.end();
+}
+
+bool SignatureStore::Changed (const std::string& output, uint64_t signature) const
+{
+   const auto key = Key(output);
+
+   std::lock_guard lock(mutex_);
+   auto it = signatures_.find(key);
+   return it == signatures_.end() || it->second != signature;
+}
+
+uint64_t SignatureStore::Recorded (const std::string& output) const
+{
+   const auto key = Key(output);
+
+   std::lock_guard lock(mutex_);
+   auto it = signatures_.find(key);
+   return it == signatures_.end() ? 0 : it->second;
+}
+
+void SignatureStore::Record (const std::string& output, uint64_t signature)
+{
+   const auto key = Key(output);
+
+   std::lock_guard lock(mutex_);
+   signatures_[key] = signature;
+   dirty_ = true;
+}
@@ -0,0 +1,79 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include "PathTable.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <filesystem>
+#include <mutex>
+
+
+
+// The signature of an output is a hash over everything it was built from: the command line and the contents of all inputs.
+// An output is rebuilt only if its signature changed, thus touching a file (e.g. by switching branches) doesn't rebuild anything.
+class Signature {
+public:
+   Signature& Add (std::string_view text);
+   Signature& AddFile (const std::string& file);
+   Signature& AddFile (PathTable::Id file);
+
+   uint64_t Value () const;
+
+private:
+   std::string data_;
+};
+
+
+
+// The signatures of all outputs, and the hashes of all inputs (rehashed only if their size or timestamp changed).
+// Loaded when FBuild starts and written back when it exits.
+class SignatureStore {
+public:
+   static SignatureStore& Instance ();
+
+   ~SignatureStore ();
+
+   void Load (const std::filesystem::path& file);
+   void Save ();
+
+   // Zero, if the file doesn't exist.
+   uint64_t FileHash (const std::string& file);
+
+   // The same, looked up once per file and Vfs::Generation(). Without a lock afterwards, for the headers every unit includes.
+   uint64_t FileHash (PathTable::Id file);
+
+   bool Known (const std::string& output) const;
+   bool Changed (const std::string& output, uint64_t signature) const;
+   void Record (const std::string& output, uint64_t signature);
+
+   // The recorded signature of the output, zero if there's none.
+   uint64_t Recorded (const std::string& output) const;
+
+private:
+   struct FileEntry {
+      uint64_t time;
+      uint64_t size;
+      uint64_t hash;
+   };
+
+   static constexpr uint32_t version_ = 1;
+
+   mutable std::mutex                         mutex_;
+   std::filesystem::path                      file_;
+   std::unordered_map<std::string, FileEntry> files_;
+   std::unordered_map<std::string, uint64_t>  signatures_;
+   bool                                       dirty_{false};
+
+   SignatureStore () { }
+
+   static std::string Key (const std::string& file);
+};
+
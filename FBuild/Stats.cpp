@@ -0,0 +1,104 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Stats.h"
+
+#include <cstdio>
+
+
+
+namespace
+{
+   struct Info {
+      const char* name;
+      bool        time;
+   };
+
+   const Info infos[] = {
+      {"vfs.queries",              false},
+      {"vfs.directoryReads",       false},
+      {"vfs.statCalls",            false},
+
+      {"depends.units",            false},
+      {"depends.databaseHits",     false},
+      {"depends.databaseMisses",   false},
+      {"depends.closureHits",      false},
+      {"depends.closureMisses",    false},
+      {"depends.lookupHits",       false},
+      {"depends.lookupMisses",     false},
+      {"depends.filesParsed",      false},
+      {"depends.bytesScanned",     false},
+      {"depends.time",             true},
+
+      {"check.units",              false},
+      {"check.upToDate",           false},
+      {"check.missingObject",      false},
+      {"check.emptyObject",        false},
+      {"check.olderObject",        false},
+      {"check.signatureChanged",   false},
+      {"check.time",               true},
+
+      {"signatures.filesHashed",   false},
+      {"signatures.bytesHashed",   false},
+
+      {"process.spawns",           false},
+      {"process.time",             true},
+      {"governor.waits",           false},
+      {"governor.waitTime",        true},
+
+      {"script.time",              true},
+   };
+
+   static_assert(sizeof(infos) / sizeof(infos[0]) == static_cast<size_t>(Stats::Counter::Count), "One name per counter");
+}
+
+
+
+namespace Stats
+{
+   std::atomic<bool> enabled{false};
+   Slot slots[static_cast<size_t>(Counter::Count)];
+
+   void Enable (bool v)
+   {
+      enabled = v;
+   }
+
+   bool Enabled ()
+   {
+      return enabled;
+   }
+
+   std::vector<std::pair<std::string, double>> All ()
+   {
+      std::vector<std::pair<std::string, double>> result;
+
+      for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i) {
+         const auto value = static_cast<double>(slots[i].value.load(std::memory_order_relaxed));
+         result.emplace_back(infos[i].name, infos[i].time ? value / 1000 : value);
+      }
+
+      return result;
+   }
+
+   std::string Report ()
+   {
+      std::string report = "\nStatistics (times in ms, summed over all threads)\n";
+
+      for (size_t i = 0; i < static_cast<size_t>(Counter::Count); ++i) {
+         const auto value = slots[i].value.load(std::memory_order_relaxed);
+
+         char line[128];
+         if (infos[i].time) std::snprintf(line, sizeof(line), "   %-26s %12.1f\n", infos[i].name, value / 1000.0);
+         else std::snprintf(line, sizeof(line), "   %-26s %12llu\n", infos[i].name, static_cast<unsigned long long>(value));
+
+         report += line;
+      }
+
+      return report;
+   }
+}
@@ -0,0 +1,102 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+
+// Counters and timers of the hot paths, to tell where the time of a build goes: I/O, scanning, hashing or the script.
+// Off by default (--stats or Stats(true) in the script). Then counting costs one relaxed load and a branch.
+// Every counter has its own cache line, thus the threads don't fight over them.
+namespace Stats
+{
+   enum class Counter {
+      VfsQueries,             // Status, time or size of a file
+      VfsDirectoryReads,      // Listings read from the file system
+      VfsStatCalls,           // Types, times and sizes fetched from the file system
+
+      DependsUnits,           // CppDepends of a translation unit
+      DependsDatabaseHits,
+      DependsDatabaseMisses,
+      DependsClosureHits,
+      DependsClosureMisses,
+      DependsLookupHits,      // Includes resolved from the cache
+      DependsLookupMisses,
+      DependsFilesParsed,
+      DependsBytesScanned,
+      DependsTime,
+
+      CheckUnits,             // Translation units checked by CppOutOfDate
+      CheckUpToDate,
+      CheckMissingObject,
+      CheckEmptyObject,
+      CheckOlderObject,       // No signature yet, and the object is older than one of its dependencies
+      CheckSignatureChanged,
+      CheckTime,
+
+      FilesHashed,
+      BytesHashed,
+
+      ProcessSpawns,
+      ProcessTime,
+      GovernorWaits,          // Processes which had to wait for a slot or memory (see Governor)
+      GovernorWaitTime,
+
+      ScriptTime,
+
+      Count
+   };
+
+   struct alignas(64) Slot {
+      std::atomic<uint64_t> value{0};
+   };
+
+   extern std::atomic<bool> enabled;
+   extern Slot slots[static_cast<size_t>(Counter::Count)];
+
+   inline void Add (Counter counter, uint64_t value = 1)
+   {
+      if (enabled.load(std::memory_order_relaxed)) slots[static_cast<size_t>(counter)].value.fetch_add(value, std::memory_order_relaxed);
+   }
+
+   void Enable (bool v);
+   bool Enabled ();
+
+   // Adds the time (microseconds) from construction to destruction to a ...Time counter.
+   class Timer {
+   public:
+      explicit Timer (Counter counter) : counter_{counter}, running_{enabled.load(std::memory_order_relaxed)}
+      {
+         if (running_) start_ = std::chrono::steady_clock::now();
+      }
+
+      ~Timer ()
+      {
+         if (running_) Add(counter_, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count());
+      }
+
+      Timer (const Timer&) = delete;
+      Timer& operator= (const Timer&) = delete;
+
+   private:
+      Counter                               counter_;
+      bool                                  running_;
+      std::chrono::steady_clock::time_point start_;
+   };
+
+   // Name and value of every counter. Times in milliseconds, summed over all threads.
+   std::vector<std::pair<std::string, double>> All ();
+
+   std::string Report ();
+}
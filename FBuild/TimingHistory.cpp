@@ -0,0 +1,149 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "TimingHistory.h"
+#include "BinaryStream.h"
+
+#include <fstream>
+#include <iostream>
+
+
+
+static const char* fileName = "FBuild.timings";
+
+
+
+TimingHistory& TimingHistory::Instance ()
+{
+   static TimingHistory timingHistory;
+   return timingHistory;
+}
+
+TimingHistory::~TimingHistory ()
+{
+   try {
+      Save();
+   }
+   catch (std::exception& e) {
+      std::cerr << "Error on writing timings: " << e.what() << std::endl;
+   }
+}
+
+TimingHistory::Directory& TimingHistory::Find (const std::filesystem::path& output)
+{
+   const auto path = std::filesystem::absolute(output).lexically_normal().parent_path();
+
+   auto it = directories_.find(path.string());
+   if (it != directories_.end()) return it->second;
+
+   Directory& directory = directories_[path.string()];
+
+   std::ifstream stream((path / fileName).string(), std::ifstream::in | std::ifstream::binary);
+   if (!stream.good()) return directory;
+
+   uint32_t version = 0;
+   stream > version;
+   if (version != version_) return directory;
+
+   size_t count = 0;
+   stream > count;
+   for (size_t i = 0; i < count && stream.good(); ++i) {
+      std::string name;
+      Entry entry;
+      stream > name > entry.milliseconds > entry.peakMemory;
+      directory.entries.emplace(std::move(name), entry);
+   }
+
+   if (!stream.good()) {
+      std::cerr << "Ignoring damaged timings " << (path / fileName) << std::endl;
+      directory.entries.clear();
+   }
+
+   for (auto&& [name, entry] : directory.entries) directory.total += entry.milliseconds;
+
+   return directory;
+}
+
+std::string TimingHistory::LinkStep (const std::string& objDir, const std::string& output)
+{
+   const auto directory = objDir.empty() ? std::filesystem::current_path() : std::filesystem::absolute(objDir);
+   return (directory / std::filesystem::path{output}.filename()).string();
+}
+
+void TimingHistory::Record (const std::string& output, const Process::Usage& usage)
+{
+   const auto name = std::filesystem::path{output}.filename().string();
+
+   std::lock_guard lock(mutex_);
+   Directory& directory = Find(output);
+
+   // Averaged with the last time, thus a single slow run (e.g. on a busy machine) doesn't turn the order upside down.
+   auto it = directory.entries.find(name);
+   if (it == directory.entries.end()) {
+      directory.entries.emplace(name, Entry{usage.milliseconds, usage.peakMemory});
+      directory.total += usage.milliseconds;
+   }
+   else {
+      const uint64_t milliseconds = (it->second.milliseconds + usage.milliseconds) / 2;
+      directory.total = directory.total - it->second.milliseconds + milliseconds;
+      it->second = Entry{milliseconds, usage.peakMemory};
+   }
+
+   directory.dirty = true;
+}
+
+uint64_t TimingHistory::Expected (const std::string& output)
+{
+   const auto name = std::filesystem::path{output}.filename().string();
+
+   std::lock_guard lock(mutex_);
+   Directory& directory = Find(output);
+
+   auto it = directory.entries.find(name);
+   if (it != directory.entries.end()) return it->second.milliseconds;
+
+   return directory.entries.empty() ? 0 : directory.total / directory.entries.size();
+}
+
+uint64_t TimingHistory::PeakMemory (const std::string& output)
+{
+   const auto name = std::filesystem::path{output}.filename().string();
+
+   std::lock_guard lock(mutex_);
+   Directory& directory = Find(output);
+
+   auto it = directory.entries.find(name);
+   return it == directory.entries.end() ? 0 : it->second.peakMemory;
+}
+
+void TimingHistory::Save ()
+{
+   std::lock_guard lock(mutex_);
+
+   for (auto&& [path, directory] : directories_) {
+      if (!directory.dirty) continue;
+
+      const auto file = std::filesystem::path{path} / fileName;
+      auto tmp = file;
+      tmp += ".tmp";
+
+      {
+         std::ofstream stream(tmp.string(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+         if (!stream.good()) throw std::runtime_error("Unable to open " + tmp.string());
+
+         stream < version_;
+
+         stream < directory.entries.size();
+         for (auto&& [name, entry] : directory.entries) stream < name < entry.milliseconds < entry.peakMemory;
+
+         if (!stream.good()) throw std::runtime_error("Unable to write " + tmp.string());
+      }
+
+      std::filesystem::rename(tmp, file);
+      directory.dirty = false;
+   }
+}
@@ -0,0 +1,64 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include "Process.h"
+
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+#include <mutex>
+
+
+
+// How long the jobs of the last builds took, and how much memory they needed. Stored by the file the job produces
+// (e.g. the object file) in FBuild.timings of that file's directory, thus there's one per ObjDir. Link steps see LinkStep().
+// Loaded when first needed and written back when FBuild exits.
+//
+// The jobs are started longest first, thus a long one doesn't end up running alone at the end of the build.
+class TimingHistory {
+public:
+   static TimingHistory& Instance ();
+
+   ~TimingHistory ();
+
+   // The key of a link step (exe, lib): in the ObjDir of its target, thus nothing is written next to the outputs.
+   // Without one (Linker and Librarian of the scripts), in the directory of the script.
+   static std::string LinkStep (const std::string& objDir, const std::string& output);
+
+   void Record (const std::string& output, const Process::Usage& usage);
+
+   // Milliseconds. Unknown jobs are expected to take as long as the average job of the directory (zero if there's none).
+   uint64_t Expected (const std::string& output);
+
+   // Bytes, zero if unknown.
+   uint64_t PeakMemory (const std::string& output);
+
+   void Save ();
+
+private:
+   struct Entry {
+      uint64_t milliseconds;
+      uint64_t peakMemory;
+   };
+
+   struct Directory {
+      std::unordered_map<std::string, Entry> entries;
+      uint64_t                               total{0};
+      bool                                   dirty{false};
+   };
+
+   static constexpr uint32_t version_ = 1;
+
+   std::mutex                                 mutex_;
+   std::unordered_map<std::string, Directory> directories_;
+
+   TimingHistory () { }
+
+   Directory& Find (const std::filesystem::path& output);
+};
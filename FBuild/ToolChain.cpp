@@ -6,20 +6,33 @@
 */
 
 #include "ToolChain.h"
+#include "Process.h"
 
 #include <filesystem>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <cstdio>
 
 
 namespace ToolChain {
 
    static std::string toolchain;
+#ifdef _WIN32
    static std::string platform = "x86";
+#else
+   static std::string platform = "x64";
+#endif
 
    static void CurrentFromEnvironment()
    {
       const char* envVersion = std::getenv("VisualStudioVersion");
-      if (!envVersion) return;    
+      if (!envVersion) {
+#ifndef _WIN32
+         toolchain = "GCC";   // Native builds on Linux
+#endif
+         return;
+      }
 
       const char* envPath = std::getenv("PATH");
       if (!envPath) return;
@@ -45,6 +58,9 @@ namespace ToolChain {
 
          ToolChain::toolchain.assign(newToolchain.begin(), newToolchain.end());
       }
+      else if (newToolchain == "GCC" || newToolchain == "CLANG") {
+         ToolChain::toolchain.assign(newToolchain.begin(), newToolchain.end());
+      }
       else {
          throw std::runtime_error("Unknown ToolChain " + std::string{newToolchain});
       }
@@ -130,9 +146,111 @@ namespace ToolChain {
 
          return "CALL \"" + batchfile + "\" >nul ";
       }
+      else if (tchain == "GCC" || tchain == "CLANG") {
+         return "";   // The compiler is in the PATH
+      }
       else {
          throw std::runtime_error("Unknown ToolChain " + tchain);
       }
    }
 
+
+
+   static std::mutex environmentMutex;
+   static std::map<std::string, std::vector<std::string>> environments;
+
+#ifdef _WIN32
+   static std::vector<std::string> CaptureEnvironment ()
+   {
+      const auto command = SetEnvBatchCall() + " & set";
+
+      FILE* pipe = _popen(command.c_str(), "r");
+      if (!pipe) throw std::runtime_error("Unable to run " + command);
+
+      std::string output;
+      char buffer[4096];
+      while (size_t count = std::fread(buffer, 1, sizeof(buffer), pipe)) output.append(buffer, count);
+
+      if (_pclose(pipe) != 0) throw std::runtime_error("Unable to capture the environment of " + ToolChain());
+
+      std::vector<std::string> result;
+
+      size_t begin = 0;
+      while (begin < output.size()) {
+         auto end = output.find('\n', begin);
+         if (end == std::string::npos) end = output.size();
+
+         auto line = output.substr(begin, end - begin);
+         if (!line.empty() && line.back() == '\r') line.pop_back();
+         if (line.find('=') != std::string::npos) result.push_back(std::move(line));
+
+         begin = end + 1;
+      }
+
+      return result;
+   }
+#endif
+
+   std::vector<std::string> Environment ()
+   {
+      const auto tchain = ToolChain();
+
+#ifdef _WIN32
+      if (tchain.substr(0, 4) == "MSVC") {
+         const auto key = tchain + " " + platform;
+
+         std::lock_guard lock(environmentMutex);
+
+         auto it = environments.find(key);
+         if (it == environments.end()) it = environments.emplace(key, CaptureEnvironment()).first;
+
+         return it->second;
+      }
+#endif
+
+      return Process::CurrentEnvironment();
+   }
+
+   void ResetEnvironment ()
+   {
+      std::lock_guard lock(environmentMutex);
+      environments.clear();
+   }
+
+
+
+   static std::mutex identityMutex;
+   static std::map<std::string, std::string> identities;
+
+   std::string Identity (const std::string& tool)
+   {
+      const auto key = ToolChain() + " " + platform + " " + tool;
+
+      {
+         std::lock_guard lock(identityMutex);
+         auto it = identities.find(key);
+         if (it != identities.end()) return it->second;
+      }
+
+      const auto args = Process::Split(tool);
+      if (args.empty()) return tool;
+
+      std::string identity;
+      try {
+         std::error_code ec;
+         auto executable = std::filesystem::canonical(Process::FindExecutable(args.front(), Environment()), ec);
+         if (ec) throw std::runtime_error(ec.message());
+
+         const auto size = std::filesystem::file_size(executable, ec);
+         const auto time = std::filesystem::last_write_time(executable, ec);
+
+         identity = executable.make_preferred().string() + " " + std::to_string(size) + " " + std::to_string(time.time_since_epoch().count());
+      }
+      catch (std::exception&) {
+         identity = args.front();   // Not found: the compile fails anyway
+      }
+
+      std::lock_guard lock(identityMutex);
+      return identities.emplace(key, identity).first->second;
+   }
 }
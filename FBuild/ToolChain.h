@@ -9,6 +9,7 @@
 
 #include <string>
 #include <string_view>
+#include <vector>
 
 
 namespace ToolChain {
@@ -19,6 +20,16 @@ namespace ToolChain {
    void        Platform (std::string_view newPlatform);
    std::string Platform ();
 
+   // Empty if the toolchain needs no environment of its own.
    std::string SetEnvBatchCall ();
+
+   // The environment the tools of the current toolchain run in ("NAME=value" entries).
+   // For MSVC the environment batch file runs once, and its result is cached.
+   std::vector<std::string> Environment ();
+   void ResetEnvironment ();
+
+   // The executable the tool (a command line, e.g. "g++ -std=c++17") resolves to in the Environment(), with its size and timestamp.
+   // Changes when the compiler is upgraded, for keys shared between builds. Determined once per tool.
+   std::string Identity (const std::string& tool);
 }
 
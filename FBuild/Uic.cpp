@@ -6,16 +6,28 @@
  */
 
 #include "Uic.h"
+#include "JobSystem.h"
+#include "Process.h"
+#include "Console.h"
+#include "SignatureStore.h"
+#include "TimingHistory.h"
+#include "Governor.h"
+#include "Vfs.h"
 
 #include <filesystem>
 #include <mutex>
-#include <thread>
 #include <atomic>
 #include <iostream>
 
 Uic::Uic(const std::string& qtBinDirectory)
 {
-   auto exe = std::filesystem::path{qtBinDirectory} / "uic.exe";
+#ifdef _WIN32
+   const char* executable = "uic.exe";
+#else
+   const char* executable = "uic";
+#endif
+
+   auto exe = std::filesystem::path{qtBinDirectory} / executable;
    if (!std::filesystem::exists(exe)) throw std::runtime_error{exe.string() + " doesn't exist"};
    exe.make_preferred();
    uicExe_ = exe.string();
@@ -28,57 +40,52 @@ void Uic::Compile()
 
    if (!std::filesystem::exists(outDir_)) std::filesystem::create_directories(outDir_);
 
-   std::vector<std::string> todo{files_};
    std::atomic<uint32_t> errors{0};
    std::mutex mutex{};
+   JobGroup jobs{};
+
+   const int64_t priority = JobSystem::CurrentPriority();
 
-   const auto threadFunction = [&] () {
-      std::string file{};
-      std::string outFile{};
-      std::string command{};
+   for (auto it = files_.rbegin(); it != files_.rend(); ++it) {
+      const auto expected = static_cast<int64_t>(TimingHistory::Instance().Expected(OutFile(*it)));
 
-      for (;;) {
+      jobs.Add([&, file = *it] () {
          try {
+            const std::string outFile = OutFile(file);
+
             {
                std::lock_guard guard{mutex};
-               const auto it = todo.rbegin();
-               if (it == todo.rend()) break;
-               file = (*it);
-               todo.pop_back();
-
-               outFile = OutFile(file);
-
                const auto full = std::filesystem::canonical(outFile);
                outFiles_.emplace_back(full.string());
             }
 
-            if (!NeedsRebuild(file, outFile)) continue;
+            uint64_t signature = 0;
+            if (!NeedsRebuild(file, outFile, signature)) return;
 
-            std::cout << "Moc: " << file << std::endl;
+            Console::Write("Moc: " + file);
 
-            command = uicExe_ + " -o \"" + outFile + "\" ";
+            std::string command = uicExe_ + " -o \"" + outFile + "\" ";
             command += file;
-            int rc = std::system(command.c_str());
+            Process::Usage usage;
+            int rc = Governor::Instance().RunJob(Governor::Class::Compile, outFile, file, command, Process::CurrentEnvironment(), &usage);
             if (rc != 0) ++errors;
+            else {
+               TimingHistory::Instance().Record(outFile, usage);
+               SignatureStore::Instance().Record(outFile, signature);
+            }
          }
          catch (std::exception& e) {
-            std::cout << e.what() << std::endl;
+            Console::Write(e.what());
             ++errors;
          }
          catch (...) {
             ++errors;
          }
-      }
-   };
-
-   size_t threadCount = std::thread::hardware_concurrency();
-   if (!threadCount) threadCount = 2;
-   if (threadCount > todo.size()) threadCount = todo.size();
+      }, priority + expected);
+   }
 
-   std::vector<std::thread> threads;
-   for (size_t i = 0; i < threadCount; ++i) threads.emplace_back(std::thread{threadFunction});
-
-   for (auto&& thread : threads) thread.join();
+   jobs.Wait();
+   Vfs::Changed(outDir_);
 
    if (errors) throw std::runtime_error("UIC Error");
 }
@@ -93,10 +100,12 @@ std::string Uic::OutFile(const std::string& inFile) const
    return outfile.string();
 }
 
-bool Uic::NeedsRebuild(const std::string& inFile, const std::string& outFile) const
+bool Uic::NeedsRebuild(const std::string& inFile, const std::string& outFile, uint64_t& signature) const
 {
+   signature = Signature{}.Add(uicExe_).AddFile(inFile).Value();
+
    if (!dependencyCheck_) return true;
-   if (!std::filesystem::exists(outFile)) return true;
+   if (!Vfs::Exists(outFile)) return true;
 
-   return std::filesystem::last_write_time(outFile) < std::filesystem::last_write_time(inFile);
+   return SignatureStore::Instance().Changed(outFile, signature);
 }
@@ -9,6 +9,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 
 class Uic {
@@ -38,6 +39,6 @@ private:
    bool dependencyCheck_{true};
 
    std::string OutFile (const std::string& inFile) const;
-   bool NeedsRebuild (const std::string& inFile, const std::string& outFile) const;
+   bool NeedsRebuild (const std::string& inFile, const std::string& outFile, uint64_t& signature) const;
 };
 
@@ -0,0 +1,226 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#include "Vfs.h"
+#include "Stats.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <cwctype>
+#endif
+
+
+
+
+namespace
+{
+   using Name = std::filesystem::path::string_type;
+
+   // Time and size are fetched on first use. On Windows, the directory_entry already has them from the directory listing,
+   // elsewhere it only knows the type and it takes a stat.
+   struct Entry {
+      std::filesystem::directory_entry entry;
+
+      bool                            haveType{false};
+      Vfs::Type                       type{Vfs::Type::Missing};
+      bool                            haveTime{false};
+      std::filesystem::file_time_type time{std::filesystem::file_time_type::min()};
+      bool                            haveSize{false};
+      uint64_t                        size{0};
+   };
+
+   struct Directory {
+      std::mutex                      mutex;
+      std::unordered_map<Name, Entry> entries;
+   };
+
+   std::mutex                                          directoriesMutex;
+   std::unordered_map<Name, std::shared_ptr<Directory>> directories;
+   std::atomic<uint64_t>                               generation{1};
+
+
+   // Windows file names are case insensitive
+   Name Fold (Name name)
+   {
+#ifdef _WIN32
+      for (auto& ch : name) ch = static_cast<wchar_t>(std::towlower(ch));
+#endif
+      return name;
+   }
+
+   std::filesystem::path Normal (const std::filesystem::path& path)
+   {
+      std::filesystem::path normal = path.is_absolute() ? path.lexically_normal() : std::filesystem::absolute(path).lexically_normal();
+      if (!normal.has_filename() && normal.has_relative_path()) normal = normal.parent_path();   // "dir/"
+      return normal;
+   }
+
+   std::shared_ptr<Directory> Read (const std::filesystem::path& path)
+   {
+      Stats::Add(Stats::Counter::VfsDirectoryReads);
+
+      auto directory = std::make_shared<Directory>();
+
+      std::error_code ec;
+      for (std::filesystem::directory_iterator it{path, ec}, end; !ec && it != end; it.increment(ec)) {
+         directory->entries.emplace(Fold(it->path().filename().native()), Entry{*it});
+      }
+
+      return directory;
+   }
+
+   std::shared_ptr<Directory> Get (const std::filesystem::path& path)
+   {
+      const Name key = Fold(path.native());
+
+      {
+         std::lock_guard lock(directoriesMutex);
+         auto it = directories.find(key);
+         if (it != directories.end()) return it->second;
+      }
+
+      auto directory = Read(path);
+
+      std::lock_guard lock(directoriesMutex);
+      return directories.emplace(key, std::move(directory)).first->second;   // Another thread may have been faster
+   }
+
+   Vfs::Type TypeOf (const std::filesystem::directory_entry& entry)
+   {
+      Stats::Add(Stats::Counter::VfsStatCalls);
+
+      std::error_code ec;
+      if (entry.is_regular_file(ec)) return Vfs::Type::File;
+      if (entry.is_directory(ec)) return Vfs::Type::Directory;
+      return entry.exists(ec) ? Vfs::Type::Other : Vfs::Type::Missing;   // e.g. a dangling link
+   }
+
+   // Calls f with the entry of path, locked. Without an entry (file doesn't exist, root directory), f isn't called.
+   template<class F>
+   void WithEntry (const std::filesystem::path& path, const F& f)
+   {
+      const auto normal = Normal(path);
+      if (!normal.has_filename()) return;
+
+      auto directory = Get(normal.parent_path());
+
+      std::lock_guard lock(directory->mutex);
+      auto it = directory->entries.find(Fold(normal.filename().native()));
+      if (it != directory->entries.end()) f(it->second);
+   }
+}
+
+
+
+
+namespace Vfs
+{
+   Type Status (const std::filesystem::path& path)
+   {
+      Stats::Add(Stats::Counter::VfsQueries);
+
+      const auto normal = Normal(path);
+      if (!normal.has_filename()) {
+         Stats::Add(Stats::Counter::VfsStatCalls);
+         std::error_code ec;
+         return std::filesystem::is_directory(normal, ec) ? Type::Directory : Type::Missing;
+      }
+
+      Type type = Type::Missing;
+
+      WithEntry(normal, [&type] (Entry& entry) {
+         if (!entry.haveType) {
+            entry.type = TypeOf(entry.entry);
+            entry.haveType = true;
+         }
+         type = entry.type;
+      });
+
+      return type;
+   }
+
+   bool Exists (const std::filesystem::path& path)
+   {
+      return Status(path) != Type::Missing;
+   }
+
+   bool IsFile (const std::filesystem::path& path)
+   {
+      return Status(path) == Type::File;
+   }
+
+   bool IsDirectory (const std::filesystem::path& path)
+   {
+      return Status(path) == Type::Directory;
+   }
+
+   std::filesystem::file_time_type LastWriteTime (const std::filesystem::path& path)
+   {
+      Stats::Add(Stats::Counter::VfsQueries);
+
+      auto time = std::filesystem::file_time_type::min();
+
+      WithEntry(path, [&time] (Entry& entry) {
+         if (!entry.haveTime) {
+            Stats::Add(Stats::Counter::VfsStatCalls);
+            std::error_code ec;
+            const auto t = entry.entry.last_write_time(ec);
+            if (!ec) entry.time = t;
+            entry.haveTime = true;
+         }
+         time = entry.time;
+      });
+
+      return time;
+   }
+
+   uint64_t FileSize (const std::filesystem::path& path)
+   {
+      Stats::Add(Stats::Counter::VfsQueries);
+
+      uint64_t size = 0;
+
+      WithEntry(path, [&size] (Entry& entry) {
+         if (!entry.haveSize) {
+            Stats::Add(Stats::Counter::VfsStatCalls);
+            std::error_code ec;
+            const auto s = entry.entry.file_size(ec);
+            if (!ec) entry.size = s;
+            entry.haveSize = true;
+         }
+         size = entry.size;
+      });
+
+      return size;
+   }
+
+   void Changed (const std::filesystem::path& path)
+   {
+      const auto normal = Normal(path);
+
+      std::lock_guard lock(directoriesMutex);
+      directories.erase(Fold(normal.native()));
+      directories.erase(Fold(normal.parent_path().native()));
+      ++generation;
+   }
+
+   void Clear ()
+   {
+      std::lock_guard lock(directoriesMutex);
+      directories.clear();
+      ++generation;
+   }
+
+   uint64_t Generation ()
+   {
+      return generation.load(std::memory_order_acquire);
+   }
+}
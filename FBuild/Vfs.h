@@ -0,0 +1,39 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+
+// A snapshot of the file system metadata for the out-of-date checks.
+// The first query of a directory reads it in one go, all further queries of files in it are answered from memory.
+// Whoever writes files during the build has to call Changed(), otherwise the snapshot still shows the old state.
+namespace Vfs
+{
+   enum class Type { Missing, File, Directory, Other };
+
+   Type Status (const std::filesystem::path& path);
+
+   bool Exists (const std::filesystem::path& path);
+   bool IsFile (const std::filesystem::path& path);
+   bool IsDirectory (const std::filesystem::path& path);
+
+   // file_time_type::min() and 0 if the file doesn't exist.
+   std::filesystem::file_time_type LastWriteTime (const std::filesystem::path& path);
+   uint64_t FileSize (const std::filesystem::path& path);
+
+   // The file or directory was written or removed: the directories are read again on the next query.
+   void Changed (const std::filesystem::path& path);
+
+   // Something unknown (e.g. a script) might have changed anything.
+   void Clear ();
+
+   // Counts Changed() and Clear(). What's derived from the snapshot stays valid as long as it's the same.
+   uint64_t Generation ();
+}
@@ -0,0 +1,27 @@
+/*
+ * Any copyright is dedicated to the Public Domain.
+ * http://creativecommons.org/publicdomain/zero/1.0/*
+ *
+ * Author: Frank Barwich
+ */
+
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+#include <Shlwapi.h>
+#else
+#include <fnmatch.h>
+#endif
+
+
+// Matches a filename against a pattern with * and ?
+inline bool MatchesWildcard (const std::string& filename, const std::string& pattern)
+{
+#ifdef _WIN32
+   return ::PathMatchSpec(filename.c_str(), pattern.c_str()) != FALSE;
+#else
+   return ::fnmatch(pattern.c_str(), filename.c_str(), 0) == 0;
+#endif
+}